@@ -35,7 +35,7 @@ const Type* Array::getElementType() const {
     return ElementType.get();
 }
 std::unique_ptr<AstExpr> Array::defaultValue() const {
-    std::vector<std::unique_ptr<AstExpr>> emptyElements;
+    std::vector<AstExprPtr> emptyElements;
     return std::make_unique<AstExprConstArray>(SourceLocation {0, 0}, ElementType->clone(), std::move(emptyElements));
 }
 std::unique_ptr<Type> Array::clone() const {
@@ -43,15 +43,21 @@ std::unique_ptr<Type> Array::clone() const {
 }
 
 
-AstExpr::AstExpr(const SourceLocation& loc) : Location(loc) {}
+AstExpr::AstExpr(const SourceLocation& loc, AstExprKind kind) : Location(loc), Kind(kind) {}
 const SourceLocation& AstExpr::getLocation() const { return Location; }
+AstExprPtr AstExpr::clone() const {
+    if (AstExprPtr self = weak_from_this().lock()) {
+        return self;
+    }
+    return copy();
+}
 
-AstExprConst::AstExprConst(const SourceLocation& loc) : AstExpr(loc) {}
+AstExprConst::AstExprConst(const SourceLocation& loc, AstExprKind kind) : AstExpr(loc, kind) {}
 
-AstExprConstLong::AstExprConstLong(const SourceLocation &loc, const long &Value) : AstExprConst(loc), Value(Value) {}
+AstExprConstLong::AstExprConstLong(const SourceLocation &loc, const long &Value) : AstExprConst(loc, AstExprKind::ConstLong), Value(Value) {}
 long AstExprConstLong::getValue() const { return Value; }
-std::unique_ptr<AstExpr> AstExprConstLong::clone() const {
-    return std::make_unique<AstExprConstLong>(Location, Value);
+AstExprPtr AstExprConstLong::copy() const {
+    return std::make_shared<AstExprConstLong>(Location, Value);
 }
 std::unique_ptr<InterpreterValue> AstExprConstLong::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -59,12 +65,15 @@ std::unique_ptr<InterpreterValue> AstExprConstLong::accept(const AstValueVisitor
 llvm::Value *AstExprConstLong::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprConstLong::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 
-AstExprConstBool::AstExprConstBool(const SourceLocation &loc, const bool &Value) : AstExprConst(loc), Value(Value) {}
+AstExprConstBool::AstExprConstBool(const SourceLocation &loc, const bool &Value) : AstExprConst(loc, AstExprKind::ConstBool), Value(Value) {}
 bool AstExprConstBool::getValue() const { return Value; }
-std::unique_ptr<AstExpr> AstExprConstBool::clone() const {
-    return std::make_unique<AstExprConstBool>(Location, Value);
+AstExprPtr AstExprConstBool::copy() const {
+    return std::make_shared<AstExprConstBool>(Location, Value);
 }
 std::unique_ptr<InterpreterValue> AstExprConstBool::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -72,23 +81,22 @@ std::unique_ptr<InterpreterValue> AstExprConstBool::accept(const AstValueVisitor
 llvm::Value *AstExprConstBool::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprConstBool::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 AstExprConstArray::AstExprConstArray(const SourceLocation &loc, 
                                      std::unique_ptr<Type> ElementType, 
-                                     std::vector<std::unique_ptr<AstExpr>> Elements)
-    : AstExprConst(loc), ElementType(std::move(ElementType)), Elements(std::move(Elements)) {}
+                                     std::vector<AstExprPtr> Elements)
+    : AstExprConst(loc, AstExprKind::ConstArray), ElementType(std::move(ElementType)), Elements(std::move(Elements)) {}
 const Type* AstExprConstArray::getElementType() const { 
     return ElementType.get(); 
 }
-const std::vector<std::unique_ptr<AstExpr>>& AstExprConstArray::getElements() const {
+const std::vector<AstExprPtr>& AstExprConstArray::getElements() const {
     return Elements;
 }
-std::unique_ptr<AstExpr> AstExprConstArray::clone() const {
-    std::vector<std::unique_ptr<AstExpr>> clonedElements;
-    for (const auto& elem : Elements) {
-        clonedElements.push_back(elem->clone());
-    }
-    return std::make_unique<AstExprConstArray>(Location, ElementType->clone(), std::move(clonedElements));
+AstExprPtr AstExprConstArray::copy() const {
+    return std::make_shared<AstExprConstArray>(Location, ElementType->clone(), Elements);
 }
 std::unique_ptr<InterpreterValue> AstExprConstArray::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -96,42 +104,58 @@ std::unique_ptr<InterpreterValue> AstExprConstArray::accept(const AstValueVisito
 llvm::Value *AstExprConstArray::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprConstArray::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
+
+AstArg::AstArg(const SourceLocation& loc, Symbol name)
+    : Location(loc), Name(name) {}
 
-AstArg::AstArg(const SourceLocation& loc, const std::string& name)
+AstImport::AstImport(const SourceLocation& loc, const std::string& name)
     : Location(loc), Name(name) {}
 
-AstPrototype::AstPrototype(const SourceLocation& loc, const std::string& name, std::vector<AstArg> args)
+AstPrototype::AstPrototype(const SourceLocation& loc, Symbol name, std::vector<AstArg> args)
     : Location(loc), Name(name), Args(std::move(args)) {}
 const SourceLocation& AstPrototype::getLocation() const { return Location; }
-const std::string& AstPrototype::getName() const { return Name; }
+Symbol AstPrototype::getName() const { return Name; }
 const std::vector<AstArg>& AstPrototype::getArgs() const { return Args; }
 
-AstFunction::AstFunction(const SourceLocation &loc, std::unique_ptr<AstPrototype> Proto, std::unique_ptr<AstExpr> Body)
+AstFunction::AstFunction(const SourceLocation &loc, std::shared_ptr<const AstPrototype> Proto, AstExprPtr Body)
     : Location(loc), Proto(std::move(Proto)), Body(std::move(Body)) {}
+AstFunction::AstFunction(const SourceLocation &loc, std::shared_ptr<const AstPrototype> Proto, BodyParser parseBody)
+    : Location(loc), Proto(std::move(Proto)), Lazy(std::make_shared<LazyBody>(LazyBody {std::move(parseBody), nullptr})) {}
 const SourceLocation& AstFunction::getLocation() const { return Location; }
 const AstPrototype* AstFunction::getPrototype() const { return Proto.get(); }
-const AstExpr* AstFunction::getBody() const { return Body.get(); }
 
-std::unique_ptr<AstFunction> AstFunction::clone() const {
-    std::vector<AstArg> clonedArgs;
-    for (const auto& arg : Proto->getArgs()) {
-        clonedArgs.push_back(AstArg(arg.Location, arg.Name));
+const AstExpr* AstFunction::getBody() const {
+    if (!Lazy) return Body.get();
+    if (!Lazy->Body) {
+        Lazy->Body = Lazy->Parse();
     }
-    return std::make_unique<AstFunction>(
-        Location,
-        std::make_unique<AstPrototype>(
-            Proto->getLocation(),
-            Proto->getName(),
-            std::move(clonedArgs)
-        ),
-        Body->clone()
-    );
-}
-
-AstExprVariable::AstExprVariable(const SourceLocation &loc, const std::string &Name) : AstExpr(loc), Name(Name) {}
-const std::string& AstExprVariable::getName() const { return Name; }
-std::unique_ptr<AstExpr> AstExprVariable::clone() const {
-    return std::make_unique<AstExprVariable>(Location, Name);
+    return Lazy->Body.get();
+}
+
+bool AstFunction::isBodyParsed() const { return !Lazy || Lazy->Body; }
+bool AstFunction::isInternal() const { return Internal; }
+void AstFunction::setInternal(bool internal) { Internal = internal; }
+
+std::unique_ptr<AstFunction> AstFunction::clone() const {
+    auto copy = std::make_unique<AstFunction>(Location, Proto, Body);
+    copy->Lazy = Lazy;
+    copy->Internal = Internal;
+    return copy;
+}
+
+std::unique_ptr<AstFunction> AstFunction::withBody(AstExprPtr body) const {
+    auto copy = std::make_unique<AstFunction>(Location, Proto, std::move(body));
+    copy->Internal = Internal;
+    return copy;
+}
+
+AstExprVariable::AstExprVariable(const SourceLocation &loc, Symbol Name) : AstExpr(loc, AstExprKind::Variable), Name(Name) {}
+Symbol AstExprVariable::getName() const { return Name; }
+AstExprPtr AstExprVariable::copy() const {
+    return std::make_shared<AstExprVariable>(Location, Name);
 }
 std::unique_ptr<InterpreterValue> AstExprVariable::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -139,21 +163,23 @@ std::unique_ptr<InterpreterValue> AstExprVariable::accept(const AstValueVisitor&
 llvm::Value *AstExprVariable::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprVariable::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 
-AstExprIndex::AstExprIndex(const SourceLocation &loc, const std::unique_ptr<AstExpr> &Indexee,
-                           const std::unique_ptr<AstExpr> &Indexer) 
-    : AstExpr(loc), 
-      Indexee(Indexee->clone()), 
-      Indexer(Indexer->clone()) {}
-const std::unique_ptr<AstExpr>& AstExprIndex::getIndexee() const {
+AstExprIndex::AstExprIndex(const SourceLocation &loc, AstExprPtr Indexee, AstExprPtr Indexer)
+    : AstExpr(loc, AstExprKind::Index),
+      Indexee(std::move(Indexee)),
+      Indexer(std::move(Indexer)) {}
+const AstExprPtr& AstExprIndex::getIndexee() const {
     return Indexee;
 }
-const std::unique_ptr<AstExpr>& AstExprIndex::getIndexer() const {
+const AstExprPtr& AstExprIndex::getIndexer() const {
     return Indexer;
 }
-std::unique_ptr<AstExpr> AstExprIndex::clone() const {
-    return std::make_unique<AstExprIndex>(Location, Indexee, Indexer);
+AstExprPtr AstExprIndex::copy() const {
+    return std::make_shared<AstExprIndex>(Location, Indexee, Indexer);
 }
 std::unique_ptr<InterpreterValue> AstExprIndex::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -161,18 +187,17 @@ std::unique_ptr<InterpreterValue> AstExprIndex::accept(const AstValueVisitor& vi
 llvm::Value *AstExprIndex::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprIndex::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 
-AstExprCall::AstExprCall(const SourceLocation &loc, const std::string &Callee,
-            std::vector<std::unique_ptr<AstExpr>> Args) : AstExpr(loc), Callee(Callee), Args(std::move(Args)) {}
-const std::string& AstExprCall::getCallee() const { return Callee; }
-const std::vector<std::unique_ptr<AstExpr>>& AstExprCall::getArgs() const { return Args; }
-std::unique_ptr<AstExpr> AstExprCall::clone() const {
-    std::vector<std::unique_ptr<AstExpr>> clonedArgs;
-    for (const auto& arg : Args) {
-        clonedArgs.push_back(arg->clone());
-    }
-    return std::make_unique<AstExprCall>(Location, Callee, std::move(clonedArgs));
+AstExprCall::AstExprCall(const SourceLocation &loc, Symbol Callee,
+            std::vector<AstExprPtr> Args) : AstExpr(loc, AstExprKind::Call), Callee(Callee), Args(std::move(Args)) {}
+Symbol AstExprCall::getCallee() const { return Callee; }
+const std::vector<AstExprPtr>& AstExprCall::getArgs() const { return Args; }
+AstExprPtr AstExprCall::copy() const {
+    return std::make_shared<AstExprCall>(Location, Callee, Args);
 }
 std::unique_ptr<InterpreterValue> AstExprCall::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -180,17 +205,20 @@ std::unique_ptr<InterpreterValue> AstExprCall::accept(const AstValueVisitor& vis
 llvm::Value *AstExprCall::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprCall::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 AstExprLetIn::AstExprLetIn(const SourceLocation &loc,
-            const std::string &Variable,
-            std::unique_ptr<AstExpr> Expr,
-            std::unique_ptr<AstExpr> Body) :
-    AstExpr(loc), Variable(Variable), Expr(std::move(Expr)), Body(std::move(Body)) {}
-const std::string& AstExprLetIn::getVariable() const { return Variable; }
+            Symbol Variable,
+            AstExprPtr Expr,
+            AstExprPtr Body) :
+    AstExpr(loc, AstExprKind::LetIn), Variable(Variable), Expr(std::move(Expr)), Body(std::move(Body)) {}
+Symbol AstExprLetIn::getVariable() const { return Variable; }
 const AstExpr* AstExprLetIn::getExpr() const { return Expr.get(); }
 const AstExpr* AstExprLetIn::getBody() const { return Body.get(); }
-std::unique_ptr<AstExpr> AstExprLetIn::clone() const {
-    return std::make_unique<AstExprLetIn>(Location, Variable, Expr->clone(), Body->clone());
+AstExprPtr AstExprLetIn::copy() const {
+    return std::make_shared<AstExprLetIn>(Location, Variable, Expr, Body);
 }
 std::unique_ptr<InterpreterValue> AstExprLetIn::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
@@ -198,19 +226,22 @@ std::unique_ptr<InterpreterValue> AstExprLetIn::accept(const AstValueVisitor& vi
 llvm::Value *AstExprLetIn::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+void AstExprLetIn::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 template <BinaryOpKindIntToInt OpKind>
 AstExprBinaryIntToInt<OpKind>::AstExprBinaryIntToInt(const SourceLocation &loc,
-                        std::unique_ptr<AstExpr> LHS,
-                        std::unique_ptr<AstExpr> RHS) :
-    AstExpr(loc), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+                        AstExprPtr LHS,
+                        AstExprPtr RHS) :
+    AstExpr(loc, toExprKind(OpKind)), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
 template <BinaryOpKindIntToInt OpKind>
 const AstExpr* AstExprBinaryIntToInt<OpKind>::getLHS() const { return LHS.get(); }
 template <BinaryOpKindIntToInt OpKind>
 const AstExpr* AstExprBinaryIntToInt<OpKind>::getRHS() const { return RHS.get(); }
 template <BinaryOpKindIntToInt OpKind>
-std::unique_ptr<AstExpr> AstExprBinaryIntToInt<OpKind>::clone() const {
-    return std::make_unique<AstExprBinaryIntToInt<OpKind>>(Location, LHS->clone(), RHS->clone());
+AstExprPtr AstExprBinaryIntToInt<OpKind>::copy() const {
+    return std::make_shared<AstExprBinaryIntToInt<OpKind>>(Location, LHS, RHS);
 }
 template <BinaryOpKindIntToInt OpKind>
 std::unique_ptr<InterpreterValue> AstExprBinaryIntToInt<OpKind>::accept(const AstValueVisitor& visitor) const {
@@ -220,6 +251,10 @@ template <BinaryOpKindIntToInt OpKind>
 llvm::Value *AstExprBinaryIntToInt<OpKind>::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+template <BinaryOpKindIntToInt OpKind>
+void AstExprBinaryIntToInt<OpKind>::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 template class AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>;
 template class AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>;
@@ -228,16 +263,16 @@ template class AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>;
 
 template <BinaryOpKindIntToBool OpKind>
 AstExprBinaryIntToBool<OpKind>::AstExprBinaryIntToBool(const SourceLocation &loc,
-                        std::unique_ptr<AstExpr> LHS,
-                        std::unique_ptr<AstExpr> RHS) :
-    AstExpr(loc), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+                        AstExprPtr LHS,
+                        AstExprPtr RHS) :
+    AstExpr(loc, toExprKind(OpKind)), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
 template <BinaryOpKindIntToBool OpKind>
 const AstExpr* AstExprBinaryIntToBool<OpKind>::getLHS() const { return LHS.get(); }
 template <BinaryOpKindIntToBool OpKind>
 const AstExpr* AstExprBinaryIntToBool<OpKind>::getRHS() const { return RHS.get(); }
 template <BinaryOpKindIntToBool OpKind>
-std::unique_ptr<AstExpr> AstExprBinaryIntToBool<OpKind>::clone() const {
-    return std::make_unique<AstExprBinaryIntToBool<OpKind>>(Location, LHS->clone(), RHS->clone());
+AstExprPtr AstExprBinaryIntToBool<OpKind>::copy() const {
+    return std::make_shared<AstExprBinaryIntToBool<OpKind>>(Location, LHS, RHS);
 }
 template <BinaryOpKindIntToBool OpKind>
 std::unique_ptr<InterpreterValue> AstExprBinaryIntToBool<OpKind>::accept(const AstValueVisitor& visitor) const {
@@ -247,6 +282,10 @@ template <BinaryOpKindIntToBool OpKind>
 llvm::Value *AstExprBinaryIntToBool<OpKind>::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+template <BinaryOpKindIntToBool OpKind>
+void AstExprBinaryIntToBool<OpKind>::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 template class AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>;
 template class AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>;
@@ -257,16 +296,16 @@ template class AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>;
 
 template <BinaryOpKindBoolToBool OpKind>
 AstExprBinaryBoolToBool<OpKind>::AstExprBinaryBoolToBool(const SourceLocation &loc,
-                        std::unique_ptr<AstExpr> LHS,
-                        std::unique_ptr<AstExpr> RHS) :
-    AstExpr(loc), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+                        AstExprPtr LHS,
+                        AstExprPtr RHS) :
+    AstExpr(loc, toExprKind(OpKind)), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
 template <BinaryOpKindBoolToBool OpKind>
 const AstExpr* AstExprBinaryBoolToBool<OpKind>::getLHS() const { return LHS.get(); }
 template <BinaryOpKindBoolToBool OpKind>
 const AstExpr* AstExprBinaryBoolToBool<OpKind>::getRHS() const { return RHS.get(); }
 template <BinaryOpKindBoolToBool OpKind>
-std::unique_ptr<AstExpr> AstExprBinaryBoolToBool<OpKind>::clone() const {
-    return std::make_unique<AstExprBinaryBoolToBool<OpKind>>(Location, LHS->clone(), RHS->clone());
+AstExprPtr AstExprBinaryBoolToBool<OpKind>::copy() const {
+    return std::make_shared<AstExprBinaryBoolToBool<OpKind>>(Location, LHS, RHS);
 }
 template <BinaryOpKindBoolToBool OpKind>
 std::unique_ptr<InterpreterValue> AstExprBinaryBoolToBool<OpKind>::accept(const AstValueVisitor& visitor) const {
@@ -276,34 +315,34 @@ template <BinaryOpKindBoolToBool OpKind>
 llvm::Value *AstExprBinaryBoolToBool<OpKind>::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
 }
+template <BinaryOpKindBoolToBool OpKind>
+void AstExprBinaryBoolToBool<OpKind>::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
+}
 
 template class AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>;
 template class AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>;
 
 AstExprMatchPath::AstExprMatchPath(const SourceLocation &loc,
-                    std::unique_ptr<AstExpr> guard,
-                    std::unique_ptr<AstExpr> body) :
+                    AstExprPtr guard,
+                    AstExprPtr body) :
     Location(loc), Guard(std::move(guard)), Body(std::move(body)) {}
 const SourceLocation& AstExprMatchPath::getLocation() const { return Location; }
 const AstExpr* AstExprMatchPath::getGuard() const { return Guard.get(); }
 const AstExpr* AstExprMatchPath::getBody() const { return Body.get(); }
-std::unique_ptr<AstExprMatchPath> AstExprMatchPath::clone() const {
-    return std::make_unique<AstExprMatchPath>(Location, Guard->clone(), Body->clone());
-}
 
-AstExprMatch::AstExprMatch(const SourceLocation &loc, std::vector<std::unique_ptr<AstExprMatchPath>> Paths) :
-    AstExpr(loc), Paths(std::move(Paths)) {}
-const std::vector<std::unique_ptr<AstExprMatchPath>>& AstExprMatch::getPaths() const { return Paths; }
-std::unique_ptr<AstExpr> AstExprMatch::clone() const {
-    std::vector<std::unique_ptr<AstExprMatchPath>> clonedPaths;
-    for (const auto& path : Paths) {
-        clonedPaths.push_back(path->clone());
-    }
-    return std::make_unique<AstExprMatch>(Location, std::move(clonedPaths));
+AstExprMatch::AstExprMatch(const SourceLocation &loc, std::vector<AstExprMatchPathPtr> Paths) :
+    AstExpr(loc, AstExprKind::Match), Paths(std::move(Paths)) {}
+const std::vector<AstExprMatchPathPtr>& AstExprMatch::getPaths() const { return Paths; }
+AstExprPtr AstExprMatch::copy() const {
+    return std::make_shared<AstExprMatch>(Location, Paths);
 }
 std::unique_ptr<InterpreterValue> AstExprMatch::accept(const AstValueVisitor& visitor) const {
     return visitor.visit(*this);
 }
 llvm::Value *AstExprMatch::accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const {
     return visitor.visit(*this, ctx);
+}
+void AstExprMatch::accept(AstVisitor& visitor) const {
+    visitor.visit(*this);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef AST_HPP
 #define AST_HPP
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <memory>
 #include <vector>
@@ -10,6 +12,7 @@
 #include "llvm/IR/Value.h"
 
 #include "source_location.hpp"
+#include "symbol.hpp"
 
 // Forward declarations
 class InterpreterValue;
@@ -27,6 +30,26 @@ enum class BinaryOpKindBoolToBool {
     And, Or
 };
 
+// The concrete class of an AstExpr, so code can switch over nodes instead
+// of going through accept() and a visitor; see ast_dispatch.hpp. Binary
+// operators are in the same order as their BinaryOpKind enums.
+enum class AstExprKind : uint8_t {
+    ConstLong, ConstBool, ConstArray, Variable, Index, Call, LetIn, Match,
+    Add, Sub, Mul, Div,
+    Eq, Neq, Leq, Lt, Geq, Gt,
+    And, Or
+};
+
+constexpr AstExprKind toExprKind(BinaryOpKindIntToInt op) {
+    return static_cast<AstExprKind>(static_cast<uint8_t>(AstExprKind::Add) + static_cast<uint8_t>(op));
+}
+constexpr AstExprKind toExprKind(BinaryOpKindIntToBool op) {
+    return static_cast<AstExprKind>(static_cast<uint8_t>(AstExprKind::Eq) + static_cast<uint8_t>(op));
+}
+constexpr AstExprKind toExprKind(BinaryOpKindBoolToBool op) {
+    return static_cast<AstExprKind>(static_cast<uint8_t>(AstExprKind::And) + static_cast<uint8_t>(op));
+}
+
 // --- Visitor Interface Definition ---
 class AstExpr;
 class AstExprConstLong;
@@ -49,6 +72,11 @@ template <BinaryOpKindBoolToBool OpKind> class AstExprBinaryBoolToBool;
 
 class AstExprMatchPath;
 
+// Nodes are immutable once built, so trees share subtrees freely and copying
+// a tree only copies a pointer.
+using AstExprPtr = std::shared_ptr<const AstExpr>;
+using AstExprMatchPathPtr = std::shared_ptr<const AstExprMatchPath>;
+
 class AstValueVisitor {
 public:
     virtual ~AstValueVisitor() = default;
@@ -109,6 +137,35 @@ public:
     virtual llvm::Value *visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>& expr, CodegenContext& ctx) const = 0;
 };
 
+class AstVisitor {
+public:
+    virtual ~AstVisitor() = default;
+
+    virtual void visit(const AstExprConstLong& expr) = 0;
+    virtual void visit(const AstExprConstBool& expr) = 0;
+    virtual void visit(const AstExprConstArray& expr) = 0;
+    virtual void visit(const AstExprVariable& expr) = 0;
+    virtual void visit(const AstExprIndex& expr) = 0;
+    virtual void visit(const AstExprCall& expr) = 0;
+    virtual void visit(const AstExprLetIn& expr) = 0;
+    virtual void visit(const AstExprMatch& expr) = 0;
+
+    virtual void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>& expr) = 0;
+
+    virtual void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>& expr) = 0;
+    virtual void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>& expr) = 0;
+
+    virtual void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>& expr) = 0;
+    virtual void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>& expr) = 0;
+};
+
 class Type {
 public:
     virtual ~Type() = default;
@@ -148,22 +205,29 @@ public:
 
 
 
-class AstExpr {
+class AstExpr : public std::enable_shared_from_this<AstExpr> {
 protected:
     SourceLocation Location;
+    const AstExprKind Kind;
+    // A new node with the same location and children.
+    virtual AstExprPtr copy() const = 0;
 public:
-    AstExpr(const SourceLocation& loc);
+    AstExpr(const SourceLocation& loc, AstExprKind kind);
     virtual ~AstExpr() = default;
-    virtual std::unique_ptr<AstExpr> clone() const = 0;
+    // Shares this node if an AstExprPtr owns it, as it does every node inside
+    // a tree; a node owned some other way is copied, sharing its children.
+    AstExprPtr clone() const;
     const SourceLocation& getLocation() const;
+    AstExprKind getKind() const { return Kind; }
 
     virtual std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const = 0;
     virtual llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const = 0;
+    virtual void accept(AstVisitor& visitor) const = 0;
 };
 
 class AstExprConst : public AstExpr {
 public:
-    AstExprConst(const SourceLocation& loc);
+    AstExprConst(const SourceLocation& loc, AstExprKind kind);
 };
 
 class AstExprConstLong : public AstExprConst {
@@ -171,10 +235,12 @@ class AstExprConstLong : public AstExprConst {
 public:
     AstExprConstLong(const SourceLocation &loc, const long &Value);
     long getValue() const;
-    std::unique_ptr<AstExpr> clone() const override;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 class AstExprConstBool : public AstExprConst {
@@ -182,129 +248,170 @@ class AstExprConstBool : public AstExprConst {
 public:
     AstExprConstBool(const SourceLocation &loc, const bool &Value);
     bool getValue() const;
-    std::unique_ptr<AstExpr> clone() const override;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 class AstExprConstArray : public AstExprConst {
     std::unique_ptr<Type> ElementType;
-    std::vector<std::unique_ptr<AstExpr>> Elements;
+    std::vector<AstExprPtr> Elements;
 public:
-    AstExprConstArray(const SourceLocation &loc, std::unique_ptr<Type> ElementType, std::vector<std::unique_ptr<AstExpr>> Elements);
+    AstExprConstArray(const SourceLocation &loc, std::unique_ptr<Type> ElementType, std::vector<AstExprPtr> Elements);
     const Type* getElementType() const;
-    const std::vector<std::unique_ptr<AstExpr>>& getElements() const;
-    std::unique_ptr<AstExpr> clone() const override;
+    const std::vector<AstExprPtr>& getElements() const;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 
 struct AstArg {
+    SourceLocation Location;
+    Symbol Name;
+    AstArg(const SourceLocation& loc, Symbol name);
+};
+
+struct AstImport {
     SourceLocation Location;
     std::string Name;
-    AstArg(const SourceLocation& loc, const std::string& name);
+    AstImport(const SourceLocation& loc, const std::string& name);
 };
 
 class AstPrototype {
     SourceLocation Location;
-    std::string Name;
+    Symbol Name;
     std::vector<AstArg> Args;
 public:
-    AstPrototype(const SourceLocation& loc, const std::string& name, std::vector<AstArg> args);
+    AstPrototype(const SourceLocation& loc, Symbol name, std::vector<AstArg> args);
     const SourceLocation& getLocation() const;
-    const std::string& getName() const;
+    Symbol getName() const;
     const std::vector<AstArg>& getArgs() const;
 };
 
 class AstFunction {
+public:
+    using BodyParser = std::function<AstExprPtr()>;
+private:
+    // A body that is parsed on first use. Clones share it, so it is parsed
+    // at most once however often the function is copied.
+    struct LazyBody {
+        BodyParser Parse;
+        AstExprPtr Body;
+    };
+
     SourceLocation Location;
-    std::unique_ptr<AstPrototype> Proto;
-    std::unique_ptr<AstExpr> Body;
+    std::shared_ptr<const AstPrototype> Proto;
+    AstExprPtr Body;
+    std::shared_ptr<LazyBody> Lazy;
+    bool Internal = false;
 public:
-    AstFunction(const SourceLocation &loc, std::unique_ptr<AstPrototype> Proto, std::unique_ptr<AstExpr> Body);
+    AstFunction(const SourceLocation &loc, std::shared_ptr<const AstPrototype> Proto, AstExprPtr Body);
+    AstFunction(const SourceLocation &loc, std::shared_ptr<const AstPrototype> Proto, BodyParser parseBody);
     const SourceLocation& getLocation() const;
     const AstPrototype* getPrototype() const;
+    // Parses a lazy body first, which may throw ParserException.
     const AstExpr* getBody() const;
+    bool isBodyParsed() const;
+    // Made up by the compiler rather than written in the source, like
+    // accumulator helpers and specialized clones. Never exported.
+    bool isInternal() const;
+    void setInternal(bool internal);
+    // Shares the prototype and body with this function.
     std::unique_ptr<AstFunction> clone() const;
+    // Shares the prototype with this function, but has another body.
+    std::unique_ptr<AstFunction> withBody(AstExprPtr body) const;
 };
 
 class AstExprVariable : public AstExpr {
-    std::string Name;
+    Symbol Name;
 public:
-    AstExprVariable(const SourceLocation &loc, const std::string &Name);
-    const std::string& getName() const;
-    std::unique_ptr<AstExpr> clone() const override;
+    AstExprVariable(const SourceLocation &loc, Symbol Name);
+    Symbol getName() const;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 class AstExprIndex : public AstExpr {
-    std::unique_ptr<AstExpr> Indexee;
-    std::unique_ptr<AstExpr> Indexer;
+    AstExprPtr Indexee;
+    AstExprPtr Indexer;
 public:
-    AstExprIndex(const SourceLocation &loc, const std::unique_ptr<AstExpr> &Indexee,
-                 const std::unique_ptr<AstExpr> &Indexer);
-    const std::unique_ptr<AstExpr>& getIndexee() const;
-    const std::unique_ptr<AstExpr>& getIndexer() const;
-    std::unique_ptr<AstExpr> clone() const override;
+    AstExprIndex(const SourceLocation &loc, AstExprPtr Indexee, AstExprPtr Indexer);
+    const AstExprPtr& getIndexee() const;
+    const AstExprPtr& getIndexer() const;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 
 
 class AstExprCall : public AstExpr {
-    std::string Callee;
-    std::vector<std::unique_ptr<AstExpr>> Args;
+    Symbol Callee;
+    std::vector<AstExprPtr> Args;
 public:
-    AstExprCall(const SourceLocation &loc, const std::string &Callee,
-                std::vector<std::unique_ptr<AstExpr>> Args);
-    const std::string& getCallee() const;
-    const std::vector<std::unique_ptr<AstExpr>>& getArgs() const;
-    std::unique_ptr<AstExpr> clone() const override;
+    AstExprCall(const SourceLocation &loc, Symbol Callee,
+                std::vector<AstExprPtr> Args);
+    Symbol getCallee() const;
+    const std::vector<AstExprPtr>& getArgs() const;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 class AstExprLetIn : public AstExpr {
-    std::string Variable;
-    std::unique_ptr<AstExpr> Expr;
-    std::unique_ptr<AstExpr> Body;
+    Symbol Variable;
+    AstExprPtr Expr;
+    AstExprPtr Body;
 public:
     AstExprLetIn(const SourceLocation &loc,
-                const std::string &Variable,
-                std::unique_ptr<AstExpr> Expr,
-                std::unique_ptr<AstExpr> Body);
-    const std::string& getVariable() const;
+                Symbol Variable,
+                AstExprPtr Expr,
+                AstExprPtr Body);
+    Symbol getVariable() const;
     const AstExpr* getExpr() const;
     const AstExpr* getBody() const;
-    std::unique_ptr<AstExpr> clone() const override;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 
 
 template <BinaryOpKindIntToInt OpKind>
 class AstExprBinaryIntToInt : public AstExpr {
-    std::unique_ptr<AstExpr> LHS, RHS;
+    AstExprPtr LHS, RHS;
 public:
     AstExprBinaryIntToInt(const SourceLocation &loc,
-                        std::unique_ptr<AstExpr> LHS,
-                        std::unique_ptr<AstExpr> RHS);
+                        AstExprPtr LHS,
+                        AstExprPtr RHS);
     const AstExpr* getLHS() const;
     const AstExpr* getRHS() const;
-    std::unique_ptr<AstExpr> clone() const override;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 extern template class AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>;
@@ -316,17 +423,19 @@ extern template class AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>;
 
 template <BinaryOpKindIntToBool OpKind>
 class AstExprBinaryIntToBool : public AstExpr {
-    std::unique_ptr<AstExpr> LHS, RHS;
+    AstExprPtr LHS, RHS;
 public:
     AstExprBinaryIntToBool(const SourceLocation &loc,
-                            std::unique_ptr<AstExpr> LHS,
-                            std::unique_ptr<AstExpr> RHS);
+                            AstExprPtr LHS,
+                            AstExprPtr RHS);
     const AstExpr* getLHS() const;
     const AstExpr* getRHS() const;
-    std::unique_ptr<AstExpr> clone() const override;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 extern template class AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>;
@@ -340,17 +449,19 @@ extern template class AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>;
 
 template <BinaryOpKindBoolToBool OpKind>
 class AstExprBinaryBoolToBool : public AstExpr {
-    std::unique_ptr<AstExpr> LHS, RHS;
+    AstExprPtr LHS, RHS;
 public:
     AstExprBinaryBoolToBool(const SourceLocation &loc,
-                            std::unique_ptr<AstExpr> LHS,
-                            std::unique_ptr<AstExpr> RHS);
+                            AstExprPtr LHS,
+                            AstExprPtr RHS);
     const AstExpr* getLHS() const;
     const AstExpr* getRHS() const;
-    std::unique_ptr<AstExpr> clone() const override;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 extern template class AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>;
@@ -358,27 +469,28 @@ extern template class AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>;
 
 class AstExprMatchPath {
     SourceLocation Location;
+    AstExprPtr Guard;
+    AstExprPtr Body;
 public:
-    std::unique_ptr<AstExpr> Guard;
-    std::unique_ptr<AstExpr> Body;
     AstExprMatchPath(const SourceLocation &loc,
-                        std::unique_ptr<AstExpr> guard,
-                        std::unique_ptr<AstExpr> body);
+                        AstExprPtr guard,
+                        AstExprPtr body);
     const SourceLocation& getLocation() const;
     const AstExpr* getGuard() const;
     const AstExpr* getBody() const;
-    std::unique_ptr<AstExprMatchPath> clone() const;
 };
 
 class AstExprMatch : public AstExpr {
-    std::vector<std::unique_ptr<AstExprMatchPath>> Paths;
+    std::vector<AstExprMatchPathPtr> Paths;
 public:
-    AstExprMatch(const SourceLocation &loc, std::vector<std::unique_ptr<AstExprMatchPath>> Paths);
-    const std::vector<std::unique_ptr<AstExprMatchPath>>& getPaths() const;
-    std::unique_ptr<AstExpr> clone() const override;
+    AstExprMatch(const SourceLocation &loc, std::vector<AstExprMatchPathPtr> Paths);
+    const std::vector<AstExprMatchPathPtr>& getPaths() const;
 
     std::unique_ptr<InterpreterValue> accept(const AstValueVisitor& visitor) const override;
     llvm::Value *accept(const AstLLVMValueVisitor& visitor, CodegenContext& ctx) const override;
+    void accept(AstVisitor& visitor) const override;
+protected:
+    AstExprPtr copy() const override;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <iterator>
+#include <type_traits>
+#include <unordered_set>
+
+#include "ast_analysis.hpp"
+#include "ast_dispatch.hpp"
+
+namespace {
+
+bool lessById(Symbol lhs, Symbol rhs) {
+    return lhs.getId() < rhs.getId();
+}
+
+void unite(std::vector<Symbol>& into, const std::vector<Symbol>& other) {
+    std::vector<Symbol> result;
+    std::set_union(into.begin(), into.end(), other.begin(), other.end(), std::back_inserter(result), lessById);
+    into = std::move(result);
+}
+
+// The owner of a node, if it is shared, to keep it alive in a cache.
+AstExprPtr pin(const AstExpr& expr) {
+    return expr.weak_from_this().lock();
+}
+
+void collectCalls(const AstExpr& expr, std::unordered_set<const AstExpr*>& visited, std::vector<Symbol>& calls) {
+    if (!visited.insert(&expr).second) return;
+    if (expr.getKind() == AstExprKind::Call) {
+        calls.push_back(static_cast<const AstExprCall&>(expr).getCallee());
+    }
+    forEachChild(expr, [&](const AstExpr& child) { collectCalls(child, visited, calls); });
+}
+
+// Tarjan's algorithm, which finds every component after the components it
+// calls into.
+class SCCFinder {
+    const std::unordered_map<Symbol, std::vector<Symbol>>& Callees;
+    std::unordered_map<Symbol, size_t> Index;
+    std::unordered_map<Symbol, size_t> LowLink;
+    std::vector<Symbol> Stack;
+    std::unordered_set<Symbol> OnStack;
+public:
+    std::vector<std::vector<Symbol>> SCCs;
+
+    explicit SCCFinder(const std::unordered_map<Symbol, std::vector<Symbol>>& callees) : Callees(callees) {}
+
+    void visit(Symbol function) {
+        if (Index.count(function)) return;
+        size_t index = Index.size();
+        Index[function] = LowLink[function] = index;
+        Stack.push_back(function);
+        OnStack.insert(function);
+
+        for (Symbol callee : Callees.at(function)) {
+            if (!Index.count(callee)) {
+                visit(callee);
+                LowLink[function] = std::min(LowLink[function], LowLink[callee]);
+            } else if (OnStack.count(callee)) {
+                LowLink[function] = std::min(LowLink[function], Index[callee]);
+            }
+        }
+
+        if (LowLink[function] == index) {
+            std::vector<Symbol> scc;
+            Symbol member;
+            do {
+                member = Stack.back();
+                Stack.pop_back();
+                OnStack.erase(member);
+                scc.push_back(member);
+            } while (member != function);
+            SCCs.push_back(std::move(scc));
+        }
+    }
+};
+
+}
+
+bool isSameExpr(const AstExpr& lhs, const AstExpr& rhs) {
+    if (&lhs == &rhs) return true;
+    if (lhs.getKind() != rhs.getKind()) return false;
+
+    bool same = dispatchExpr(lhs, [&rhs](const auto& node) {
+        using Node = std::decay_t<decltype(node)>;
+        const auto& other = static_cast<const Node&>(rhs);
+        if constexpr (std::is_same_v<Node, AstExprConstLong> || std::is_same_v<Node, AstExprConstBool>) {
+            return node.getValue() == other.getValue();
+        } else if constexpr (std::is_same_v<Node, AstExprVariable>) {
+            return node.getName() == other.getName();
+        } else if constexpr (std::is_same_v<Node, AstExprConstArray>) {
+            return node.getElements().size() == other.getElements().size();
+        } else if constexpr (std::is_same_v<Node, AstExprCall>) {
+            return node.getCallee() == other.getCallee() && node.getArgs().size() == other.getArgs().size();
+        } else if constexpr (std::is_same_v<Node, AstExprLetIn>) {
+            return node.getVariable() == other.getVariable();
+        } else if constexpr (std::is_same_v<Node, AstExprMatch>) {
+            return node.getPaths().size() == other.getPaths().size();
+        } else {
+            return true;
+        }
+    });
+    if (!same) return false;
+
+    std::vector<const AstExpr*> children;
+    forEachChild(rhs, [&children](const AstExpr& child) { children.push_back(&child); });
+    size_t i = 0;
+    forEachChild(lhs, [&](const AstExpr& child) { same = same && isSameExpr(child, *children[i++]); });
+    return same;
+}
+
+AnalysisManager::AnalysisManager(const std::vector<std::unique_ptr<AstFunction>>& functions) : Functions(functions) {}
+
+const std::vector<Symbol>& AnalysisManager::getFreeVariables(const AstExpr& expr) {
+    auto cached = FreeVariables.find(&expr);
+    if (cached != FreeVariables.end()) {
+        return cached->second.Value;
+    }
+    return FreeVariables.emplace(&expr, NodeEntry<std::vector<Symbol>> {pin(expr), computeFreeVariables(expr)}).first->second.Value;
+}
+
+std::vector<Symbol> AnalysisManager::computeFreeVariables(const AstExpr& expr) const {
+    auto cached = FreeVariables.find(&expr);
+    if (cached != FreeVariables.end()) {
+        return cached->second.Value;
+    }
+
+    std::vector<Symbol> vars;
+    if (expr.getKind() == AstExprKind::Variable) {
+        vars.push_back(static_cast<const AstExprVariable&>(expr).getName());
+    } else if (expr.getKind() == AstExprKind::LetIn) {
+        const auto& let = static_cast<const AstExprLetIn&>(expr);
+        vars = computeFreeVariables(*let.getBody());
+        auto bound = std::lower_bound(vars.begin(), vars.end(), let.getVariable(), lessById);
+        if (bound != vars.end() && *bound == let.getVariable()) {
+            vars.erase(bound);
+        }
+        unite(vars, computeFreeVariables(*let.getExpr()));
+    } else {
+        forEachChild(expr, [&](const AstExpr& child) { unite(vars, computeFreeVariables(child)); });
+    }
+    return vars;
+}
+
+size_t AnalysisManager::getCost(const AstExpr& expr) {
+    auto cached = Costs.find(&expr);
+    if (cached != Costs.end()) {
+        return cached->second.Value;
+    }
+    size_t cost = computeCost(expr);
+    Costs.emplace(&expr, NodeEntry<size_t> {pin(expr), cost});
+    return cost;
+}
+
+size_t AnalysisManager::computeCost(const AstExpr& expr) const {
+    auto cached = Costs.find(&expr);
+    if (cached != Costs.end()) {
+        return cached->second.Value;
+    }
+    size_t cost = expr.getKind() == AstExprKind::Call ? 1 + CallCost : 1;
+    forEachChild(expr, [&](const AstExpr& child) { cost += computeCost(child); });
+    return cost;
+}
+
+void AnalysisManager::buildCallGraph() {
+    if (HasCallGraph) return;
+    HasCallGraph = true;
+
+    for (const auto& func : Functions) {
+        FunctionsByName[func->getPrototype()->getName()] = func.get();
+    }
+    for (const auto& func : Functions) {
+        std::unordered_set<const AstExpr*> visited;
+        std::vector<Symbol> calls;
+        collectCalls(*func->getBody(), visited, calls);
+
+        std::vector<Symbol>& callees = Callees[func->getPrototype()->getName()];
+        std::unordered_set<Symbol> seen;
+        for (Symbol call : calls) {
+            // Calls into other modules are not part of this call graph.
+            if (FunctionsByName.count(call) && seen.insert(call).second) {
+                callees.push_back(call);
+            }
+        }
+    }
+
+    SCCFinder finder(Callees);
+    for (const auto& func : Functions) {
+        finder.visit(func->getPrototype()->getName());
+    }
+    SCCs = std::move(finder.SCCs);
+    for (size_t i = 0; i < SCCs.size(); ++i) {
+        for (Symbol member : SCCs[i]) {
+            SCCIndices[member] = i;
+        }
+    }
+}
+
+const AstFunction* AnalysisManager::getFunction(Symbol name) {
+    buildCallGraph();
+    auto it = FunctionsByName.find(name);
+    return it != FunctionsByName.end() ? it->second : nullptr;
+}
+
+const std::vector<Symbol>& AnalysisManager::getCallees(Symbol name) {
+    static const std::vector<Symbol> none;
+    buildCallGraph();
+    auto it = Callees.find(name);
+    return it != Callees.end() ? it->second : none;
+}
+
+const std::vector<std::vector<Symbol>>& AnalysisManager::getSCCs() {
+    buildCallGraph();
+    return SCCs;
+}
+
+RecursionKind AnalysisManager::getRecursionKind(Symbol name) {
+    buildCallGraph();
+    auto index = SCCIndices.find(name);
+    if (index == SCCIndices.end()) {
+        return RecursionKind::None;
+    }
+    if (SCCs[index->second].size() > 1) {
+        return RecursionKind::Mutual;
+    }
+    const auto& callees = Callees[name];
+    return std::find(callees.begin(), callees.end(), name) != callees.end() ? RecursionKind::Self : RecursionKind::None;
+}
+
+void AnalysisManager::computePurity() {
+    if (!PureFunctions.empty() || getSCCs().empty()) return;
+    for (const auto& [name, func] : FunctionsByName) {
+        Arities[name] = func->getPrototype()->getArgs().size();
+    }
+    // Callees come first, so their purity is known when a caller needs it.
+    for (const auto& scc : SCCs) {
+        if (getRecursionKind(scc.front()) != RecursionKind::None) {
+            // Recursion may not terminate.
+            for (Symbol member : scc) {
+                PureFunctions[member] = false;
+            }
+            continue;
+        }
+        PureFunctions[scc.front()] = computeIsPure(*FunctionsByName.at(scc.front())->getBody());
+    }
+}
+
+bool AnalysisManager::isPure(Symbol function) {
+    computePurity();
+    auto it = PureFunctions.find(function);
+    return it != PureFunctions.end() && it->second;
+}
+
+bool AnalysisManager::isPure(const AstExpr& expr) {
+    computePurity();
+    auto cached = PureExprs.find(&expr);
+    if (cached != PureExprs.end()) {
+        return cached->second.Value;
+    }
+    bool pure = computeIsPure(expr);
+    PureExprs.emplace(&expr, NodeEntry<bool> {pin(expr), pure});
+    return pure;
+}
+
+bool AnalysisManager::isPureOperation(const AstExpr& expr) {
+    // Only calls need the purity of functions.
+    if (expr.getKind() == AstExprKind::Call) {
+        computePurity();
+    }
+    return isPureNode(expr);
+}
+
+bool AnalysisManager::computeIsPure(const AstExpr& expr) const {
+    auto cached = PureExprs.find(&expr);
+    if (cached != PureExprs.end()) {
+        return cached->second.Value;
+    }
+    bool pure = isPureNode(expr);
+    if (pure) {
+        forEachChild(expr, [&](const AstExpr& child) { pure = pure && computeIsPure(child); });
+    }
+    return pure;
+}
+
+bool AnalysisManager::isPureNode(const AstExpr& expr) const {
+    bool pure = true;
+    switch (expr.getKind()) {
+        case AstExprKind::Index:
+            // May be out of bounds.
+            pure = false;
+            break;
+        case AstExprKind::Div: {
+            // Only a constant divisor is known not to trap; -1 overflows on
+            // the smallest long.
+            const auto& div = static_cast<const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>&>(expr);
+            auto divisor = div.getRHS()->getKind() == AstExprKind::ConstLong
+                ? static_cast<const AstExprConstLong*>(div.getRHS()) : nullptr;
+            pure = divisor && divisor->getValue() != 0 && divisor->getValue() != -1;
+            break;
+        }
+        case AstExprKind::Match: {
+            // Fails unless the last arm is always taken.
+            const auto& paths = static_cast<const AstExprMatch&>(expr).getPaths();
+            const AstExpr* last = paths.empty() ? nullptr : paths.back()->getGuard();
+            pure = last && last->getKind() == AstExprKind::ConstBool && static_cast<const AstExprConstBool*>(last)->getValue();
+            break;
+        }
+        case AstExprKind::Call: {
+            const auto& call = static_cast<const AstExprCall&>(expr);
+            auto callee = PureFunctions.find(call.getCallee());
+            pure = callee != PureFunctions.end() && callee->second && Arities.at(call.getCallee()) == call.getArgs().size();
+            break;
+        }
+        default:
+            break;
+    }
+    return pure;
+}
+
+void AnalysisManager::invalidate() {
+    HasCallGraph = false;
+    FunctionsByName.clear();
+    Callees.clear();
+    SCCs.clear();
+    SCCIndices.clear();
+    PureFunctions.clear();
+    Arities.clear();
+    PureExprs.clear();
+}
@@ -0,0 +1,94 @@
+#ifndef AST_ANALYSIS_HPP
+#define AST_ANALYSIS_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+enum class RecursionKind {
+    // Not part of any call cycle.
+    None,
+    // Calls itself, but is in no cycle with other functions.
+    Self,
+    // In a call cycle with other functions.
+    Mutual,
+};
+
+// Whether two expressions are the same apart from their source locations.
+bool isSameExpr(const AstExpr& lhs, const AstExpr& rhs);
+
+// Facts about the functions of a module, computed on first use and cached.
+// Facts about a single expression only depend on that node and its
+// children, which never change, so they stay cached for as long as the
+// manager lives. Facts about functions depend on the whole module and are
+// dropped by invalidate(), which the pass manager calls whenever a pass
+// changed the module.
+class AnalysisManager {
+    const std::vector<std::unique_ptr<AstFunction>>& Functions;
+
+    // Cached for the nodes asked about, whose subtrees reuse the entries
+    // they find. Each entry keeps its node alive, so that the address cannot
+    // be reused by a different node.
+    template <typename T>
+    struct NodeEntry {
+        AstExprPtr Node;
+        T Value;
+    };
+    std::unordered_map<const AstExpr*, NodeEntry<std::vector<Symbol>>> FreeVariables;
+    std::unordered_map<const AstExpr*, NodeEntry<size_t>> Costs;
+
+    // Cached for the module until invalidate().
+    bool HasCallGraph = false;
+    std::unordered_map<Symbol, const AstFunction*> FunctionsByName;
+    std::unordered_map<Symbol, std::vector<Symbol>> Callees;
+    std::vector<std::vector<Symbol>> SCCs;
+    std::unordered_map<Symbol, size_t> SCCIndices;
+    std::unordered_map<Symbol, bool> PureFunctions;
+    // Parameter counts, so that calls are checked without touching functions
+    // a pass may already have replaced.
+    std::unordered_map<Symbol, size_t> Arities;
+    std::unordered_map<const AstExpr*, NodeEntry<bool>> PureExprs;
+
+    std::vector<Symbol> computeFreeVariables(const AstExpr& expr) const;
+    size_t computeCost(const AstExpr& expr) const;
+    void buildCallGraph();
+    void computePurity();
+    bool computeIsPure(const AstExpr& expr) const;
+    bool isPureNode(const AstExpr& expr) const;
+public:
+    // Extra cost of a call over other nodes, for the frame it sets up.
+    static constexpr size_t CallCost = 4;
+
+    explicit AnalysisManager(const std::vector<std::unique_ptr<AstFunction>>& functions);
+
+    // Variables expr refers to that are not bound inside it, ordered by id.
+    const std::vector<Symbol>& getFreeVariables(const AstExpr& expr);
+    // Estimated cost of evaluating expr once: its number of nodes, with
+    // every call adding CallCost. Used as a code size measure as well.
+    size_t getCost(const AstExpr& expr);
+
+    const AstFunction* getFunction(Symbol name);
+    // Functions of the module called in the body of name, in first call order.
+    const std::vector<Symbol>& getCallees(Symbol name);
+    // Strongly connected components of the call graph, callees before
+    // their callers.
+    const std::vector<std::vector<Symbol>>& getSCCs();
+    RecursionKind getRecursionKind(Symbol name);
+    // Whether evaluating the expression always terminates without an error,
+    // so it can be dropped, duplicated or evaluated earlier. Calls are pure
+    // when the callee is a non-recursive function of the module with a pure
+    // body. Type errors are not considered, so an ill-typed program may
+    // report a different one first after a transformation.
+    bool isPure(const AstExpr& expr);
+    bool isPure(Symbol function);
+    // Whether the node itself is pure, given that its children are. Lets
+    // passes that walk every node anyway find pure subtrees bottom-up.
+    bool isPureOperation(const AstExpr& expr);
+
+    // Drops every fact that depends on the set of functions.
+    void invalidate();
+};
+
+#endif
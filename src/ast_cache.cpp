@@ -0,0 +1,251 @@
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+
+#include "ast_cache.hpp"
+#include "compile_cache.hpp"
+#include "source_buffer.hpp"
+
+namespace {
+
+// Bump whenever the layout below or the FlatAst arrays change.
+constexpr uint32_t FormatVersion = 2;
+constexpr char Magic[8] = {'L', 'A', 'N', 'G', 'A', 'S', 'T', '\n'};
+
+// Entries are only read back on the machine that wrote them, so values are
+// stored in host byte order; the header records enough to reject others.
+struct Header {
+    char Magic[8];
+    uint32_t Version;
+    uint32_t ByteOrder;
+    uint32_t SizeOfSizeT;
+    uint32_t SizeOfLong;
+    uint64_t Key;
+};
+constexpr uint32_t ByteOrderMark = 0x01020304;
+
+class Writer {
+    std::string& Out;
+    size_t BaseOffset;
+public:
+    Writer(std::string& out, size_t baseOffset) : Out(out), BaseOffset(baseOffset) {}
+
+    template <typename T>
+    void pod(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        Out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+    template <typename T>
+    void array(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        pod(static_cast<uint64_t>(values.size()));
+        Out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+    void string(std::string_view text) {
+        pod(static_cast<uint64_t>(text.size()));
+        Out.append(text);
+    }
+    void location(const SourceLocation& loc) {
+        pod(loc.StartPos - BaseOffset);
+        pod(loc.EndPos - BaseOffset);
+    }
+};
+
+// Reads what Writer wrote. Any read past the end marks the entry damaged
+// and yields zeroes from then on.
+class Reader {
+    const char* Pos;
+    const char* End;
+    size_t BaseOffset;
+public:
+    bool Failed = false;
+
+    Reader(std::string_view data, size_t baseOffset) : Pos(data.data()), End(data.data() + data.size()), BaseOffset(baseOffset) {}
+
+    bool take(void* out, size_t size) {
+        if (Failed || static_cast<size_t>(End - Pos) < size) {
+            Failed = true;
+            std::memset(out, 0, size);
+            return false;
+        }
+        std::memcpy(out, Pos, size);
+        Pos += size;
+        return true;
+    }
+    template <typename T>
+    T pod() {
+        T value;
+        take(&value, sizeof(T));
+        return value;
+    }
+    uint64_t count(size_t elementSize) {
+        uint64_t size = pod<uint64_t>();
+        if (size > static_cast<size_t>(End - Pos) / elementSize) {
+            Failed = true;
+            return 0;
+        }
+        return size;
+    }
+    template <typename T>
+    void array(std::vector<T>& values) {
+        values.resize(count(sizeof(T)));
+        take(values.data(), values.size() * sizeof(T));
+    }
+    std::string string() {
+        std::string text(count(1), '\0');
+        take(text.data(), text.size());
+        return text;
+    }
+    SourceLocation location() {
+        size_t start = pod<size_t>();
+        size_t end = pod<size_t>();
+        return SourceLocation(start + BaseOffset, end + BaseOffset);
+    }
+    bool atEnd() const { return Pos == End; }
+};
+
+void writeArgs(Writer& writer, const std::vector<AstArg>& args) {
+    writer.pod(static_cast<uint64_t>(args.size()));
+    for (const AstArg& arg : args) {
+        writer.location(arg.Location);
+        writer.string(arg.Name.str());
+    }
+}
+
+std::vector<AstArg> readArgs(Reader& reader) {
+    std::vector<AstArg> args;
+    uint64_t count = reader.count(sizeof(SourceLocation));
+    for (uint64_t i = 0; i < count; ++i) {
+        SourceLocation loc = reader.location();
+        args.emplace_back(loc, Symbol(reader.string()));
+    }
+    return args;
+}
+}
+
+AstCache::AstCache(std::filesystem::path directory) : Directory(std::move(directory)) {}
+
+std::filesystem::path AstCache::entryPath(uint64_t key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".ast";
+    return Directory / name.str();
+}
+
+uint64_t AstCache::getKey(std::string_view source, bool hasMainExpr) {
+    return hashString(source, FormatVersion * 2 + (hasMainExpr ? 1 : 0));
+}
+
+std::optional<CachedModule> AstCache::lookup(uint64_t key, size_t baseOffset) const {
+    SourceBuffer entry;
+    try {
+        entry = SourceBuffer::fromFile(entryPath(key).string());
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+
+    Reader reader(entry.text(), baseOffset);
+    Header header = reader.pod<Header>();
+    if (reader.Failed || std::memcmp(header.Magic, Magic, sizeof(Magic)) != 0 || header.Version != FormatVersion
+        || header.ByteOrder != ByteOrderMark || header.SizeOfSizeT != sizeof(size_t) || header.SizeOfLong != sizeof(long)
+        || header.Key != key) {
+        return std::nullopt;
+    }
+
+    CachedModule module {{}, FlatAst(baseOffset), {}, {}, std::nullopt};
+    uint64_t importCount = reader.count(sizeof(SourceLocation));
+    for (uint64_t i = 0; i < importCount; ++i) {
+        SourceLocation loc = reader.location();
+        module.Imports.emplace_back(loc, reader.string());
+    }
+
+    FlatAst& ast = module.Ast;
+    uint64_t nameCount = reader.count(sizeof(uint64_t));
+    for (uint64_t i = 0; i < nameCount; ++i) {
+        ast.addName(Symbol(reader.string()));
+    }
+    reader.array(ast.Kinds);
+    reader.array(ast.First);
+    reader.array(ast.Second);
+    reader.array(ast.Locations);
+    reader.array(ast.Lists);
+    reader.array(ast.Longs);
+
+    uint64_t functionCount = reader.count(2 * sizeof(SourceLocation));
+    for (uint64_t i = 0; i < functionCount; ++i) {
+        SourceLocation loc = reader.location();
+        SourceLocation protoLoc = reader.location();
+        Symbol name(reader.string());
+        std::vector<AstArg> args = readArgs(reader);
+        FlatNodeId body = reader.pod<FlatNodeId>();
+        bool internal = reader.pod<uint8_t>() != 0;
+        module.Functions.push_back(FlatFunction {loc, protoLoc, name, std::move(args), body, internal});
+    }
+    module.MainInputs = readArgs(reader);
+    if (reader.pod<uint8_t>()) {
+        module.MainExpr = reader.pod<FlatNodeId>();
+    }
+
+    if (reader.Failed || !reader.atEnd() || !ast.isWellFormed()) {
+        return std::nullopt;
+    }
+    for (const FlatFunction& func : module.Functions) {
+        if (!ast.isExpression(func.Body)) return std::nullopt;
+    }
+    if (module.MainExpr && !ast.isExpression(*module.MainExpr)) {
+        return std::nullopt;
+    }
+    return module;
+}
+
+void AstCache::store(uint64_t key, const CachedModule& module) const {
+    const FlatAst& ast = module.Ast;
+    std::string data;
+    Writer writer(data, ast.BaseOffset);
+
+    Header header;
+    std::memcpy(header.Magic, Magic, sizeof(Magic));
+    header.Version = FormatVersion;
+    header.ByteOrder = ByteOrderMark;
+    header.SizeOfSizeT = sizeof(size_t);
+    header.SizeOfLong = sizeof(long);
+    header.Key = key;
+    writer.pod(header);
+
+    writer.pod(static_cast<uint64_t>(module.Imports.size()));
+    for (const AstImport& import : module.Imports) {
+        writer.location(import.Location);
+        writer.string(import.Name);
+    }
+
+    writer.pod(static_cast<uint64_t>(ast.Names.size()));
+    for (Symbol name : ast.Names) {
+        writer.string(name.str());
+    }
+    writer.array(ast.Kinds);
+    writer.array(ast.First);
+    writer.array(ast.Second);
+    writer.array(ast.Locations);
+    writer.array(ast.Lists);
+    writer.array(ast.Longs);
+
+    writer.pod(static_cast<uint64_t>(module.Functions.size()));
+    for (const FlatFunction& func : module.Functions) {
+        writer.location(func.Location);
+        writer.location(func.PrototypeLocation);
+        writer.string(func.Name.str());
+        writeArgs(writer, func.Args);
+        writer.pod(func.Body);
+        writer.pod(static_cast<uint8_t>(func.Internal));
+    }
+    writeArgs(writer, module.MainInputs);
+    writer.pod(static_cast<uint8_t>(module.MainExpr.has_value()));
+    if (module.MainExpr) {
+        writer.pod(*module.MainExpr);
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(Directory, ec);
+    if (ec) return;
+    writeFileAtomically(entryPath(key), data);
+}
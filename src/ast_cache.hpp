@@ -0,0 +1,41 @@
+#ifndef AST_CACHE_HPP
+#define AST_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "flat_ast.hpp"
+
+// A parsed module as stored in the cache, after the tail recursion rewrite.
+struct CachedModule {
+    std::vector<AstImport> Imports;
+    FlatAst Ast;
+    std::vector<FlatFunction> Functions;
+    std::vector<AstArg> MainInputs;
+    std::optional<FlatNodeId> MainExpr;
+};
+
+// On-disk store of parsed modules keyed by a hash of their source text, so
+// unchanged files skip lexing and parsing. An entry is the module's FlatAst
+// arrays written back to back after a small header; a lookup maps the file
+// and copies each array in one piece, only re-interning the names. Like
+// CompileCache it is best effort: missing, stale or damaged entries miss and
+// failed stores are ignored.
+class AstCache {
+    std::filesystem::path Directory;
+
+    std::filesystem::path entryPath(uint64_t key) const;
+public:
+    explicit AstCache(std::filesystem::path directory);
+    // Covers the text, whether a main expression follows the functions, and
+    // the entry format.
+    static uint64_t getKey(std::string_view source, bool hasMainExpr);
+    // Locations in the result are moved to start at baseOffset.
+    std::optional<CachedModule> lookup(uint64_t key, size_t baseOffset) const;
+    void store(uint64_t key, const CachedModule& module) const;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef AST_DISPATCH_HPP
+#define AST_DISPATCH_HPP
+
+#include <cstdlib>
+#include <type_traits>
+
+#include "ast.hpp"
+
+// Calls visitor(node) with expr cast to its concrete class, switching on
+// its kind. Unlike accept(), this is one predictable branch instead of two
+// virtual calls, and the handlers can be inlined into the caller. Every
+// overload of visitor must return the same type.
+template <typename Visitor>
+decltype(auto) dispatchExpr(const AstExpr& expr, Visitor&& visitor) {
+    switch (expr.getKind()) {
+        case AstExprKind::ConstLong: return visitor(static_cast<const AstExprConstLong&>(expr));
+        case AstExprKind::ConstBool: return visitor(static_cast<const AstExprConstBool&>(expr));
+        case AstExprKind::ConstArray: return visitor(static_cast<const AstExprConstArray&>(expr));
+        case AstExprKind::Variable: return visitor(static_cast<const AstExprVariable&>(expr));
+        case AstExprKind::Index: return visitor(static_cast<const AstExprIndex&>(expr));
+        case AstExprKind::Call: return visitor(static_cast<const AstExprCall&>(expr));
+        case AstExprKind::LetIn: return visitor(static_cast<const AstExprLetIn&>(expr));
+        case AstExprKind::Match: return visitor(static_cast<const AstExprMatch&>(expr));
+
+        case AstExprKind::Add: return visitor(static_cast<const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>&>(expr));
+        case AstExprKind::Sub: return visitor(static_cast<const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>&>(expr));
+        case AstExprKind::Mul: return visitor(static_cast<const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>&>(expr));
+        case AstExprKind::Div: return visitor(static_cast<const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>&>(expr));
+
+        case AstExprKind::Eq: return visitor(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>&>(expr));
+        case AstExprKind::Neq: return visitor(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>&>(expr));
+        case AstExprKind::Leq: return visitor(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>&>(expr));
+        case AstExprKind::Lt: return visitor(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>&>(expr));
+        case AstExprKind::Geq: return visitor(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>&>(expr));
+        case AstExprKind::Gt: return visitor(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>&>(expr));
+
+        case AstExprKind::And: return visitor(static_cast<const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>&>(expr));
+        case AstExprKind::Or: return visitor(static_cast<const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>&>(expr));
+    }
+    // Every kind is handled above.
+    std::abort();
+}
+
+// Calls f(child) for each direct subexpression of expr, in evaluation order.
+// Match guards and bodies alternate, arm by arm.
+template <typename F>
+void forEachChild(const AstExpr& expr, F&& f) {
+    dispatchExpr(expr, [&f](const auto& node) {
+        using Node = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<Node, AstExprConstArray>) {
+            for (const auto& element : node.getElements()) f(*element);
+        } else if constexpr (std::is_same_v<Node, AstExprIndex>) {
+            f(*node.getIndexer());
+            f(*node.getIndexee());
+        } else if constexpr (std::is_same_v<Node, AstExprCall>) {
+            for (const auto& arg : node.getArgs()) f(*arg);
+        } else if constexpr (std::is_same_v<Node, AstExprLetIn>) {
+            f(*node.getExpr());
+            f(*node.getBody());
+        } else if constexpr (std::is_same_v<Node, AstExprMatch>) {
+            for (const auto& path : node.getPaths()) {
+                f(*path->getGuard());
+                f(*path->getBody());
+            }
+        } else if constexpr (!std::is_same_v<Node, AstExprConstLong> && !std::is_same_v<Node, AstExprConstBool> &&
+                             !std::is_same_v<Node, AstExprVariable>) {
+            f(*node.getLHS());
+            f(*node.getRHS());
+        }
+    });
+}
+
+#endif
@@ -0,0 +1,137 @@
+#include <type_traits>
+
+#include "ast_interner.hpp"
+#include "ast_dispatch.hpp"
+
+bool AstInterner::NodeKey::operator==(const NodeKey& other) const {
+    return Kind == other.Kind && StartPos == other.StartPos && EndPos == other.EndPos &&
+        Payload == other.Payload && Children == other.Children;
+}
+
+size_t AstInterner::NodeKeyHash::operator()(const NodeKey& key) const {
+    size_t hash = static_cast<size_t>(key.Kind);
+    auto mix = [&hash](size_t value) {
+        hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    };
+    mix(key.StartPos);
+    mix(key.EndPos);
+    mix(static_cast<size_t>(key.Payload));
+    for (const void* child : key.Children) {
+        mix(std::hash<const void*>()(child));
+    }
+    return hash;
+}
+
+AstExprPtr AstInterner::intern(const AstExprPtr& expr) {
+    auto visited = Visited.find(expr.get());
+    if (visited != Visited.end()) {
+        return visited->second.second;
+    }
+    AstExprPtr result = internNode(expr);
+    Visited.emplace(expr.get(), std::make_pair(expr, result));
+    Visited.emplace(result.get(), std::make_pair(result, result));
+    return result;
+}
+
+std::unique_ptr<AstFunction> AstInterner::intern(const AstFunction& func) {
+    if (!func.isBodyParsed()) {
+        return func.clone();
+    }
+    return func.withBody(intern(func.getBody()->clone()));
+}
+
+AstInterner::NodeKey AstInterner::makeKey(AstExprKind kind, const SourceLocation& loc) const {
+    return KeepLocations ? NodeKey {kind, loc.StartPos, loc.EndPos, 0, {}} : NodeKey {kind, 0, 0, 0, {}};
+}
+
+AstExprPtr AstInterner::unique(NodeKey key, AstExprPtr expr) {
+    return Nodes.emplace(std::move(key), std::move(expr)).first->second;
+}
+
+AstExprPtr AstInterner::internNode(const AstExprPtr& expr) {
+    const SourceLocation& loc = expr->getLocation();
+    NodeKey key = makeKey(expr->getKind(), loc);
+    auto internAll = [this, &key](const std::vector<AstExprPtr>& exprs) {
+        std::vector<AstExprPtr> result;
+        for (const auto& child : exprs) {
+            result.push_back(intern(child));
+            key.Children.push_back(result.back().get());
+        }
+        return result;
+    };
+
+    // Nodes are only rebuilt when one of their children was replaced.
+    return dispatchExpr(*expr, [&](const auto& node) -> AstExprPtr {
+        using Node = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<Node, AstExprConstLong> || std::is_same_v<Node, AstExprConstBool>) {
+            key.Payload = node.getValue();
+            return unique(std::move(key), expr);
+        } else if constexpr (std::is_same_v<Node, AstExprVariable>) {
+            key.Payload = node.getName().getId();
+            return unique(std::move(key), expr);
+        } else if constexpr (std::is_same_v<Node, AstExprConstArray>) {
+            // Element types are not compared, so array literals keep their node.
+            auto elements = internAll(node.getElements());
+            if (elements == node.getElements()) return expr;
+            return std::make_shared<AstExprConstArray>(loc, node.getElementType()->clone(), std::move(elements));
+        } else if constexpr (std::is_same_v<Node, AstExprIndex>) {
+            AstExprPtr indexee = intern(node.getIndexee());
+            AstExprPtr indexer = intern(node.getIndexer());
+            key.Children = {indexee.get(), indexer.get()};
+            bool same = indexee == node.getIndexee() && indexer == node.getIndexer();
+            return unique(std::move(key), same ? expr : std::make_shared<AstExprIndex>(loc, indexee, indexer));
+        } else if constexpr (std::is_same_v<Node, AstExprCall>) {
+            key.Payload = node.getCallee().getId();
+            auto args = internAll(node.getArgs());
+            bool same = args == node.getArgs();
+            return unique(std::move(key), same ? expr : std::make_shared<AstExprCall>(loc, node.getCallee(), std::move(args)));
+        } else if constexpr (std::is_same_v<Node, AstExprLetIn>) {
+            key.Payload = node.getVariable().getId();
+            AstExprPtr value = intern(node.getExpr()->clone());
+            AstExprPtr body = intern(node.getBody()->clone());
+            key.Children = {value.get(), body.get()};
+            bool same = value.get() == node.getExpr() && body.get() == node.getBody();
+            return unique(std::move(key), same ? expr : std::make_shared<AstExprLetIn>(loc, node.getVariable(), value, body));
+        } else if constexpr (std::is_same_v<Node, AstExprMatch>) {
+            std::vector<AstExprMatchPathPtr> paths;
+            for (const auto& path : node.getPaths()) {
+                AstExprPtr guard = intern(path->getGuard()->clone());
+                AstExprPtr body = intern(path->getBody()->clone());
+                const SourceLocation& pathLoc = path->getLocation();
+                NodeKey pathKey = makeKey(AstExprKind::Match, pathLoc);
+                pathKey.Children = {guard.get(), body.get()};
+                bool same = guard.get() == path->getGuard() && body.get() == path->getBody();
+                auto candidate = same ? path : std::make_shared<AstExprMatchPath>(pathLoc, guard, body);
+                paths.push_back(Paths.emplace(std::move(pathKey), std::move(candidate)).first->second);
+                key.Children.push_back(paths.back().get());
+            }
+            bool same = paths == node.getPaths();
+            return unique(std::move(key), same ? expr : std::make_shared<AstExprMatch>(loc, std::move(paths)));
+        } else {
+            AstExprPtr lhs = intern(node.getLHS()->clone());
+            AstExprPtr rhs = intern(node.getRHS()->clone());
+            key.Children = {lhs.get(), rhs.get()};
+            bool same = lhs.get() == node.getLHS() && rhs.get() == node.getRHS();
+            return unique(std::move(key), same ? expr : std::make_shared<Node>(loc, lhs, rhs));
+        }
+    });
+}
+
+bool InternPass::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) {
+    (void) analyses;
+    AstInterner interner(KeepLocations);
+    bool changed = false;
+    for (auto& func : functions) {
+        auto interned = interner.intern(*func);
+        if (interned->getBody() != func->getBody()) {
+            func = std::move(interned);
+            changed = true;
+        }
+    }
+    if (mainExpr && *mainExpr) {
+        AstExprPtr interned = interner.intern(*mainExpr);
+        changed = changed || interned != *mainExpr;
+        *mainExpr = std::move(interned);
+    }
+    return changed;
+}
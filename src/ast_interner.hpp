@@ -0,0 +1,61 @@
+#ifndef AST_INTERNER_HPP
+#define AST_INTERNER_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "pass_manager.hpp"
+
+// Hash-conses expression trees: structurally identical subtrees become one
+// shared node, which keeps the location of the first occurrence seen, so a
+// runtime error in a repeated expression may point at an earlier copy of
+// it. Sharing saves the memory of duplicated code and lets analyses cached
+// per node answer for every copy at once. With keepLocations the location
+// is part of a node's identity instead, for debug info that has to point at
+// what was written; then only copies made by rewrites, such as the
+// accumulator the tail recursion rewrite puts into every match arm,
+// collapse. Interned trees stay valid after the interner is gone.
+class AstInterner {
+    struct NodeKey {
+        AstExprKind Kind;
+        size_t StartPos;
+        size_t EndPos;
+        // The literal or name of the node, if it has one.
+        long Payload;
+        std::vector<const void*> Children;
+        bool operator==(const NodeKey& other) const;
+    };
+    struct NodeKeyHash {
+        size_t operator()(const NodeKey& key) const;
+    };
+
+    std::unordered_map<NodeKey, AstExprPtr, NodeKeyHash> Nodes;
+    std::unordered_map<NodeKey, AstExprMatchPathPtr, NodeKeyHash> Paths;
+    // Nodes already interned, so a shared subtree is only visited once. Holds
+    // the original node to keep its address from being reused.
+    std::unordered_map<const AstExpr*, std::pair<AstExprPtr, AstExprPtr>> Visited;
+    bool KeepLocations;
+
+    NodeKey makeKey(AstExprKind kind, const SourceLocation& loc) const;
+    AstExprPtr internNode(const AstExprPtr& expr);
+    AstExprPtr unique(NodeKey key, AstExprPtr expr);
+public:
+    explicit AstInterner(bool keepLocations = false) : KeepLocations(keepLocations) {}
+
+    AstExprPtr intern(const AstExprPtr& expr);
+    std::unique_ptr<AstFunction> intern(const AstFunction& func);
+    // Number of distinct expression nodes seen.
+    size_t size() const { return Nodes.size(); }
+};
+
+// Interns all functions of a module together.
+class InternPass : public AstPass {
+    bool KeepLocations;
+public:
+    explicit InternPass(bool keepLocations = false) : KeepLocations(keepLocations) {}
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) override;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#include "ast_rewriter.hpp"
+
+AstExprPtr AstRewriter::rewrite(const AstExpr& expr) {
+    expr.accept(*this);
+    return std::move(Result);
+}
+
+std::unique_ptr<AstFunction> AstRewriter::rewrite(const AstFunction& func) {
+    return func.withBody(rewrite(*func.getBody()));
+}
+
+void AstRewriter::visit(const AstExprConstLong& expr) {
+    Result = expr.clone();
+}
+
+void AstRewriter::visit(const AstExprConstBool& expr) {
+    Result = expr.clone();
+}
+
+void AstRewriter::visit(const AstExprConstArray& expr) {
+    std::vector<AstExprPtr> elements;
+    for (const auto& element : expr.getElements()) {
+        elements.push_back(rewrite(*element));
+    }
+    if (elements == expr.getElements()) {
+        Result = expr.clone();
+        return;
+    }
+    Result = std::make_unique<AstExprConstArray>(expr.getLocation(), expr.getElementType()->clone(), std::move(elements));
+}
+
+void AstRewriter::visit(const AstExprVariable& expr) {
+    Result = expr.clone();
+}
+
+void AstRewriter::visit(const AstExprIndex& expr) {
+    auto indexee = rewrite(*expr.getIndexee());
+    auto indexer = rewrite(*expr.getIndexer());
+    if (indexee == expr.getIndexee() && indexer == expr.getIndexer()) {
+        Result = expr.clone();
+        return;
+    }
+    Result = std::make_unique<AstExprIndex>(expr.getLocation(), indexee, indexer);
+}
+
+void AstRewriter::visit(const AstExprCall& expr) {
+    std::vector<AstExprPtr> args;
+    for (const auto& arg : expr.getArgs()) {
+        args.push_back(rewrite(*arg));
+    }
+    if (args == expr.getArgs()) {
+        Result = expr.clone();
+        return;
+    }
+    Result = std::make_unique<AstExprCall>(expr.getLocation(), expr.getCallee(), std::move(args));
+}
+
+void AstRewriter::visit(const AstExprLetIn& expr) {
+    auto value = rewrite(*expr.getExpr());
+    auto body = rewrite(*expr.getBody());
+    if (value.get() == expr.getExpr() && body.get() == expr.getBody()) {
+        Result = expr.clone();
+        return;
+    }
+    Result = std::make_unique<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+}
+
+void AstRewriter::visit(const AstExprMatch& expr) {
+    std::vector<AstExprMatchPathPtr> paths;
+    for (const auto& path : expr.getPaths()) {
+        auto guard = rewrite(*path->getGuard());
+        auto body = rewrite(*path->getBody());
+        if (guard.get() == path->getGuard() && body.get() == path->getBody()) {
+            paths.push_back(path);
+        } else {
+            paths.push_back(std::make_unique<AstExprMatchPath>(path->getLocation(), std::move(guard), std::move(body)));
+        }
+    }
+    if (paths == expr.getPaths()) {
+        Result = expr.clone();
+        return;
+    }
+    Result = std::make_unique<AstExprMatch>(expr.getLocation(), std::move(paths));
+}
+
+#define IMPLEMENT_BIN_REWRITE(NODE, OP_KIND_TYPE, OP_KIND) \
+    void AstRewriter::visit(const NODE<OP_KIND_TYPE::OP_KIND>& expr) { \
+        auto lhs = rewrite(*expr.getLHS()); \
+        auto rhs = rewrite(*expr.getRHS()); \
+        if (lhs.get() == expr.getLHS() && rhs.get() == expr.getRHS()) { \
+            Result = expr.clone(); \
+            return; \
+        } \
+        Result = std::make_unique<NODE<OP_KIND_TYPE::OP_KIND>>(expr.getLocation(), std::move(lhs), std::move(rhs)); \
+    }
+
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Add)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Sub)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Mul)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Div)
+
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Eq)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Neq)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Leq)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Lt)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Geq)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Gt)
+
+IMPLEMENT_BIN_REWRITE(AstExprBinaryBoolToBool, BinaryOpKindBoolToBool, And)
+IMPLEMENT_BIN_REWRITE(AstExprBinaryBoolToBool, BinaryOpKindBoolToBool, Or)
+
+#undef IMPLEMENT_BIN_REWRITE
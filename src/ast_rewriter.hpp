@@ -0,0 +1,41 @@
+#ifndef AST_REWRITER_HPP
+#define AST_REWRITER_HPP
+
+#include "ast.hpp"
+
+// Default AstVisitor that rebuilds every node from its rewritten children,
+// or shares the node when none of them changed. Transformations override rewrite() or individual visit methods, setting
+// Result to the replacement node.
+class AstRewriter : public AstVisitor {
+protected:
+    AstExprPtr Result;
+public:
+    virtual AstExprPtr rewrite(const AstExpr& expr);
+    virtual std::unique_ptr<AstFunction> rewrite(const AstFunction& func);
+
+    void visit(const AstExprConstLong& expr) override;
+    void visit(const AstExprConstBool& expr) override;
+    void visit(const AstExprConstArray& expr) override;
+    void visit(const AstExprVariable& expr) override;
+    void visit(const AstExprIndex& expr) override;
+    void visit(const AstExprCall& expr) override;
+    void visit(const AstExprLetIn& expr) override;
+    void visit(const AstExprMatch& expr) override;
+
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>& expr) override;
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>& expr) override;
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>& expr) override;
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>& expr) override;
+
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>& expr) override;
+
+    void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>& expr) override;
+    void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>& expr) override;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#include "ast_walker.hpp"
+
+void AstWalker::walk(const AstExpr& expr) {
+    expr.accept(*this);
+}
+
+void AstWalker::visit(const AstExprConstLong& expr) {
+    (void) expr;
+}
+
+void AstWalker::visit(const AstExprConstBool& expr) {
+    (void) expr;
+}
+
+void AstWalker::visit(const AstExprConstArray& expr) {
+    for (const auto& element : expr.getElements()) {
+        walk(*element);
+    }
+}
+
+void AstWalker::visit(const AstExprVariable& expr) {
+    (void) expr;
+}
+
+void AstWalker::visit(const AstExprIndex& expr) {
+    walk(*expr.getIndexee());
+    walk(*expr.getIndexer());
+}
+
+void AstWalker::visit(const AstExprCall& expr) {
+    for (const auto& arg : expr.getArgs()) {
+        walk(*arg);
+    }
+}
+
+void AstWalker::visit(const AstExprLetIn& expr) {
+    walk(*expr.getExpr());
+    walk(*expr.getBody());
+}
+
+void AstWalker::visit(const AstExprMatch& expr) {
+    for (const auto& path : expr.getPaths()) {
+        walk(*path->getGuard());
+        walk(*path->getBody());
+    }
+}
+
+#define IMPLEMENT_BIN_WALK(NODE, OP_KIND_TYPE, OP_KIND) \
+    void AstWalker::visit(const NODE<OP_KIND_TYPE::OP_KIND>& expr) { \
+        walk(*expr.getLHS()); \
+        walk(*expr.getRHS()); \
+    }
+
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Add)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Sub)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Mul)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Div)
+
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Eq)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Neq)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Leq)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Lt)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Geq)
+IMPLEMENT_BIN_WALK(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Gt)
+
+IMPLEMENT_BIN_WALK(AstExprBinaryBoolToBool, BinaryOpKindBoolToBool, And)
+IMPLEMENT_BIN_WALK(AstExprBinaryBoolToBool, BinaryOpKindBoolToBool, Or)
+
+#undef IMPLEMENT_BIN_WALK
@@ -0,0 +1,38 @@
+#ifndef AST_WALKER_HPP
+#define AST_WALKER_HPP
+
+#include "ast.hpp"
+
+// Default AstVisitor that recursively visits every child of a node.
+// Analyses override the visit methods they care about and call
+// AstWalker::visit(expr) to keep descending.
+class AstWalker : public AstVisitor {
+public:
+    virtual void walk(const AstExpr& expr);
+
+    void visit(const AstExprConstLong& expr) override;
+    void visit(const AstExprConstBool& expr) override;
+    void visit(const AstExprConstArray& expr) override;
+    void visit(const AstExprVariable& expr) override;
+    void visit(const AstExprIndex& expr) override;
+    void visit(const AstExprCall& expr) override;
+    void visit(const AstExprLetIn& expr) override;
+    void visit(const AstExprMatch& expr) override;
+
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>& expr) override;
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>& expr) override;
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>& expr) override;
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>& expr) override;
+
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>& expr) override;
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>& expr) override;
+
+    void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>& expr) override;
+    void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>& expr) override;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include <cstdint>
+
+#include "char_scan.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+enum class CharClass { Whitespace, Identifier, Digit };
+
+template <CharClass Class>
+bool inClass(char c) {
+    switch (Class) {
+        case CharClass::Whitespace: return isWhitespaceChar(c);
+        case CharClass::Identifier: return isIdentifierChar(c);
+        default: return isDigitChar(c);
+    }
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#if defined(__AVX2__)
+using Block = __m256i;
+constexpr size_t BlockSize = 32;
+inline Block load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Block splat(char c) { return _mm256_set1_epi8(c); }
+inline Block eq(Block a, Block b) { return _mm256_cmpeq_epi8(a, b); }
+inline Block orBlocks(Block a, Block b) { return _mm256_or_si256(a, b); }
+inline Block sub(Block a, Block b) { return _mm256_sub_epi8(a, b); }
+inline Block minUnsigned(Block a, Block b) { return _mm256_min_epu8(a, b); }
+inline uint32_t matchMask(Block mask) { return static_cast<uint32_t>(_mm256_movemask_epi8(mask)); }
+constexpr uint32_t FullMask = 0xFFFFFFFFu;
+#else
+using Block = __m128i;
+constexpr size_t BlockSize = 16;
+inline Block load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Block splat(char c) { return _mm_set1_epi8(c); }
+inline Block eq(Block a, Block b) { return _mm_cmpeq_epi8(a, b); }
+inline Block orBlocks(Block a, Block b) { return _mm_or_si128(a, b); }
+inline Block sub(Block a, Block b) { return _mm_sub_epi8(a, b); }
+inline Block minUnsigned(Block a, Block b) { return _mm_min_epu8(a, b); }
+inline uint32_t matchMask(Block mask) { return static_cast<uint32_t>(_mm_movemask_epi8(mask)); }
+constexpr uint32_t FullMask = 0xFFFFu;
+#endif
+
+// lo <= c <= hi as an unsigned comparison of c - lo.
+inline Block inRange(Block c, char lo, char hi) {
+    Block offset = sub(c, splat(lo));
+    return eq(minUnsigned(offset, splat(static_cast<char>(hi - lo))), offset);
+}
+
+template <CharClass Class>
+Block classify(Block c) {
+    switch (Class) {
+        case CharClass::Whitespace: return orBlocks(eq(c, splat(' ')), inRange(c, '\t', '\r'));
+        case CharClass::Identifier:
+            return orBlocks(orBlocks(inRange(orBlocks(c, splat(0x20)), 'a', 'z'), inRange(c, '0', '9')), eq(c, splat('_')));
+        default: return inRange(c, '0', '9');
+    }
+}
+
+// Index of the first byte of a block outside the class, or BlockSize.
+template <CharClass Class>
+size_t firstMismatch(const char* p) {
+    uint32_t mismatches = ~matchMask(classify<Class>(load(p))) & FullMask;
+    return mismatches ? static_cast<size_t>(__builtin_ctz(mismatches)) : BlockSize;
+}
+
+#elif defined(__ARM_NEON)
+
+constexpr size_t BlockSize = 16;
+
+inline uint8x16_t inRange(uint8x16_t c, char lo, char hi) {
+    return vcleq_u8(vsubq_u8(c, vdupq_n_u8(lo)), vdupq_n_u8(static_cast<uint8_t>(hi - lo)));
+}
+
+template <CharClass Class>
+uint8x16_t classify(uint8x16_t c) {
+    switch (Class) {
+        case CharClass::Whitespace: return vorrq_u8(vceqq_u8(c, vdupq_n_u8(' ')), inRange(c, '\t', '\r'));
+        case CharClass::Identifier:
+            return vorrq_u8(vorrq_u8(inRange(vorrq_u8(c, vdupq_n_u8(0x20)), 'a', 'z'), inRange(c, '0', '9')),
+                            vceqq_u8(c, vdupq_n_u8('_')));
+        default: return inRange(c, '0', '9');
+    }
+}
+
+// NEON has no movemask; narrowing keeps four bits per byte instead.
+template <CharClass Class>
+size_t firstMismatch(const char* p) {
+    uint8x16_t matches = classify<Class>(vld1q_u8(reinterpret_cast<const uint8_t*>(p)));
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(matches), 4);
+    uint64_t mismatches = ~vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+    return mismatches ? static_cast<size_t>(__builtin_ctzll(mismatches)) / 4 : BlockSize;
+}
+
+#endif
+
+template <CharClass Class>
+const char* skipClass(const char* p, const char* end) {
+#if defined(__AVX2__) || defined(__SSE2__) || defined(__ARM_NEON)
+    while (static_cast<size_t>(end - p) >= BlockSize) {
+        size_t index = firstMismatch<Class>(p);
+        if (index < BlockSize) return p + index;
+        p += BlockSize;
+    }
+#endif
+    while (p < end && inClass<Class>(*p)) ++p;
+    return p;
+}
+
+}
+
+const char* skipWhitespaceChars(const char* begin, const char* end) {
+    return skipClass<CharClass::Whitespace>(begin, end);
+}
+
+const char* skipIdentifierChars(const char* begin, const char* end) {
+    return skipClass<CharClass::Identifier>(begin, end);
+}
+
+const char* skipDigitChars(const char* begin, const char* end) {
+    return skipClass<CharClass::Digit>(begin, end);
+}
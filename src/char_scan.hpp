@@ -0,0 +1,28 @@
+#ifndef CHAR_SCAN_HPP
+#define CHAR_SCAN_HPP
+
+#include <cstddef>
+
+// Locale independent character classes of the lexer.
+inline bool isWhitespaceChar(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+inline bool isDigitChar(char c) {
+    return c >= '0' && c <= '9';
+}
+inline bool isIdentifierStartChar(char c) {
+    char lower = static_cast<char>(c | 0x20);
+    return (lower >= 'a' && lower <= 'z') || c == '_';
+}
+inline bool isIdentifierChar(char c) {
+    return isIdentifierStartChar(c) || isDigitChar(c);
+}
+
+// Each returns the position of the first character in [begin, end) outside
+// the class. Full 16 or 32 byte blocks are classified with SSE2, AVX2 or NEON
+// where the target has them, the rest byte by byte.
+const char* skipWhitespaceChars(const char* begin, const char* end);
+const char* skipIdentifierChars(const char* begin, const char* end);
+const char* skipDigitChars(const char* begin, const char* end);
+
+#endif
@@ -1,24 +1,39 @@
 #include "codegen.hpp"
+#include "ast_dispatch.hpp"
+#include "debug_info.hpp"
+#include "freestanding_runtime.hpp"
+#include "profile.hpp"
+
+llvm::Value *CodeGenerator::dispatch(const AstExpr& expr, CodegenContext& ctx) const {
+    return dispatchExpr(expr, [this, &ctx](const auto& node) { return CodeGenerator::visit(node, ctx); });
+}
 
 llvm::Value *CodeGenerator::codegen(const AstExpr& expr, CodegenContext& ctx) const {
-    return expr.accept(*this, ctx);
+    if (!Debug) {
+        return dispatch(expr, ctx);
+    }
+
+    // Instructions emitted for a node after its children are generated
+    // belong to the node itself, so restore its location afterwards.
+    llvm::DebugLoc outerLoc = Builder->getCurrentDebugLocation();
+    Builder->SetCurrentDebugLocation(Debug->getLocation(expr.getLocation(), ctx.DebugScope));
+    llvm::Value *result = dispatch(expr, ctx);
+    Builder->SetCurrentDebugLocation(outerLoc);
+    return result;
 }
 
 llvm::Value *CodeGenerator::codegen(const AstFunction& func, CodegenContext& ctx) {
-    llvm::Function *TheFunction = TheModule->getFunction(func.getPrototype()->getName());
+    llvm::Function *TheFunction = getFunction(func.getPrototype()->getName());
 
-    std::vector<llvm::Type *> ArgTypes;
-    for (auto arg : func.getPrototype()->getArgs()) {
-        ArgTypes.push_back(llvm::Type::getInt64Ty(*TheContext));
-    }
+    std::vector<llvm::Type *> ArgTypes(func.getPrototype()->getArgs().size(), llvm::Type::getInt64Ty(*TheContext));
 
     llvm::FunctionType *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(*TheContext), ArgTypes, false);
 
-    llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, func.getPrototype()->getName(), TheModule.get());
+    llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, func.getPrototype()->getName().str(), TheModule.get());
 
     unsigned Idx = 0;
     for (auto &Arg : F->args())
-        Arg.setName(func.getPrototype()->getArgs()[Idx++].Name);
+        Arg.setName(func.getPrototype()->getArgs()[Idx++].Name.str());
 
     TheFunction = F;
 
@@ -27,11 +42,17 @@ llvm::Value *CodeGenerator::codegen(const AstFunction& func, CodegenContext& ctx
 
     ctx.NamedValues.clear();
     for (auto &Arg : TheFunction->args())
-        ctx.NamedValues[std::string(Arg.getName())] = &Arg;
+        ctx.NamedValues[func.getPrototype()->getArgs()[Arg.getArgNo()].Name] = &Arg;
+
+    beginFunctionBody(func, *TheFunction, ctx);
 
     if (llvm::Value *RetVal = this->codegen(*func.getBody(), ctx)) {
         Builder->CreateRet(RetVal);
 
+        if (Debug) {
+            Debug->finalizeFunction(*TheFunction);
+        }
+
         verifyFunction(*TheFunction);
 
         return TheFunction;
@@ -40,6 +61,31 @@ llvm::Value *CodeGenerator::codegen(const AstFunction& func, CodegenContext& ctx
     throw CodegenException("Function failed to generate", func.getLocation());
 }
 
+void CodeGenerator::beginFunctionBody(const AstFunction& func, llvm::Function& F, CodegenContext& ctx) {
+    ctx.FunctionName = func.getPrototype()->getName().str();
+    ctx.NextMatchIndex = 0;
+    ctx.Profile = nullptr;
+    ctx.DebugScope = nullptr;
+
+    if (Debug) {
+        ctx.DebugScope = Debug->createFunction(F, func);
+        Builder->SetCurrentDebugLocation(Debug->getLocation(func.getLocation(), ctx.DebugScope));
+    } else {
+        Builder->SetCurrentDebugLocation(llvm::DebugLoc());
+    }
+
+    if (ProfileGen) {
+        ProfileGen->emitFunctionEntry(*this, func);
+    }
+
+    if (ProfileUse) {
+        ctx.Profile = ProfileUse->lookup(func);
+        if (ctx.Profile) {
+            ProfileUse->annotateFunction(F, *ctx.Profile);
+        }
+    }
+}
+
 // Helper to get or create the printf function declaration
 llvm::Function *getPrintf(CodeGenerator& codeGen) {
     // Check if printf is already declared
@@ -67,20 +113,22 @@ llvm::Function *getPrintf(CodeGenerator& codeGen) {
 
 // Global constant for the format string "%lld\n"
 llvm::Constant *getFormatString(CodeGenerator& codeGen) {
-
-    llvm::Constant *FormatStr = llvm::ConstantDataArray::getString(
-        *codeGen.TheContext, "%lld\n"
-    );
-
-    // Create a global variable to hold the string
-    llvm::GlobalVariable *GlobalStr = new llvm::GlobalVariable(
-        *codeGen.TheModule,
-        FormatStr->getType(),
-        true, // isConstant
-        llvm::GlobalValue::PrivateLinkage,
-        FormatStr,
-        "formatStr"
-    );
+    llvm::GlobalVariable *GlobalStr = codeGen.TheModule->getNamedGlobal("formatStr");
+    if (!GlobalStr) {
+        llvm::Constant *FormatStr = llvm::ConstantDataArray::getString(
+            *codeGen.TheContext, "%lld\n"
+        );
+
+        // Create a global variable to hold the string
+        GlobalStr = new llvm::GlobalVariable(
+            *codeGen.TheModule,
+            FormatStr->getType(),
+            true, // isConstant
+            llvm::GlobalValue::PrivateLinkage,
+            FormatStr,
+            "formatStr"
+        );
+    }
 
     llvm::Constant *Zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(*codeGen.TheContext), 0);
     std::vector<llvm::Constant *> indices = {Zero, Zero};
@@ -91,20 +139,17 @@ llvm::Constant *getFormatString(CodeGenerator& codeGen) {
 }
 
 llvm::Value *CodeGenerator::codegenPrintResult(const AstFunction& func, CodegenContext& ctx) {
-    llvm::Function *TheFunction = TheModule->getFunction(func.getPrototype()->getName());
+    llvm::Function *TheFunction = getFunction(func.getPrototype()->getName());
 
-    std::vector<llvm::Type *> ArgTypes;
-    for (auto arg : func.getPrototype()->getArgs()) {
-        ArgTypes.push_back(llvm::Type::getInt64Ty(*TheContext));
-    }
+    std::vector<llvm::Type *> ArgTypes(func.getPrototype()->getArgs().size(), llvm::Type::getInt64Ty(*TheContext));
 
     llvm::FunctionType *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(*TheContext), ArgTypes, false);
 
-    llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, func.getPrototype()->getName(), TheModule.get());
+    llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, func.getPrototype()->getName().str(), TheModule.get());
 
     unsigned Idx = 0;
     for (auto &Arg : F->args())
-        Arg.setName(func.getPrototype()->getArgs()[Idx++].Name);
+        Arg.setName(func.getPrototype()->getArgs()[Idx++].Name.str());
 
     TheFunction = F;
 
@@ -113,21 +158,39 @@ llvm::Value *CodeGenerator::codegenPrintResult(const AstFunction& func, CodegenC
 
     ctx.NamedValues.clear();
     for (auto &Arg : TheFunction->args())
-        ctx.NamedValues[std::string(Arg.getName())] = &Arg;
+        ctx.NamedValues[func.getPrototype()->getArgs()[Arg.getArgNo()].Name] = &Arg;
+
+    beginFunctionBody(func, *TheFunction, ctx);
 
     if (llvm::Value *RetVal = this->codegen(*func.getBody(), ctx)) {
-        llvm::Function *printfFunc = getPrintf(*this);
-        llvm::Constant *formatStr = getFormatString(*this);
+        if (Freestanding) {
+            emitFreestandingPrint(*this, Builder->CreateZExt(RetVal, llvm::Type::getInt64Ty(*TheContext)));
+        } else {
+            llvm::Function *printfFunc = getPrintf(*this);
+            llvm::Constant *formatStr = getFormatString(*this);
+
+            std::vector<llvm::Value *> args;
+            args.push_back(formatStr);
+            args.push_back(RetVal);
 
-        std::vector<llvm::Value *> args;
-        args.push_back(formatStr);
-        args.push_back(RetVal);
+            Builder->CreateCall(printfFunc, args, "printcall");
+        }
 
-        Builder->CreateCall(printfFunc, args, "printcall");
+        if (ProfileGen) {
+            ProfileGen->emitWriteProfile(*this);
+        }
         
         llvm::Value *zero = llvm::ConstantInt::get(llvm::Type::getInt64Ty(*TheContext), 0);
         Builder->CreateRet(zero);
 
+        if (Freestanding) {
+            emitFreestandingExits(*this, *TheFunction);
+        }
+
+        if (Debug) {
+            Debug->finalizeFunction(*TheFunction);
+        }
+
         verifyFunction(*TheFunction);
 
         return TheFunction;
@@ -136,6 +199,111 @@ llvm::Value *CodeGenerator::codegenPrintResult(const AstFunction& func, CodegenC
     throw CodegenException("Function failed to generate", func.getLocation());
 }
 
+llvm::Function *CodeGenerator::codegenInputMain(llvm::Function& entry) {
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*TheContext);
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(*TheContext);
+    llvm::Type *i8PtrTy = llvm::PointerType::get(llvm::Type::getInt8Ty(*TheContext), 0);
+    llvm::Type *i8PtrPtrTy = llvm::PointerType::get(i8PtrTy, 0);
+    unsigned numInputs = entry.arg_size();
+
+    llvm::FunctionCallee strtollFunc = TheModule->getOrInsertFunction(
+        "strtoll", llvm::FunctionType::get(Int64Ty, {i8PtrTy, i8PtrPtrTy, Int32Ty}, false));
+    llvm::FunctionCallee fdopenFunc = TheModule->getOrInsertFunction(
+        "fdopen", llvm::FunctionType::get(i8PtrTy, {Int32Ty, i8PtrTy}, false));
+    llvm::FunctionCallee freadFunc = TheModule->getOrInsertFunction(
+        "fread", llvm::FunctionType::get(Int64Ty, {i8PtrTy, Int64Ty, Int64Ty, i8PtrTy}, false));
+    llvm::FunctionCallee writeFunc = TheModule->getOrInsertFunction(
+        "write", llvm::FunctionType::get(Int64Ty, {Int32Ty, i8PtrTy, Int64Ty}, false));
+    llvm::Function *printfFunc = getPrintf(*this);
+    llvm::Constant *formatStr = getFormatString(*this);
+
+    llvm::FunctionType *FT = llvm::FunctionType::get(Int32Ty, {Int32Ty, i8PtrPtrTy}, false);
+    llvm::Function *F = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, "main", TheModule.get());
+    llvm::Argument *argc = F->getArg(0);
+    llvm::Argument *argv = F->getArg(1);
+    argc->setName("argc");
+    argv->setName("argv");
+
+    llvm::BasicBlock *EntryBB = llvm::BasicBlock::Create(*TheContext, "entry", F);
+    llvm::BasicBlock *ArgsBB = llvm::BasicBlock::Create(*TheContext, "args", F);
+    llvm::BasicBlock *StdinCheckBB = llvm::BasicBlock::Create(*TheContext, "stdin.check", F);
+    llvm::BasicBlock *StdinOpenBB = llvm::BasicBlock::Create(*TheContext, "stdin.open", F);
+    llvm::BasicBlock *StdinReadBB = llvm::BasicBlock::Create(*TheContext, "stdin.read", F);
+    llvm::BasicBlock *StdinBodyBB = llvm::BasicBlock::Create(*TheContext, "stdin.body", F);
+    llvm::BasicBlock *UsageBB = llvm::BasicBlock::Create(*TheContext, "usage", F);
+    llvm::BasicBlock *DoneBB = llvm::BasicBlock::Create(*TheContext, "done", F);
+
+    // The driver has no source location of its own.
+    Builder->SetCurrentDebugLocation(llvm::DebugLoc());
+
+    Builder->SetInsertPoint(EntryBB);
+    llvm::Value *record = Builder->CreateAlloca(Int64Ty, llvm::ConstantInt::get(Int32Ty, numInputs), "record");
+    llvm::Value *hasArgs = Builder->CreateICmpEQ(argc, llvm::ConstantInt::get(Int32Ty, numInputs + 1), "has_args");
+    Builder->CreateCondBr(hasArgs, ArgsBB, StdinCheckBB);
+
+    // One record from the command line.
+    Builder->SetInsertPoint(ArgsBB);
+    std::vector<llvm::Value *> argValues;
+    for (unsigned i = 0; i < numInputs; ++i) {
+        llvm::Value *argPtr = Builder->CreateGEP(i8PtrTy, argv, llvm::ConstantInt::get(Int32Ty, i + 1));
+        llvm::Value *argStr = Builder->CreateLoad(i8PtrTy, argPtr, "arg");
+        argValues.push_back(Builder->CreateCall(strtollFunc, {
+            argStr, llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(i8PtrPtrTy)), llvm::ConstantInt::get(Int32Ty, 10)
+        }, "input"));
+    }
+    llvm::Value *argResult = Builder->CreateCall(&entry, argValues, "result");
+    Builder->CreateCall(printfFunc, {formatStr, argResult}, "printcall");
+    Builder->CreateBr(DoneBB);
+
+    // Without arguments, records are read from stdin until it runs out; a
+    // trailing partial record is ignored.
+    Builder->SetInsertPoint(StdinCheckBB);
+    llvm::Value *noArgs = Builder->CreateICmpEQ(argc, llvm::ConstantInt::get(Int32Ty, 1), "no_args");
+    Builder->CreateCondBr(noArgs, StdinOpenBB, UsageBB);
+
+    Builder->SetInsertPoint(StdinOpenBB);
+    llvm::Value *input = Builder->CreateCall(fdopenFunc, {
+        llvm::ConstantInt::get(Int32Ty, 0), Builder->CreateGlobalStringPtr("rb", "stdin.mode")
+    }, "stdin");
+    Builder->CreateCondBr(Builder->CreateIsNull(input), DoneBB, StdinReadBB);
+
+    Builder->SetInsertPoint(StdinReadBB);
+    llvm::Value *recordBytes = Builder->CreateBitCast(record, i8PtrTy);
+    llvm::Value *numRead = Builder->CreateCall(freadFunc, {
+        recordBytes, llvm::ConstantInt::get(Int64Ty, 8), llvm::ConstantInt::get(Int64Ty, numInputs), input
+    }, "num_read");
+    llvm::Value *fullRecord = Builder->CreateICmpEQ(numRead, llvm::ConstantInt::get(Int64Ty, numInputs), "full_record");
+    Builder->CreateCondBr(fullRecord, StdinBodyBB, DoneBB);
+
+    Builder->SetInsertPoint(StdinBodyBB);
+    std::vector<llvm::Value *> recordValues;
+    for (unsigned i = 0; i < numInputs; ++i) {
+        llvm::Value *fieldPtr = Builder->CreateGEP(Int64Ty, record, llvm::ConstantInt::get(Int32Ty, i));
+        recordValues.push_back(Builder->CreateLoad(Int64Ty, fieldPtr, "input"));
+    }
+    llvm::Value *recordResult = Builder->CreateCall(&entry, recordValues, "result");
+    Builder->CreateCall(printfFunc, {formatStr, recordResult}, "printcall");
+    Builder->CreateBr(StdinReadBB);
+
+    Builder->SetInsertPoint(UsageBB);
+    std::string usage = "expected " + std::to_string(numInputs) + " integer arguments, or records of "
+        + std::to_string(numInputs) + " native 64 bit integers on stdin\n";
+    Builder->CreateCall(writeFunc, {
+        llvm::ConstantInt::get(Int32Ty, 2), Builder->CreateGlobalStringPtr(usage, "usage"), llvm::ConstantInt::get(Int64Ty, usage.size())
+    });
+    Builder->CreateRet(llvm::ConstantInt::get(Int32Ty, 1));
+
+    Builder->SetInsertPoint(DoneBB);
+    if (ProfileGen) {
+        ProfileGen->emitWriteProfile(*this);
+    }
+    Builder->CreateRet(llvm::ConstantInt::get(Int32Ty, 0));
+
+    verifyFunction(*F);
+
+    return F;
+}
+
 
 llvm::Value *CodeGenerator::visit(const AstExprConstLong& expr, CodegenContext& ctx) const {
     (void) ctx;
@@ -175,10 +343,24 @@ llvm::Value *CodeGenerator::visit(const AstExprIndex& expr, CodegenContext& ctx)
 }
 
 
+llvm::Function *CodeGenerator::getFunction(Symbol name) const {
+    auto it = FunctionsBySymbol.find(name);
+    if (it != FunctionsBySymbol.end()) {
+        if (auto *F = llvm::dyn_cast_or_null<llvm::Function>(static_cast<llvm::Value *>(it->second))) {
+            return F;
+        }
+    }
+    llvm::Function *F = TheModule->getFunction(name.str());
+    if (F) {
+        FunctionsBySymbol[name] = F;
+    }
+    return F;
+}
+
 llvm::Value *CodeGenerator::visit(const AstExprCall& expr, CodegenContext& ctx) const {
-    llvm::Function *CalleeF = TheModule->getFunction(expr.getCallee());
+    llvm::Function *CalleeF = getFunction(expr.getCallee());
     if (!CalleeF)
-        throw CodegenException("Function " + expr.getCallee() + " not found", expr.getLocation());
+        throw CodegenException("Function " + expr.getCallee().str() + " not found", expr.getLocation());
     
     if (CalleeF->arg_size() != expr.getArgs().size())
         throw CodegenException("Wrong number of args", expr.getLocation());
@@ -232,6 +414,7 @@ llvm::Value *CodeGenerator::visit(const AstExprMatch& expr, CodegenContext& ctx)
     Builder->SetInsertPoint(CurrentCondBB);
 
     std::vector<std::pair<llvm::Value*, llvm::BasicBlock*>> incomingValues;
+    unsigned matchIndex = ctx.NextMatchIndex++;
     
     for (size_t i = 0; i < expr.getPaths().size(); ++i) {
         const auto& path = expr.getPaths()[i];
@@ -243,19 +426,32 @@ llvm::Value *CodeGenerator::visit(const AstExprMatch& expr, CodegenContext& ctx)
         llvm::BasicBlock *ThenBB = llvm::BasicBlock::Create(*TheContext, "match.then", TheFunction);
 
         llvm::BasicBlock *NextCondBB = nullptr;
+        llvm::BranchInst *GuardBr;
         if (i == expr.getPaths().size() - 1) {
-            Builder->CreateCondBr(GuardVal, ThenBB, NoMatchBB);
+            GuardBr = Builder->CreateCondBr(GuardVal, ThenBB, NoMatchBB);
         } else {
             NextCondBB = llvm::BasicBlock::Create(*TheContext, "match.else", TheFunction);
-            Builder->CreateCondBr(GuardVal, ThenBB, NextCondBB);
+            GuardBr = Builder->CreateCondBr(GuardVal, ThenBB, NextCondBB);
+        }
+
+        if (ctx.Profile) {
+            uint64_t laterArms = 0;
+            for (size_t j = i + 1; j < expr.getPaths().size(); ++j) {
+                laterArms += ctx.Profile->getArmCount(matchIndex, j);
+            }
+            ProfileUse->annotateBranch(*GuardBr, ctx.Profile->getArmCount(matchIndex, i), laterArms);
         }
 
         Builder->SetInsertPoint(ThenBB);
+        if (ProfileGen) {
+            ProfileGen->emitArmEntry(*this, ctx.FunctionName, matchIndex, i);
+        }
         llvm::Value *ThenVal = this->codegen(*path->getBody(), ctx);
         if (!ThenVal)
             return nullptr;
 
-        incomingValues.push_back({ThenVal, ThenBB});
+        // The body may have left ThenBB, e.g. for the blocks of a nested match.
+        incomingValues.push_back({ThenVal, Builder->GetInsertBlock()});
         Builder->CreateBr(MergeBB);
 
         CurrentCondBB = NextCondBB;
@@ -1,7 +1,7 @@
 #ifndef CODEGEN_HPP
 #define CODEGEN_HPP
 
-#include <map>
+#include <unordered_map>
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
@@ -13,14 +13,25 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
+#include "llvm/IR/ValueHandle.h"
 #include "llvm/IR/Verifier.h"
 
 #include "ast.hpp"
 #include "codegen_exception.hpp"
 
+class ProfileGenerator;
+class ProfileData;
+struct FunctionProfile;
+class DebugInfoEmitter;
+
 class CodegenContext {
 public:
-    std::map<std::string, llvm::Value *> NamedValues;
+    std::unordered_map<Symbol, llvm::Value *> NamedValues;
+    // Used to identify profile counters of the function being generated.
+    std::string FunctionName;
+    unsigned NextMatchIndex = 0;
+    const FunctionProfile *Profile = nullptr;
+    llvm::DIScope *DebugScope = nullptr;
 };
 
 class CodeGenerator: AstLLVMValueVisitor {
@@ -28,11 +39,30 @@ public:
     std::unique_ptr<llvm::LLVMContext> TheContext;
     std::unique_ptr<llvm::Module> TheModule;
     std::unique_ptr<llvm::IRBuilder<>> Builder;
+    // Set to instrument generated code, or to annotate it with a collected profile.
+    ProfileGenerator *ProfileGen = nullptr;
+    const ProfileData *ProfileUse = nullptr;
+    // Set to attach source locations to the generated code.
+    DebugInfoEmitter *Debug = nullptr;
+    // Print the result without libc, see freestanding_runtime.hpp.
+    bool Freestanding = false;
 public:
     llvm::Value *codegen(const AstExpr& expr, CodegenContext& ctx) const;
     llvm::Value *codegen(const AstFunction& func, CodegenContext& ctx);
     llvm::Value *codegenPrintResult(const AstFunction& func, CodegenContext& ctx);
+    // Emits a main that calls entry once per input record and prints each
+    // result. Records come from argv, or as native 64 bit integers from stdin.
+    llvm::Function *codegenInputMain(llvm::Function& entry);
+    // Looks up a function of TheModule, remembering it by symbol.
+    llvm::Function *getFunction(Symbol name) const;
 private:
+    // The handles follow functions replaced by linking and drop deleted ones.
+    mutable std::unordered_map<Symbol, llvm::WeakTrackingVH> FunctionsBySymbol;
+
+    void beginFunctionBody(const AstFunction& func, llvm::Function& F, CodegenContext& ctx);
+    // Calls the visit() for the node's kind without virtual dispatch.
+    llvm::Value *dispatch(const AstExpr& expr, CodegenContext& ctx) const;
+
     llvm::Value *visit(const AstExprConstLong& expr, CodegenContext& ctx) const override;
     llvm::Value *visit(const AstExprConstBool& expr, CodegenContext& ctx) const override;
     llvm::Value *visit(const AstExprConstArray &expr, CodegenContext &ctx) const override;
@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <unistd.h>
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "compile_cache.hpp"
+#include "ast_walker.hpp"
+
+namespace {
+
+constexpr uint64_t FnvOffsetBasis = 1469598103934665603ULL;
+constexpr uint64_t FnvPrime = 1099511628211ULL;
+
+// Tags are part of the on-disk key format; only ever append to this list.
+enum class NodeTag : uint8_t {
+    ConstLong = 1, ConstBool, ConstArray, Variable, Index, Call, LetIn, Match,
+    Add, Sub, Mul, Div,
+    Eq, Neq, Leq, Lt, Geq, Gt,
+    And, Or,
+};
+
+class BodyHasher : public AstWalker {
+public:
+    uint64_t Hash = FnvOffsetBasis;
+    std::set<std::string> Callees;
+
+    void mixByte(uint8_t byte) {
+        Hash ^= byte;
+        Hash *= FnvPrime;
+    }
+    void mix(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            mixByte(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+    void mix(std::string_view text) {
+        mix(static_cast<uint64_t>(text.size()));
+        for (char c : text) {
+            mixByte(static_cast<uint8_t>(c));
+        }
+    }
+    void mixTag(NodeTag tag) {
+        mixByte(static_cast<uint8_t>(tag));
+    }
+
+    void visit(const AstExprConstLong& expr) override {
+        mixTag(NodeTag::ConstLong);
+        mix(static_cast<uint64_t>(expr.getValue()));
+    }
+    void visit(const AstExprConstBool& expr) override {
+        mixTag(NodeTag::ConstBool);
+        mixByte(expr.getValue() ? 1 : 0);
+    }
+    void visit(const AstExprConstArray& expr) override {
+        mixTag(NodeTag::ConstArray);
+        mix(static_cast<uint64_t>(expr.getElements().size()));
+        AstWalker::visit(expr);
+    }
+    void visit(const AstExprVariable& expr) override {
+        mixTag(NodeTag::Variable);
+        mix(expr.getName().str());
+    }
+    void visit(const AstExprIndex& expr) override {
+        mixTag(NodeTag::Index);
+        AstWalker::visit(expr);
+    }
+    void visit(const AstExprCall& expr) override {
+        mixTag(NodeTag::Call);
+        mix(expr.getCallee().str());
+        mix(static_cast<uint64_t>(expr.getArgs().size()));
+        Callees.insert(expr.getCallee().str());
+        AstWalker::visit(expr);
+    }
+    void visit(const AstExprLetIn& expr) override {
+        mixTag(NodeTag::LetIn);
+        mix(expr.getVariable().str());
+        AstWalker::visit(expr);
+    }
+    void visit(const AstExprMatch& expr) override {
+        mixTag(NodeTag::Match);
+        mix(static_cast<uint64_t>(expr.getPaths().size()));
+        AstWalker::visit(expr);
+    }
+
+#define IMPLEMENT_BIN_HASH(NODE, OP_KIND_TYPE, OP_KIND) \
+    void visit(const NODE<OP_KIND_TYPE::OP_KIND>& expr) override { \
+        mixTag(NodeTag::OP_KIND); \
+        AstWalker::visit(expr); \
+    }
+
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Add)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Sub)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Mul)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToInt, BinaryOpKindIntToInt, Div)
+
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Eq)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Neq)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Leq)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Lt)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Geq)
+    IMPLEMENT_BIN_HASH(AstExprBinaryIntToBool, BinaryOpKindIntToBool, Gt)
+
+    IMPLEMENT_BIN_HASH(AstExprBinaryBoolToBool, BinaryOpKindBoolToBool, And)
+    IMPLEMENT_BIN_HASH(AstExprBinaryBoolToBool, BinaryOpKindBoolToBool, Or)
+
+#undef IMPLEMENT_BIN_HASH
+};
+
+} // namespace
+
+uint64_t hashString(std::string_view text, uint64_t seed) {
+    BodyHasher hasher;
+    hasher.mix(seed);
+    hasher.mix(text);
+    return hasher.Hash;
+}
+
+static void hashFunction(BodyHasher& hasher, const AstFunction& func) {
+    hasher.mix(func.getPrototype()->getName().str());
+    hasher.mix(static_cast<uint64_t>(func.getPrototype()->getArgs().size()));
+    for (const auto& arg : func.getPrototype()->getArgs()) {
+        hasher.mix(arg.Name.str());
+    }
+    hasher.walk(*func.getBody());
+}
+
+uint64_t hashFunctionBody(const AstFunction& func) {
+    BodyHasher hasher;
+    hashFunction(hasher, func);
+    return hasher.Hash;
+}
+
+FunctionHasher::FunctionHasher(uint64_t seed) : Seed(seed) {}
+
+uint64_t FunctionHasher::addFunction(const AstFunction& func) {
+    const std::string& name = func.getPrototype()->getName().str();
+
+    BodyHasher hasher;
+    hasher.mix(Seed);
+    hashFunction(hasher, func);
+
+    // Callees are visited in sorted order so the key does not depend on the
+    // order calls appear in the body. Self calls are covered by the name.
+    for (const auto& callee : hasher.Callees) {
+        if (callee == name) continue;
+        hasher.mix(callee);
+        auto it = Keys.find(callee);
+        hasher.mix(it != Keys.end() ? it->second : 0);
+    }
+
+    Keys[name] = hasher.Hash;
+    return hasher.Hash;
+}
+
+void FunctionHasher::addExternalKey(const std::string& name, uint64_t key) {
+    Keys[name] = key;
+}
+
+std::optional<uint64_t> FunctionHasher::getKey(const std::string& name) const {
+    auto it = Keys.find(name);
+    if (it != Keys.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+
+CompileCache::CompileCache(const std::filesystem::path& directory, uintmax_t sizeLimit)
+    : Directory(directory), SizeLimit(sizeLimit) {}
+
+std::filesystem::path CompileCache::entryPath(uint64_t key) const {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key << ".bc";
+    return Directory / name.str();
+}
+
+std::optional<std::string> CompileCache::lookup(uint64_t key) const {
+    std::filesystem::path path = entryPath(key);
+    std::ifstream fileStream(path, std::ios::binary);
+    if (!fileStream.is_open()) {
+        return std::nullopt;
+    }
+    std::stringstream buffer;
+    buffer << fileStream.rdbuf();
+    if (!fileStream.good() && !fileStream.eof()) {
+        return std::nullopt;
+    }
+
+    // Touch the entry so prune() evicts in least recently used order.
+    std::error_code ec;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return buffer.str();
+}
+
+void CompileCache::store(uint64_t key, const std::string& data) const {
+    std::error_code ec;
+    std::filesystem::create_directories(Directory, ec);
+    if (ec) return;
+
+    writeFileAtomically(entryPath(key), data);
+}
+
+bool writeFileAtomically(const std::filesystem::path& path, const std::string& data) {
+    std::error_code ec;
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!out.good()) {
+            out.close();
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+void CompileCache::prune() const {
+    struct Entry {
+        std::filesystem::file_time_type LastUse;
+        uintmax_t Size;
+        std::filesystem::path Path;
+    };
+
+    std::error_code ec;
+    std::vector<Entry> entries;
+    uintmax_t totalSize = 0;
+    for (const auto& dirEntry : std::filesystem::directory_iterator(Directory, ec)) {
+        if (dirEntry.path().extension() != ".bc") continue;
+        std::error_code entryEc;
+        uintmax_t size = dirEntry.file_size(entryEc);
+        if (entryEc) continue;
+        auto lastUse = dirEntry.last_write_time(entryEc);
+        if (entryEc) continue;
+        entries.push_back(Entry{lastUse, size, dirEntry.path()});
+        totalSize += size;
+    }
+
+    if (totalSize <= SizeLimit) return;
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.LastUse < b.LastUse;
+    });
+    for (const auto& entry : entries) {
+        if (totalSize <= SizeLimit) break;
+        if (std::filesystem::remove(entry.Path, ec)) {
+            totalSize -= entry.Size;
+        }
+    }
+}
+
+
+std::string emitFunctionBitcode(const llvm::Function& func) {
+    llvm::ValueToValueMapTy VMap;
+    std::unique_ptr<llvm::Module> single = llvm::CloneModule(*func.getParent(), VMap,
+        [&func](const llvm::GlobalValue *GV) { return GV == &func; });
+
+    // Everything else was cloned as a declaration; only keep the ones the
+    // function actually references so linking stays cheap.
+    std::vector<llvm::GlobalValue *> unused;
+    for (auto &GV : single->global_values()) {
+        if (GV.isDeclaration() && GV.use_empty()) {
+            unused.push_back(&GV);
+        }
+    }
+    for (auto *GV : unused) {
+        GV->eraseFromParent();
+    }
+
+    std::string bitcode;
+    llvm::raw_string_ostream os(bitcode);
+    llvm::WriteBitcodeToFile(*single, os);
+    os.flush();
+    return bitcode;
+}
+
+bool linkFunctionBitcode(llvm::Module& module, const std::string& bitcode) {
+    auto buffer = llvm::MemoryBuffer::getMemBuffer(bitcode, "cached-function", false);
+    auto cachedModule = llvm::parseBitcodeFile(buffer->getMemBufferRef(), module.getContext());
+    if (!cachedModule) {
+        llvm::consumeError(cachedModule.takeError());
+        return false;
+    }
+    // linkModules returns true on error.
+    return !llvm::Linker::linkModules(module, std::move(*cachedModule));
+}
@@ -0,0 +1,57 @@
+#ifndef COMPILE_CACHE_HPP
+#define COMPILE_CACHE_HPP
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+#include "ast.hpp"
+
+// Computes content-addressed cache keys for functions. A key covers the
+// structure of a function body (source locations are ignored) plus the keys
+// of every function it calls, so changing a callee invalidates its callers.
+// Functions must be added in definition order.
+class FunctionHasher {
+    uint64_t Seed;
+    std::unordered_map<std::string, uint64_t> Keys;
+public:
+    explicit FunctionHasher(uint64_t seed);
+    uint64_t addFunction(const AstFunction& func);
+    // Registers a function compiled elsewhere, e.g. in an imported module.
+    void addExternalKey(const std::string& name, uint64_t key);
+    std::optional<uint64_t> getKey(const std::string& name) const;
+};
+
+uint64_t hashString(std::string_view text, uint64_t seed);
+// Structural hash of a single function, ignoring its callees.
+uint64_t hashFunctionBody(const AstFunction& func);
+
+// On-disk store of per-function bitcode keyed by FunctionHasher keys.
+// The cache is best effort: I/O errors make lookups miss and stores no-ops.
+class CompileCache {
+    std::filesystem::path Directory;
+    uintmax_t SizeLimit;
+
+    std::filesystem::path entryPath(uint64_t key) const;
+public:
+    CompileCache(const std::filesystem::path& directory, uintmax_t sizeLimit);
+    std::optional<std::string> lookup(uint64_t key) const;
+    void store(uint64_t key, const std::string& data) const;
+    // Evicts least recently used entries until the cache fits its size limit.
+    void prune() const;
+};
+
+// Writes through a private temporary that is renamed into place, so
+// concurrent processes never observe a partially written file.
+bool writeFileAtomically(const std::filesystem::path& path, const std::string& data);
+
+std::string emitFunctionBitcode(const llvm::Function& func);
+bool linkFunctionBitcode(llvm::Module& module, const std::string& bitcode);
+
+#endif
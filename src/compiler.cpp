@@ -1,43 +1,438 @@
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
+#include <map>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Linker/Linker.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/ToolOutputFile.h>
+#include <llvm/TargetParser/Host.h>
 
+#include "ast_interner.hpp"
 #include "codegen.hpp"
+#include "compile_cache.hpp"
+#include "const_eval.hpp"
+#include "cse.hpp"
+#include "debug_info.hpp"
+#include "freestanding_runtime.hpp"
+#include "guard_elimination.hpp"
+#include "inliner.hpp"
+#include "module_loader.hpp"
+#include "optimizer.hpp"
 #include "runner.hpp"
+#include "shared_library.hpp"
+#include "specializer.hpp"
 #include "parser.hpp"
+#include "profile.hpp"
 
+struct CompilerOptions {
+    unsigned OptLevel = 0;
+    std::optional<std::string> CacheDir;
+    std::optional<std::string> AstCacheDir;
+    uintmax_t CacheSizeLimit = 256 * 1024 * 1024;
+    std::vector<std::filesystem::path> ImportPaths;
+    std::optional<std::filesystem::path> ModuleDir;
+    std::optional<std::string> ProfileGenerate;
+    std::vector<std::string> ProfileUse;
+    uint64_t ConstEvalFuel = 1000000;
+    bool SpecializeAst = false;
+    bool SpecializeIR = false;
+    size_t SpecializeBudget = 1000;
+    size_t InlineThreshold = 30;
+    bool EliminateRedundancy = true;
+    bool DebugInfo = false;
+    bool Shared = false;
+    std::vector<std::string> Exports;
+    std::string SymbolPrefix;
+    std::optional<std::string> HeaderPath;
+    bool Freestanding = false;
+};
 
-int compileFile(char file[], char outputFilename[]) {
-    std::string filePath = file;
-    std::string sourceCode = readFile(filePath);
+// Deeper recursion is left to runtime code, so the compiler's stack stays bounded.
+const size_t ConstEvalMaxCallDepth = 2000;
 
-    Parser parser(sourceCode);
-    
-    CodeGenerator codeGenerator;
+// Anything that changes the generated code for an unchanged function body
+// has to be part of the seed, otherwise stale entries would be reused. That
+// includes the options of the AST pipeline, as module bitcode is keyed by
+// the source rather than by the rewritten bodies.
+uint64_t cacheSeed(const CompilerOptions& options) {
+    std::string pipeline = " inline-" + std::to_string(options.InlineThreshold) + " fuel-" + std::to_string(options.ConstEvalFuel)
+        + (options.SpecializeAst ? " specialize-" + std::to_string(options.SpecializeBudget) : "")
+        + (options.EliminateRedundancy ? " redundancy-elim" : "");
+    return hashString("fun-lang-cache-v1 llvm-" LLVM_VERSION_STRING " O" + std::to_string(options.OptLevel)
+                      + (options.DebugInfo ? " g" : "") + pipeline, 0);
+}
+
+// The AST passes every module goes through before code generation.
+// Interning first shares repeated subtrees, so the analyses the later passes
+// cache per node cover every copy. Inlining comes next, so that
+// compile-time evaluation sees the arguments that flow into inlined bodies.
+// Specialized clones are simplified with the same fuel as compile-time
+// evaluation. Guards and repeated subexpressions are eliminated once the
+// code is as constant as it gets. Interning again merges the identical
+// subtrees clones and their originals end up with, like guards folded to the
+// same constant. Debug info needs every node's own location.
+PassManager buildAstPipeline(const CompilerOptions& options) {
+    PassManager passes;
+    passes.addPass(std::make_unique<InternPass>(options.DebugInfo));
+    if (options.InlineThreshold > 0) {
+        passes.addPass(std::make_unique<InlinePass>(options.InlineThreshold));
+    }
+    if (options.ConstEvalFuel > 0) {
+        passes.addPass(std::make_unique<ConstantEvaluationPass>(options.ConstEvalFuel, ConstEvalMaxCallDepth));
+    }
+    if (options.SpecializeAst) {
+        passes.addPass(std::make_unique<SpecializationPass>(options.SpecializeBudget, options.ConstEvalFuel, ConstEvalMaxCallDepth));
+    }
+    if (options.EliminateRedundancy) {
+        passes.addPass(std::make_unique<GuardEliminationPass>());
+        passes.addPass(std::make_unique<CommonSubexpressionPass>());
+    }
+    passes.addPass(std::make_unique<InternPass>(options.DebugInfo));
+    return passes;
+}
+
+void initCodeGenerator(CodeGenerator& codeGenerator, const std::string& moduleName) {
     codeGenerator.TheContext = std::make_unique<llvm::LLVMContext>();
-    codeGenerator.TheModule = std::make_unique<llvm::Module>("testcompiled", *codeGenerator.TheContext);
+    codeGenerator.TheModule = std::make_unique<llvm::Module>(moduleName, *codeGenerator.TheContext);
     codeGenerator.Builder = std::make_unique<llvm::IRBuilder<>>(*codeGenerator.TheContext);
+}
 
-    while (parser.get().Kind == TokenKind::Fn) {
-        auto func = parser.parseFunction();
-        if (!func) {
-            throw ParserException("Parsing failed while defining a function.", SourceLocation{0, 0});
+void compileFunctions(CodeGenerator& codeGenerator, const std::vector<std::unique_ptr<AstFunction>>& functions,
+                      Optimizer& optimizer, FunctionHasher& hasher, const std::optional<CompileCache>& cache) {
+    for (const auto& func : functions) {
+        const std::string& name = func->getPrototype()->getName().str();
+        llvm::Function *existing = codeGenerator.TheModule->getFunction(name);
+        if (existing && existing->isDeclaration()) {
+            throw CodegenException("Function '" + name + "' is already defined in an imported module", func->getPrototype()->getLocation());
         }
+
+        uint64_t key = hasher.addFunction(*func);
+        if (cache) {
+            if (auto bitcode = cache->lookup(key)) {
+                if (linkFunctionBitcode(*codeGenerator.TheModule, *bitcode)) {
+                    continue;
+                }
+            }
+        }
+
         CodegenContext ctxt;
-        codeGenerator.codegen(*func, ctxt);
+        auto *F = llvm::cast<llvm::Function>(codeGenerator.codegen(*func, ctxt));
+        optimizer.optimizeFunction(*F);
+
+        if (cache) {
+            cache->store(key, emitFunctionBitcode(*F));
+        }
+    }
+}
+
+// --- Separate compilation of imported modules ---
+
+std::filesystem::path moduleBitcodePath(const CompilerOptions& options, const std::filesystem::path& moduleDir, const SourceModule& module) {
+    // Same-named modules from different directories must not share a file,
+    // and neither may builds with different options.
+    std::ostringstream name;
+    name << module.Name << "." << std::hex << std::setw(16) << std::setfill('0')
+         << hashString(module.Path.string(), cacheSeed(options)) << ".bc";
+    return moduleDir / name.str();
+}
+
+void collectDependencies(const SourceModule& module, std::vector<const SourceModule*>& out) {
+    for (const SourceModule* dependency : module.Dependencies) {
+        if (std::find(out.begin(), out.end(), dependency) != out.end()) continue;
+        out.push_back(dependency);
+        collectDependencies(*dependency, out);
     }
+}
 
-    auto resultExpr = parser.parseExpression();
+bool isBitcodeUpToDate(const std::filesystem::path& bitcodePath, const SourceModule& module,
+                       const std::map<const SourceModule*, std::filesystem::path>& bitcodePaths) {
+    std::error_code ec;
+    auto bitcodeTime = std::filesystem::last_write_time(bitcodePath, ec);
+    if (ec) return false;
+    auto sourceTime = std::filesystem::last_write_time(module.Path, ec);
+    if (ec || sourceTime > bitcodeTime) return false;
 
-    if (!resultExpr) {
-        throw ParserException("Parsing failed for the main expression.", parser.get().Location);
+    // A rebuilt dependency may have changed the signatures this module was
+    // compiled against.
+    std::vector<const SourceModule*> dependencies;
+    collectDependencies(module, dependencies);
+    for (const SourceModule* dependency : dependencies) {
+        auto dependencyTime = std::filesystem::last_write_time(bitcodePaths.at(dependency), ec);
+        if (ec || dependencyTime > bitcodeTime) return false;
     }
+    return true;
+}
 
-    auto mainFuncProto = std::make_unique<AstPrototype>(resultExpr->getLocation(), "main", std::vector<AstArg>{});
-    auto resultFunction = std::make_unique<AstFunction>(resultExpr->getLocation(), std::move(mainFuncProto), std::move(resultExpr));
+// Loads a module's bitcode lazily: only the symbol table is read up front,
+// function bodies are materialized when the linker actually needs them.
+std::unique_ptr<llvm::Module> loadModuleBitcode(const std::filesystem::path& bitcodePath, llvm::LLVMContext& context, uint64_t& contentKey) {
+    auto buffer = llvm::MemoryBuffer::getFile(bitcodePath.string());
+    if (!buffer) {
+        throw FileError("Error: Could not open module bitcode " + bitcodePath.string());
+    }
+    contentKey = hashString(std::string((*buffer)->getBuffer()), 0);
+
+    auto module = llvm::getOwningLazyBitcodeModule(std::move(*buffer), context);
+    if (!module) {
+        llvm::consumeError(module.takeError());
+        throw FileError("Error: Could not read module bitcode " + bitcodePath.string());
+    }
+    return std::move(*module);
+}
+
+// Declares every function defined in an imported module so calls to it can be
+// generated, and records its content key so callers are rebuilt when it changes.
+void declareImportedFunctions(CodeGenerator& codeGenerator, FunctionHasher& hasher, const std::filesystem::path& bitcodePath) {
+    uint64_t contentKey;
+    auto imported = loadModuleBitcode(bitcodePath, *codeGenerator.TheContext, contentKey);
+    for (const llvm::Function& F : imported->functions()) {
+        if (F.isDeclaration()) continue;
+        codeGenerator.TheModule->getOrInsertFunction(F.getName(), F.getFunctionType());
+        hasher.addExternalKey(std::string(F.getName()), contentKey);
+    }
+}
+
+void writeModuleBitcode(llvm::Module& module, const std::filesystem::path& bitcodePath) {
+    std::error_code ec;
+    std::filesystem::create_directories(bitcodePath.parent_path(), ec);
+
+    llvm::ToolOutputFile Out(bitcodePath.string(), ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        throw FileError("Error: Could not write module bitcode " + bitcodePath.string() + ": " + ec.message());
+    }
+    llvm::WriteBitcodeToFile(module, Out.os());
+    Out.keep();
+}
+
+void compileModule(SourceModule& module, const std::filesystem::path& bitcodePath,
+                   const std::map<const SourceModule*, std::filesystem::path>& bitcodePaths,
+                   const CompilerOptions& options, const std::optional<CompileCache>& cache) {
+    CodeGenerator codeGenerator;
+    initCodeGenerator(codeGenerator, module.Name);
+    Optimizer optimizer(options.OptLevel);
+    FunctionHasher hasher(cacheSeed(options));
+
+    std::optional<DebugInfoEmitter> debugInfo;
+    if (options.DebugInfo) {
+        debugInfo.emplace(*codeGenerator.TheModule, module, options.OptLevel > 0);
+        codeGenerator.Debug = &*debugInfo;
+    }
+
+    std::vector<const SourceModule*> dependencies;
+    collectDependencies(module, dependencies);
+    for (const SourceModule* dependency : dependencies) {
+        declareImportedFunctions(codeGenerator, hasher, bitcodePaths.at(dependency));
+    }
+
+    buildAstPipeline(options).run(module.Functions, nullptr);
+    // Cache keys ignore where a function is in the file, so cached code
+    // could carry stale line numbers.
+    const std::optional<CompileCache> noCache;
+    compileFunctions(codeGenerator, module.Functions, optimizer, hasher, debugInfo ? noCache : cache);
+    if (debugInfo) {
+        debugInfo->finalize();
+    }
+    writeModuleBitcode(*codeGenerator.TheModule, bitcodePath);
+}
+
+void compileMain(CodeGenerator& codeGenerator, SourceModule& root, Optimizer& optimizer) {
+    if (codeGenerator.Freestanding && !root.MainInputs.empty()) {
+        throw CodegenException("Inputs are not supported by the freestanding runtime", root.MainInputs.front().Location);
+    }
+
+    if (root.MainInputs.empty()) {
+        // Without libc there is no startup code calling main.
+        std::string entryName = codeGenerator.Freestanding ? "_start" : "main";
+        auto mainFuncProto = std::make_unique<AstPrototype>(root.MainExpr->getLocation(), entryName, std::vector<AstArg>{});
+        auto resultFunction = std::make_unique<AstFunction>(root.MainExpr->getLocation(), std::move(mainFuncProto), std::move(root.MainExpr));
+
+        CodegenContext ctxt;
+        auto *mainFunction = llvm::cast<llvm::Function>(codeGenerator.codegenPrintResult(*resultFunction, ctxt));
+        optimizer.optimizeFunction(*mainFunction);
+        return;
+    }
+
+    // A main expression with inputs becomes a function of them, which the
+    // generated main calls once per input record.
+    auto entryProto = std::make_unique<AstPrototype>(root.MainExpr->getLocation(), "__lang_main", root.MainInputs);
+    auto entryFunction = std::make_unique<AstFunction>(root.MainExpr->getLocation(), std::move(entryProto), std::move(root.MainExpr));
 
     CodegenContext ctxt;
-    codeGenerator.codegenPrintResult(*resultFunction, ctxt);
+    auto *entry = llvm::cast<llvm::Function>(codeGenerator.codegen(*entryFunction, ctxt));
+    optimizer.optimizeFunction(*entry);
+    optimizer.optimizeFunction(*codeGenerator.codegenInputMain(*entry));
+}
+
+// Link importers before their dependencies so that every declaration an
+// imported function introduces is resolved by a later module. Only functions
+// that are actually referenced get pulled in.
+void linkImportedModules(CodeGenerator& codeGenerator, const ModuleLoader& loader,
+                         const std::map<const SourceModule*, std::filesystem::path>& bitcodePaths) {
+    const auto& modules = loader.getModules();
+    for (auto it = modules.rbegin(); it != modules.rend(); ++it) {
+        if ((*it)->IsRoot) continue;
+        uint64_t contentKey;
+        auto imported = loadModuleBitcode(bitcodePaths.at(*it), *codeGenerator.TheContext, contentKey);
+        if (llvm::Linker::linkModules(*codeGenerator.TheModule, std::move(imported), llvm::Linker::Flags::LinkOnlyNeeded)) {
+            throw FileError("Error: Could not link module " + (*it)->Path.string());
+        }
+    }
+}
+
+int compileFile(char file[], char outputFilename[], const CompilerOptions& options, ModuleLoader& loader) {
+    SourceModule& root = loader.load(file);
+
+    std::optional<CompileCache> cache;
+    if (options.CacheDir) {
+        cache.emplace(*options.CacheDir, options.CacheSizeLimit);
+    }
+
+    std::filesystem::path moduleDir = options.ModuleDir.value_or(
+        std::filesystem::absolute(outputFilename).parent_path());
+
+    // Imported modules are compiled on their own and only rebuilt when they
+    // or one of their dependencies changed.
+    std::map<const SourceModule*, std::filesystem::path> bitcodePaths;
+    for (SourceModule* module : loader.getModules()) {
+        if (module->IsRoot) continue;
+        std::filesystem::path bitcodePath = moduleBitcodePath(options, moduleDir, *module);
+        if (!isBitcodeUpToDate(bitcodePath, *module, bitcodePaths)) {
+            loader.parse(*module);
+            compileModule(*module, bitcodePath, bitcodePaths, options, cache);
+        }
+        bitcodePaths[module] = bitcodePath;
+    }
+
+    loader.parse(root);
+    buildAstPipeline(options).run(root.Functions, &root.MainExpr);
+
+    CodeGenerator codeGenerator;
+    initCodeGenerator(codeGenerator, "testcompiled");
+    Optimizer optimizer(options.OptLevel, options.SpecializeIR);
+    FunctionHasher hasher(cacheSeed(options));
+
+    if (options.Freestanding) {
+        // System calls are emitted as inline assembly for the host.
+        codeGenerator.TheModule->setTargetTriple(llvm::sys::getDefaultTargetTriple());
+        if (!isFreestandingSupported(llvm::Triple(codeGenerator.TheModule->getTargetTriple()))) {
+            llvm::errs() << "--freestanding is only supported on Linux x86-64 and AArch64\n";
+            return 1;
+        }
+        codeGenerator.Freestanding = true;
+    }
+
+    // Only the root module is instrumented or annotated with profiles.
+    std::optional<ProfileGenerator> profileGenerator;
+    if (options.ProfileGenerate) {
+        profileGenerator.emplace(*options.ProfileGenerate);
+        codeGenerator.ProfileGen = &*profileGenerator;
+    }
+    ProfileData profileData;
+    if (!options.ProfileUse.empty()) {
+        for (const std::string& path : options.ProfileUse) {
+            profileData.read(path);
+        }
+        codeGenerator.ProfileUse = &profileData;
+    }
+
+    std::optional<DebugInfoEmitter> debugInfo;
+    if (options.DebugInfo) {
+        debugInfo.emplace(*codeGenerator.TheModule, root, options.OptLevel > 0);
+        codeGenerator.Debug = &*debugInfo;
+    }
+
+    // Cached code carries neither counters, profile data nor up to date line
+    // numbers, so those builds bypass the cache.
+    bool bypassCache = codeGenerator.ProfileGen || codeGenerator.ProfileUse || codeGenerator.Debug;
+    const std::optional<CompileCache> noCache;
+
+    for (const SourceModule* module : loader.getModules()) {
+        if (module->IsRoot) continue;
+        declareImportedFunctions(codeGenerator, hasher, bitcodePaths.at(module));
+    }
+
+    // A shared library exports the selected root functions, by default all
+    // of them, instead of a main that prints the program's result. Helpers
+    // and clones the compiler made up stay internal.
+    std::vector<const AstFunction*> exports;
+    if (options.Shared) {
+        for (const auto& func : root.Functions) {
+            if (func->isInternal()) continue;
+            const std::string& name = func->getPrototype()->getName().str();
+            if (options.Exports.empty() || std::count(options.Exports.begin(), options.Exports.end(), name)) {
+                exports.push_back(func.get());
+            }
+        }
+        for (const std::string& name : options.Exports) {
+            auto isExported = [&](const AstFunction* func) { return func->getPrototype()->getName().str() == name; };
+            if (std::none_of(exports.begin(), exports.end(), isExported)) {
+                llvm::errs() << "Cannot export '" << name << "': no such function in " << file << "\n";
+                return 1;
+            }
+        }
+        for (const AstFunction* func : exports) {
+            std::string symbol = options.SymbolPrefix + func->getPrototype()->getName().str();
+            if (!isValidCIdentifier(symbol)) {
+                llvm::errs() << "Cannot export '" << symbol << "': not a valid C identifier\n";
+                return 1;
+            }
+        }
+    }
+
+    compileFunctions(codeGenerator, root.Functions, optimizer, hasher, bypassCache ? noCache : cache);
+
+    if (!options.Shared) {
+        compileMain(codeGenerator, root, optimizer);
+    }
+
+    if (debugInfo) {
+        debugInfo->finalize();
+    }
+
+    linkImportedModules(codeGenerator, loader, bitcodePaths);
+
+    std::set<std::string> entryPoints;
+    if (options.Shared) {
+        for (const AstFunction* func : exports) {
+            std::string symbol = options.SymbolPrefix + func->getPrototype()->getName().str();
+            llvm::Function *F = codeGenerator.TheModule->getFunction(func->getPrototype()->getName().str());
+            F->setName(symbol);
+            if (F->getName() != symbol) {
+                llvm::errs() << "Cannot export '" << symbol << "': the symbol is already used\n";
+                return 1;
+            }
+            entryPoints.insert(symbol);
+        }
+    } else {
+        entryPoints.insert(codeGenerator.Freestanding ? "_start" : "main");
+    }
+
+    // With imports the linked program is optimized as a whole. A shared
+    // library is always internalized, so only its exports stay visible, and
+    // LLVM only specializes internal functions.
+    if (!bitcodePaths.empty() || options.Shared || options.SpecializeIR) {
+        optimizer.optimizeLinkedProgram(*codeGenerator.TheModule, entryPoints);
+    }
+
+    if (cache) {
+        cache->prune();
+    }
+
+    if (options.Shared) {
+        emitSharedLibrary(*codeGenerator.TheModule, outputFilename);
+        std::string headerPath = options.HeaderPath.value_or(
+            std::filesystem::path(outputFilename).replace_extension(".h").string());
+        writeCHeader(headerPath, exports, options.SymbolPrefix, std::filesystem::path(file).filename().string());
+        llvm::outs() << "Successfully generated shared library: " << outputFilename << " (header: " << headerPath << ")\n";
+        return 0;
+    }
 
     std::error_code EC;
     
@@ -57,35 +452,24 @@ int compileFile(char file[], char outputFilename[]) {
     return 0;
 }
 
-int compileFileAndPrint(char file[], char outputFilename[]) {
+int compileFileAndPrint(char file[], char outputFilename[], const CompilerOptions& options) {
+    ModuleLoader loader(options.ImportPaths, !options.Shared);
+    if (options.AstCacheDir) {
+        loader.setAstCache(*options.AstCacheDir);
+    }
     try {
-        compileFile(file, outputFilename);
+        return compileFile(file, outputFilename, options, loader);
     } catch (const LexerException& e) {
         std::cerr << "Lexer Error: " << e.what() << std::endl;
-        try {
-            std::string sourceCode = readFile(file);
-            printAffectedCode(sourceCode, e.Location, file);
-        } catch (const std::exception& fileE) {
-            std::cerr << "Could not read file for error display: " << fileE.what() << std::endl;
-        }
+        printAffectedCode(loader, e.Location, file);
         return 1;
     } catch (const ParserException& e) {
         std::cerr << "Parser Error: " << e.what() << std::endl;
-        try {
-            std::string sourceCode = readFile(file);
-            printAffectedCode(sourceCode, e.Location, file);
-        } catch (const std::exception& fileE) {
-            std::cerr << "Could not read file for error display: " << fileE.what() << std::endl;
-        }
+        printAffectedCode(loader, e.Location, file);
         return 1;
     } catch (const CodegenException& e) {
         std::cerr << "Codegen Error: " << e.what() << std::endl;
-        try {
-            std::string sourceCode = readFile(file);
-            printAffectedCode(sourceCode, e.Location, file);
-        } catch (const std::exception& fileE) {
-            std::cerr << "Could not read file for error display: " << fileE.what() << std::endl;
-        }
+        printAffectedCode(loader, e.Location, file);
         return 1;
     } catch (const std::exception& e) {
         std::cerr << "Fatal Error: " << e.what() << std::endl;
@@ -96,11 +480,123 @@ int compileFileAndPrint(char file[], char outputFilename[]) {
 }
 
 
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] <input filename> <output filename>" << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  -O<level>             Optimization level 0-3 (default 0)" << std::endl;
+    std::cerr << "  --shared              Build a shared library and C header instead of a program" << std::endl;
+    std::cerr << "  --export <name>       Function to export from the shared library; may be given several times (default: all)" << std::endl;
+    std::cerr << "  --symbol-prefix <p>   Prefix for exported symbols" << std::endl;
+    std::cerr << "  --header <file>       Where to write the C header (default: the output with a .h extension)" << std::endl;
+    std::cerr << "  --freestanding        Print the result through system calls instead of libc (link with -nostdlib -static)" << std::endl;
+    std::cerr << "  -g                    Emit DWARF debug info with .lang source locations" << std::endl;
+    std::cerr << "  --cache-dir <dir>     Reuse per-function code from an on-disk cache" << std::endl;
+    std::cerr << "  --cache-limit <bytes> Maximum cache size before old entries are evicted" << std::endl;
+    std::cerr << "  --ast-cache <dir>     Reuse parsed modules of unchanged source files from <dir>" << std::endl;
+    std::cerr << "  -I <dir>              Additional directory to search for imported modules" << std::endl;
+    std::cerr << "  --module-dir <dir>    Where compiled imported modules are kept (default: next to the output)" << std::endl;
+    std::cerr << "  --profile-generate[=<file>]" << std::endl;
+    std::cerr << "                        Instrument the program to write a profile on exit (default: default.langprof)" << std::endl;
+    std::cerr << "  --profile-use <file>  Optimize using a collected profile; may be given several times" << std::endl;
+    std::cerr << "  --specialize[=ast|ir] Clone functions for calls with constant arguments, on the AST, in LLVM or both (default)" << std::endl;
+    std::cerr << "  --specialize-budget <nodes>" << std::endl;
+    std::cerr << "                        Total size of AST clones (default 1000)" << std::endl;
+    std::cerr << "  --inline-threshold <cost>" << std::endl;
+    std::cerr << "                        Largest function body inlined into its callers; 0 disables (default 30)" << std::endl;
+    std::cerr << "  --no-redundancy-elim  Keep match guards implied by earlier ones and repeated subexpressions" << std::endl;
+    std::cerr << "  --const-eval-fuel <steps>" << std::endl;
+    std::cerr << "                        Step budget for evaluating each closed expression at compile time; 0 disables (default 1000000)" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <input filename> <output filename>" << std::endl;
+    CompilerOptions options;
+    std::vector<char*> positional;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3') {
+            options.OptLevel = arg[2] - '0';
+        } else if (arg == "--shared") {
+            options.Shared = true;
+        } else if (arg == "--export" && i + 1 < argc) {
+            options.Exports.push_back(argv[++i]);
+        } else if (arg == "--symbol-prefix" && i + 1 < argc) {
+            options.SymbolPrefix = argv[++i];
+        } else if (arg == "--header" && i + 1 < argc) {
+            options.HeaderPath = argv[++i];
+        } else if (arg == "--freestanding") {
+            options.Freestanding = true;
+        } else if (arg == "-g") {
+            options.DebugInfo = true;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            options.CacheDir = argv[++i];
+        } else if (arg == "--ast-cache" && i + 1 < argc) {
+            options.AstCacheDir = argv[++i];
+        } else if (arg == "-I" && i + 1 < argc) {
+            options.ImportPaths.push_back(argv[++i]);
+        } else if (arg == "--module-dir" && i + 1 < argc) {
+            options.ModuleDir = argv[++i];
+        } else if (arg == "--profile-generate") {
+            options.ProfileGenerate = "default.langprof";
+        } else if (arg.rfind("--profile-generate=", 0) == 0) {
+            options.ProfileGenerate = arg.substr(std::string("--profile-generate=").size());
+        } else if (arg == "--profile-use" && i + 1 < argc) {
+            options.ProfileUse.push_back(argv[++i]);
+        } else if (arg == "--specialize" || arg == "--specialize=ast" || arg == "--specialize=ir") {
+            options.SpecializeAst = arg != "--specialize=ir";
+            options.SpecializeIR = arg != "--specialize=ast";
+        } else if (arg == "--specialize-budget" && i + 1 < argc) {
+            try {
+                options.SpecializeBudget = std::stoull(argv[++i]);
+            } catch (const std::exception&) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--inline-threshold" && i + 1 < argc) {
+            try {
+                options.InlineThreshold = std::stoull(argv[++i]);
+            } catch (const std::exception&) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--no-redundancy-elim") {
+            options.EliminateRedundancy = false;
+        } else if (arg == "--const-eval-fuel" && i + 1 < argc) {
+            try {
+                options.ConstEvalFuel = std::stoull(argv[++i]);
+            } catch (const std::exception&) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--cache-limit" && i + 1 < argc) {
+            try {
+                options.CacheSizeLimit = std::stoull(argv[++i]);
+            } catch (const std::exception&) {
+                printUsage(argv[0]);
+                return 1;
+            }
+        } else if (!arg.empty() && arg[0] == '-') {
+            printUsage(argv[0]);
+            return 1;
+        } else {
+            positional.push_back(argv[i]);
+        }
+    }
+
+    if (positional.size() != 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (options.Shared && options.ProfileGenerate) {
+        std::cerr << "--profile-generate needs a program with a main expression to write the profile" << std::endl;
+        return 1;
+    }
+
+    if (options.Freestanding && (options.Shared || options.ProfileGenerate)) {
+        std::cerr << "--freestanding cannot be combined with --shared or --profile-generate" << std::endl;
         return 1;
     }
 
-    return compileFileAndPrint(argv[1], argv[2]);
+    return compileFileAndPrint(positional[0], positional[1], options);
 }
\ No newline at end of file
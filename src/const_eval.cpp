@@ -0,0 +1,94 @@
+#include <algorithm>
+
+#include "const_eval.hpp"
+#include "ast_dispatch.hpp"
+#include "interpreter_exception.hpp"
+
+namespace {
+
+// Returns the variables free in expr and records every closed subexpression.
+std::vector<Symbol> collectClosed(const AstExpr& expr, std::unordered_set<const AstExpr*>& closed) {
+    std::vector<Symbol> vars;
+    auto unite = [&vars](const std::vector<Symbol>& other) {
+        for (Symbol var : other) {
+            if (std::find(vars.begin(), vars.end(), var) == vars.end()) {
+                vars.push_back(var);
+            }
+        }
+    };
+    if (expr.getKind() == AstExprKind::Variable) {
+        vars.push_back(static_cast<const AstExprVariable&>(expr).getName());
+    } else if (expr.getKind() == AstExprKind::LetIn) {
+        const auto& let = static_cast<const AstExprLetIn&>(expr);
+        vars = collectClosed(*let.getBody(), closed);
+        vars.erase(std::remove(vars.begin(), vars.end(), let.getVariable()), vars.end());
+        unite(collectClosed(*let.getExpr(), closed));
+    } else {
+        forEachChild(expr, [&](const AstExpr& child) { unite(collectClosed(child, closed)); });
+    }
+    if (vars.empty()) {
+        closed.insert(&expr);
+    }
+    return vars;
+}
+
+}
+
+ConstantEvaluator::ConstantEvaluator(const Context& functions, uint64_t fuel, size_t maxCallDepth)
+    : Functions(functions), Fuel(fuel), MaxCallDepth(maxCallDepth) {}
+
+AstExprPtr ConstantEvaluator::rewrite(const AstExpr& expr) {
+    if (Depth == 0) {
+        Closed.clear();
+        collectClosed(expr, Closed);
+        RemainingFuel = Fuel;
+    }
+
+    AstExprKind kind = expr.getKind();
+    bool isLiteral = kind == AstExprKind::ConstLong || kind == AstExprKind::ConstBool;
+    if (RemainingFuel > 0 && !isLiteral && Closed.count(&expr)) {
+        if (auto value = tryEvaluate(expr)) {
+            return value;
+        }
+    }
+    ++Depth;
+    auto result = AstRewriter::rewrite(expr);
+    --Depth;
+    return result;
+}
+
+AstExprPtr ConstantEvaluator::tryEvaluate(const AstExpr& expr) {
+    Interpreter interpreter(Functions);
+    interpreter.setFuel(RemainingFuel, MaxCallDepth);
+
+    std::unique_ptr<InterpreterValue> value;
+    try {
+        value = interpreter.eval(expr);
+    } catch (const InterpreterException&) {
+        // Out of fuel, or an error that has to happen at runtime instead.
+        RemainingFuel = *interpreter.getRemainingFuel();
+        return nullptr;
+    }
+    RemainingFuel = *interpreter.getRemainingFuel();
+
+    if (auto longValue = dynamic_cast<InterpreterValueLong*>(value.get())) {
+        return std::make_unique<AstExprConstLong>(expr.getLocation(), longValue->getValue());
+    }
+    if (auto boolValue = dynamic_cast<InterpreterValueBool*>(value.get())) {
+        return std::make_unique<AstExprConstBool>(expr.getLocation(), boolValue->getValue());
+    }
+    return nullptr;
+}
+
+ConstantEvaluationPass::ConstantEvaluationPass(uint64_t fuel, size_t maxCallDepth) : Fuel(fuel), MaxCallDepth(maxCallDepth) {}
+
+bool ConstantEvaluationPass::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr,
+                                 AnalysisManager& analyses) {
+    (void) analyses;
+    Context functionContext;
+    for (const auto& func : functions) {
+        functionContext.addFunction(func->clone());
+    }
+    ConstantEvaluator evaluator(functionContext, Fuel, MaxCallDepth);
+    return rewriteModule(evaluator, functions, mainExpr);
+}
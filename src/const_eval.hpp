@@ -0,0 +1,44 @@
+#ifndef CONST_EVAL_HPP
+#define CONST_EVAL_HPP
+
+#include <cstdint>
+#include <unordered_set>
+
+#include "ast_rewriter.hpp"
+#include "interpreter.hpp"
+#include "pass_manager.hpp"
+
+// Replaces closed subexpressions by the value the interpreter computes for
+// them, largest first. A subexpression that fails or evaluates to an array
+// is kept as runtime code and its children are tried instead. All attempts
+// within one top-level expression share a single budget of fuel.
+class ConstantEvaluator : public AstRewriter {
+    const Context& Functions;
+    uint64_t Fuel;
+    size_t MaxCallDepth;
+
+    // State of the top-level expression being rewritten: its closed
+    // subexpressions, found in one bottom-up walk, and the fuel left.
+    std::unordered_set<const AstExpr*> Closed;
+    uint64_t RemainingFuel = 0;
+    size_t Depth = 0;
+
+    AstExprPtr tryEvaluate(const AstExpr& expr);
+public:
+    ConstantEvaluator(const Context& functions, uint64_t fuel, size_t maxCallDepth);
+
+    using AstRewriter::rewrite;
+    AstExprPtr rewrite(const AstExpr& expr) override;
+};
+
+// Evaluates closed subexpressions of a module at compile time, calling only
+// the module's own functions: imported modules exist as bitcode only.
+class ConstantEvaluationPass : public AstPass {
+    uint64_t Fuel;
+    size_t MaxCallDepth;
+public:
+    ConstantEvaluationPass(uint64_t fuel, size_t maxCallDepth);
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) override;
+};
+
+#endif
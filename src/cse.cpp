@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "cse.hpp"
+#include "ast_dispatch.hpp"
+
+namespace {
+
+void mix(size_t& hash, size_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+}
+
+// Finds the expressions evaluated every time a region is that may be
+// hoisted out of it. Reused for every region, to keep its buffers.
+class OccurrenceCounter {
+    AnalysisManager& Analyses;
+    // Variables bound by lets inside the region around the counted node.
+    std::vector<Symbol> Bound;
+
+    struct NodeInfo {
+        size_t Hash;
+        size_t Cost;
+        // Pure, and refers to no variable bound inside the region.
+        bool Hoistable;
+    };
+    struct Occurrence {
+        size_t Hash;
+        size_t Cost;
+        const AstExpr* Expr;
+    };
+    std::vector<Occurrence> Occurrences;
+
+    NodeInfo count(const AstExpr& expr) {
+        NodeInfo info {static_cast<size_t>(expr.getKind()), 1, true};
+        dispatchExpr(expr, [&](const auto& node) {
+            using Node = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<Node, AstExprConstLong> || std::is_same_v<Node, AstExprConstBool>) {
+                mix(info.Hash, static_cast<size_t>(node.getValue()));
+            } else if constexpr (std::is_same_v<Node, AstExprVariable>) {
+                mix(info.Hash, node.getName().getId());
+                info.Hoistable = std::find(Bound.begin(), Bound.end(), node.getName()) == Bound.end();
+            } else if constexpr (std::is_same_v<Node, AstExprLetIn>) {
+                count(*node.getExpr());
+                Bound.push_back(node.getVariable());
+                count(*node.getBody());
+                Bound.pop_back();
+                info.Hoistable = false;
+            } else if constexpr (std::is_same_v<Node, AstExprMatch>) {
+                // Only the first guard is always evaluated.
+                if (!node.getPaths().empty()) {
+                    count(*node.getPaths().front()->getGuard());
+                }
+                info.Hoistable = false;
+            } else {
+                // Both operands of && and || are always evaluated as well.
+                if constexpr (std::is_same_v<Node, AstExprCall>) {
+                    mix(info.Hash, node.getCallee().getId());
+                    info.Cost += AnalysisManager::CallCost;
+                }
+                forEachChild(expr, [&](const AstExpr& child) {
+                    NodeInfo childInfo = count(child);
+                    mix(info.Hash, childInfo.Hash);
+                    info.Cost += childInfo.Cost;
+                    info.Hoistable = info.Hoistable && childInfo.Hoistable;
+                });
+                // Array literals would be copied rather than shared.
+                info.Hoistable = info.Hoistable && !std::is_same_v<Node, AstExprConstArray> && Analyses.isPureOperation(expr);
+                if (info.Hoistable) {
+                    Occurrences.push_back({info.Hash, info.Cost, &expr});
+                }
+            }
+        });
+        return info;
+    }
+public:
+    explicit OccurrenceCounter(AnalysisManager& analyses) : Analyses(analyses) {}
+
+    // The hoistable expression of the region saving the most work when
+    // evaluated once, or null if none saves at least minSaving.
+    const AstExpr* findMostRepeated(const AstExpr& region, size_t minSaving) {
+        Occurrences.clear();
+        count(region);
+        if (Occurrences.size() < 2) return nullptr;
+        std::sort(Occurrences.begin(), Occurrences.end(), [](const Occurrence& lhs, const Occurrence& rhs) {
+            return lhs.Hash < rhs.Hash;
+        });
+
+        const AstExpr* best = nullptr;
+        size_t bestSaving = minSaving - 1;
+        for (size_t begin = 0, end = 0; begin < Occurrences.size(); begin = end) {
+            while (end < Occurrences.size() && Occurrences[end].Hash == Occurrences[begin].Hash) ++end;
+            // Hash collisions are rare, so comparing within a run is cheap.
+            for (size_t i = begin; i < end; ++i) {
+                if (!Occurrences[i].Expr) continue;
+                size_t count = 1;
+                for (size_t j = i + 1; j < end; ++j) {
+                    if (Occurrences[j].Expr && isSameExpr(*Occurrences[i].Expr, *Occurrences[j].Expr)) {
+                        Occurrences[j].Expr = nullptr;
+                        ++count;
+                    }
+                }
+                size_t saving = (count - 1) * Occurrences[i].Cost;
+                if (saving > bestSaving) {
+                    best = Occurrences[i].Expr;
+                    bestSaving = saving;
+                }
+            }
+        }
+        return best;
+    }
+};
+
+// Replaces an expression by a variable wherever the variables it refers to
+// are not rebound.
+class OccurrenceReplacer : public AstRewriter {
+    const AstExpr& Target;
+    const std::vector<Symbol>& TargetVariables;
+    AstExprPtr Replacement;
+    std::unordered_map<Symbol, size_t> Shadowed;
+public:
+    OccurrenceReplacer(const AstExpr& target, const std::vector<Symbol>& targetVariables, AstExprPtr replacement)
+        : Target(target), TargetVariables(targetVariables), Replacement(std::move(replacement)) {}
+
+    using AstRewriter::visit;
+
+    AstExprPtr rewrite(const AstExpr& expr) override {
+        if (Shadowed.empty() && isSameExpr(expr, Target)) {
+            return Replacement;
+        }
+        return AstRewriter::rewrite(expr);
+    }
+
+    void visit(const AstExprLetIn& expr) override {
+        auto value = rewrite(*expr.getExpr());
+        bool shadows = std::find(TargetVariables.begin(), TargetVariables.end(), expr.getVariable()) != TargetVariables.end();
+        if (shadows) ++Shadowed[expr.getVariable()];
+        auto body = rewrite(*expr.getBody());
+        if (shadows && --Shadowed[expr.getVariable()] == 0) Shadowed.erase(expr.getVariable());
+        bool same = value.get() == expr.getExpr() && body.get() == expr.getBody();
+        Result = same ? expr.clone() : std::make_shared<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+    }
+};
+
+class SubexpressionEliminator : public AstRewriter {
+    AnalysisManager& Analyses;
+    OccurrenceCounter Counter;
+    size_t NextTemporary = 0;
+    // Whether the expression rewritten is part of a region, rather than the
+    // root of a function body or of the main expression.
+    bool InRegion = false;
+
+    // Hoists the most profitable repeated expression of the region, if any.
+    AstExprPtr hoist(const AstExprPtr& region) {
+        const AstExpr* best = Counter.findMostRepeated(*region, CommonSubexpressionPass::MinSaving);
+        if (!best) return nullptr;
+
+        AstExprPtr value = best->clone();
+        // Not a valid identifier, so no variable of the program is captured.
+        Symbol name("cse." + std::to_string(NextTemporary++));
+        const SourceLocation& loc = value->getLocation();
+        OccurrenceReplacer replacer(*value, Analyses.getFreeVariables(*value), std::make_shared<AstExprVariable>(loc, name));
+        return std::make_shared<AstExprLetIn>(region->getLocation(), name, value, replacer.rewrite(*region));
+    }
+
+    AstExprPtr eliminate(const AstExpr& expr) {
+        AstExprPtr region = expr.clone();
+        while (AstExprPtr hoisted = hoist(region)) {
+            region = std::move(hoisted);
+        }
+        // The regions nested in this one.
+        return AstRewriter::rewrite(*region);
+    }
+public:
+    explicit SubexpressionEliminator(AnalysisManager& analyses) : Analyses(analyses), Counter(analyses) {}
+
+    AstExprPtr rewrite(const AstExpr& expr) override {
+        if (InRegion) {
+            return AstRewriter::rewrite(expr);
+        }
+        InRegion = true;
+        AstExprPtr result = eliminate(expr);
+        InRegion = false;
+        return result;
+    }
+
+    using AstRewriter::visit;
+
+    void visit(const AstExprLetIn& expr) override {
+        auto value = rewrite(*expr.getExpr());
+        auto body = eliminate(*expr.getBody());
+        bool same = value.get() == expr.getExpr() && body.get() == expr.getBody();
+        Result = same ? expr.clone() : std::make_shared<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+    }
+
+    void visit(const AstExprMatch& expr) override {
+        std::vector<AstExprMatchPathPtr> paths;
+        for (const auto& path : expr.getPaths()) {
+            bool first = paths.empty();
+            auto guard = first ? rewrite(*path->getGuard()) : eliminate(*path->getGuard());
+            auto body = eliminate(*path->getBody());
+            bool same = guard.get() == path->getGuard() && body.get() == path->getBody();
+            paths.push_back(same ? path : std::make_shared<AstExprMatchPath>(path->getLocation(), std::move(guard), std::move(body)));
+        }
+        Result = paths == expr.getPaths() ? expr.clone() : std::make_shared<AstExprMatch>(expr.getLocation(), std::move(paths));
+    }
+};
+
+}
+
+bool CommonSubexpressionPass::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) {
+    SubexpressionEliminator eliminator(analyses);
+    return rewriteModule(eliminator, functions, mainExpr);
+}
@@ -0,0 +1,23 @@
+#ifndef CSE_HPP
+#define CSE_HPP
+
+#include "pass_manager.hpp"
+
+// Evaluates repeated pure subexpressions once: in
+//   (a * b + 1) * (a * b + 1)
+// the operand becomes let cse.0 = a * b + 1 in cse.0 * cse.0. Only
+// expressions that are evaluated at least twice whenever their region is
+// are hoisted, a region being a function body, a match arm, a guard after
+// the first or a let body. Pure expressions cannot fail, so evaluating one
+// earlier than written changes nothing but the work done. Within the
+// region every other occurrence, including those in arms, reuses the
+// variable.
+class CommonSubexpressionPass : public AstPass {
+public:
+    // Smallest saving, in AnalysisManager::getCost units, worth a let.
+    static constexpr size_t MinSaving = 6;
+
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) override;
+};
+
+#endif
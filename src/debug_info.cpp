@@ -0,0 +1,48 @@
+#include "llvm/BinaryFormat/Dwarf.h"
+
+#include "debug_info.hpp"
+
+DebugInfoEmitter::DebugInfoEmitter(llvm::Module& module, const SourceModule& source, bool isOptimized)
+    : DIB(module), Source(source.Source), BaseOffset(source.BaseOffset) {
+    std::filesystem::path path = std::filesystem::absolute(source.Path);
+    File = DIB.createFile(path.filename().string(), path.parent_path().string());
+    // There is no DWARF language code for .lang; C is the closest match for
+    // how debuggers and profilers should treat the functions.
+    CompileUnit = DIB.createCompileUnit(llvm::dwarf::DW_LANG_C, File, "fun-lang compiler", isOptimized, "", 0);
+    LongType = DIB.createBasicType("long", 64, llvm::dwarf::DW_ATE_signed);
+
+    module.addModuleFlag(llvm::Module::Warning, "Debug Info Version", llvm::DEBUG_METADATA_VERSION);
+    module.addModuleFlag(llvm::Module::Max, "Dwarf Version", 4);
+}
+
+// Shares the line table error messages use.
+std::pair<unsigned, unsigned> DebugInfoEmitter::getLineAndCol(size_t pos) const {
+    auto [line, col] = Source.getLineAndCol(pos >= BaseOffset ? pos - BaseOffset : 0);
+    return {static_cast<unsigned>(line), static_cast<unsigned>(col)};
+}
+
+llvm::DISubprogram *DebugInfoEmitter::createFunction(llvm::Function& F, const AstFunction& func) {
+    // Every argument and the result are 64 bit integers.
+    llvm::SmallVector<llvm::Metadata *, 8> signature(func.getPrototype()->getArgs().size() + 1, LongType);
+    llvm::DISubroutineType *type = DIB.createSubroutineType(DIB.getOrCreateTypeArray(signature));
+
+    unsigned line = getLineAndCol(func.getLocation().StartPos).first;
+    llvm::DISubprogram *subprogram = DIB.createFunction(
+        File, F.getName(), llvm::StringRef(), File, line, type, line,
+        llvm::DINode::FlagPrototyped, llvm::DISubprogram::SPFlagDefinition);
+    F.setSubprogram(subprogram);
+    return subprogram;
+}
+
+llvm::DILocation *DebugInfoEmitter::getLocation(const SourceLocation& loc, llvm::DIScope *scope) const {
+    auto [line, col] = getLineAndCol(loc.StartPos);
+    return llvm::DILocation::get(scope->getContext(), line, col, scope);
+}
+
+void DebugInfoEmitter::finalizeFunction(llvm::Function& F) {
+    DIB.finalizeSubprogram(F.getSubprogram());
+}
+
+void DebugInfoEmitter::finalize() {
+    DIB.finalize();
+}
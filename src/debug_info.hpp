@@ -0,0 +1,36 @@
+#ifndef DEBUG_INFO_HPP
+#define DEBUG_INFO_HPP
+
+#include <utility>
+
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+
+#include "ast.hpp"
+#include "module_loader.hpp"
+
+// Emits DWARF metadata for the code generated from one source file: a
+// compile unit for the file, a subprogram per function and a line location
+// for every expression.
+class DebugInfoEmitter {
+    llvm::DIBuilder DIB;
+    llvm::DIFile *File;
+    llvm::DICompileUnit *CompileUnit;
+    llvm::DIBasicType *LongType;
+    const SourceBuffer& Source;
+    size_t BaseOffset;
+
+    std::pair<unsigned, unsigned> getLineAndCol(size_t pos) const;
+public:
+    DebugInfoEmitter(llvm::Module& module, const SourceModule& source, bool isOptimized);
+    llvm::DISubprogram *createFunction(llvm::Function& F, const AstFunction& func);
+    llvm::DILocation *getLocation(const SourceLocation& loc, llvm::DIScope *scope) const;
+    void finalizeFunction(llvm::Function& F);
+    // Must be called once all functions are generated, before the module is
+    // written out.
+    void finalize();
+};
+
+#endif
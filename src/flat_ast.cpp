@@ -0,0 +1,238 @@
+#include <stdexcept>
+
+#include "flat_ast.hpp"
+
+FlatNodeId FlatAst::addNode(FlatNodeKind kind, uint32_t first, uint32_t second, const SourceLocation& loc) {
+    if (Kinds.size() > UINT32_MAX) {
+        throw std::length_error("Program has too many expressions for a flat AST");
+    }
+    if (loc.EndPos - BaseOffset > UINT32_MAX) {
+        throw std::length_error("Program is too large for a flat AST");
+    }
+    Kinds.push_back(kind);
+    First.push_back(first);
+    Second.push_back(second);
+    Locations.push_back(Span {static_cast<uint32_t>(loc.StartPos - BaseOffset), static_cast<uint32_t>(loc.EndPos - BaseOffset)});
+    return static_cast<FlatNodeId>(Kinds.size() - 1);
+}
+
+uint32_t FlatAst::addName(Symbol name) {
+    auto [it, inserted] = NameIndices.emplace(name, static_cast<uint32_t>(Names.size()));
+    if (inserted) {
+        Names.push_back(name);
+    }
+    return it->second;
+}
+
+FlatNodeId FlatAst::addListNode(FlatNodeKind kind, std::vector<uint32_t> items, uint32_t count, const SourceLocation& loc) {
+    uint32_t offset = static_cast<uint32_t>(Lists.size());
+    Lists.insert(Lists.end(), items.begin(), items.end());
+    return addNode(kind, offset, count, loc);
+}
+
+class FlatAstBuilder : public AstVisitor {
+    FlatAst& Ast;
+public:
+    FlatNodeId Result = 0;
+
+    explicit FlatAstBuilder(FlatAst& ast) : Ast(ast) {}
+
+    FlatNodeId build(const AstExpr& expr) {
+        expr.accept(*this);
+        return Result;
+    }
+
+    template <typename Node>
+    void binary(FlatNodeKind kind, const Node& expr) {
+        FlatNodeId lhs = build(*expr.getLHS());
+        FlatNodeId rhs = build(*expr.getRHS());
+        Result = Ast.addNode(kind, lhs, rhs, expr.getLocation());
+    }
+
+    void visit(const AstExprConstLong& expr) override {
+        Ast.Longs.push_back(expr.getValue());
+        Result = Ast.addNode(FlatNodeKind::ConstLong, static_cast<uint32_t>(Ast.Longs.size() - 1), 0, expr.getLocation());
+    }
+    void visit(const AstExprConstBool& expr) override {
+        Result = Ast.addNode(FlatNodeKind::ConstBool, expr.getValue(), 0, expr.getLocation());
+    }
+    void visit(const AstExprConstArray& expr) override {
+        std::vector<uint32_t> elements;
+        for (const auto& element : expr.getElements()) {
+            elements.push_back(build(*element));
+        }
+        uint32_t count = static_cast<uint32_t>(elements.size());
+        Result = Ast.addListNode(FlatNodeKind::ConstArray, std::move(elements), count, expr.getLocation());
+    }
+    void visit(const AstExprVariable& expr) override {
+        Result = Ast.addNode(FlatNodeKind::Variable, Ast.addName(expr.getName()), 0, expr.getLocation());
+    }
+    void visit(const AstExprIndex& expr) override {
+        FlatNodeId indexee = build(*expr.getIndexee());
+        FlatNodeId indexer = build(*expr.getIndexer());
+        Result = Ast.addNode(FlatNodeKind::Index, indexee, indexer, expr.getLocation());
+    }
+    void visit(const AstExprCall& expr) override {
+        std::vector<uint32_t> items {Ast.addName(expr.getCallee())};
+        for (const auto& arg : expr.getArgs()) {
+            items.push_back(build(*arg));
+        }
+        uint32_t count = static_cast<uint32_t>(expr.getArgs().size());
+        Result = Ast.addListNode(FlatNodeKind::Call, std::move(items), count, expr.getLocation());
+    }
+    void visit(const AstExprLetIn& expr) override {
+        FlatNodeId value = build(*expr.getExpr());
+        FlatNodeId body = build(*expr.getBody());
+        Result = Ast.addListNode(FlatNodeKind::LetIn, {Ast.addName(expr.getVariable()), value, body}, 2, expr.getLocation());
+    }
+    void visit(const AstExprMatch& expr) override {
+        std::vector<uint32_t> paths;
+        for (const auto& path : expr.getPaths()) {
+            FlatNodeId guard = build(*path->getGuard());
+            FlatNodeId body = build(*path->getBody());
+            paths.push_back(Ast.addNode(FlatNodeKind::MatchPath, guard, body, path->getLocation()));
+        }
+        uint32_t count = static_cast<uint32_t>(paths.size());
+        Result = Ast.addListNode(FlatNodeKind::Match, std::move(paths), count, expr.getLocation());
+    }
+
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>& expr) override { binary(FlatNodeKind::Add, expr); }
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>& expr) override { binary(FlatNodeKind::Sub, expr); }
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>& expr) override { binary(FlatNodeKind::Mul, expr); }
+    void visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>& expr) override { binary(FlatNodeKind::Div, expr); }
+
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>& expr) override { binary(FlatNodeKind::Eq, expr); }
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>& expr) override { binary(FlatNodeKind::Neq, expr); }
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>& expr) override { binary(FlatNodeKind::Leq, expr); }
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>& expr) override { binary(FlatNodeKind::Lt, expr); }
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>& expr) override { binary(FlatNodeKind::Geq, expr); }
+    void visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>& expr) override { binary(FlatNodeKind::Gt, expr); }
+
+    void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>& expr) override { binary(FlatNodeKind::And, expr); }
+    void visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>& expr) override { binary(FlatNodeKind::Or, expr); }
+};
+
+FlatNodeId FlatAst::add(const AstExpr& expr) {
+    FlatAstBuilder builder(*this);
+    return builder.build(expr);
+}
+
+FlatFunction FlatAst::add(const AstFunction& func) {
+    const AstPrototype* proto = func.getPrototype();
+    return FlatFunction {func.getLocation(), proto->getLocation(), proto->getName(), proto->getArgs(), add(*func.getBody()), func.isInternal()};
+}
+
+bool FlatAst::isWellFormed() const {
+    size_t nodeCount = Kinds.size();
+    if (First.size() != nodeCount || Second.size() != nodeCount || Locations.size() != nodeCount) {
+        return false;
+    }
+    for (FlatNodeId node = 0; node < nodeCount; ++node) {
+        // Children come before their parents, so they were checked already.
+        auto isChild = [&](uint32_t child) { return child < node && Kinds[child] != FlatNodeKind::MatchPath; };
+        // The list entries of the node, after skip leading ones.
+        auto listHolds = [&](uint64_t skip, uint64_t count) { return First[node] + skip + count <= Lists.size(); };
+        auto childrenFrom = [&](uint64_t skip) {
+            for (uint64_t i = 0; i < Second[node]; ++i) {
+                if (!isChild(Lists[First[node] + skip + i])) return false;
+            }
+            return true;
+        };
+
+        if (Locations[node].StartPos > Locations[node].EndPos) return false;
+        bool valid = false;
+        switch (Kinds[node]) {
+            case FlatNodeKind::ConstLong: valid = First[node] < Longs.size(); break;
+            case FlatNodeKind::ConstBool: valid = true; break;
+            case FlatNodeKind::Variable: valid = First[node] < Names.size(); break;
+            case FlatNodeKind::ConstArray: valid = listHolds(0, Second[node]) && childrenFrom(0); break;
+            case FlatNodeKind::Call:
+                valid = listHolds(1, Second[node]) && Lists[First[node]] < Names.size() && childrenFrom(1);
+                break;
+            case FlatNodeKind::LetIn:
+                valid = Second[node] == 2 && listHolds(1, 2) && Lists[First[node]] < Names.size() && childrenFrom(1);
+                break;
+            case FlatNodeKind::Match:
+                valid = listHolds(0, Second[node]);
+                for (uint64_t i = 0; valid && i < Second[node]; ++i) {
+                    FlatNodeId path = Lists[First[node] + i];
+                    valid = path < node && Kinds[path] == FlatNodeKind::MatchPath;
+                }
+                break;
+            case FlatNodeKind::Index: case FlatNodeKind::MatchPath:
+            case FlatNodeKind::Add: case FlatNodeKind::Sub: case FlatNodeKind::Mul: case FlatNodeKind::Div:
+            case FlatNodeKind::Eq: case FlatNodeKind::Neq: case FlatNodeKind::Leq: case FlatNodeKind::Lt:
+            case FlatNodeKind::Geq: case FlatNodeKind::Gt: case FlatNodeKind::And: case FlatNodeKind::Or:
+                valid = isChild(First[node]) && isChild(Second[node]);
+                break;
+        }
+        // Kinds outside the enumeration stay invalid.
+        if (!valid) return false;
+    }
+    return true;
+}
+
+namespace {
+
+template <typename Node>
+AstExprPtr makeBinary(const FlatAst& ast, FlatNodeId node) {
+    return std::make_unique<Node>(ast.getLocation(node), ast.toTree(ast.getLHS(node)), ast.toTree(ast.getRHS(node)));
+}
+
+}
+
+AstExprPtr FlatAst::toTree(FlatNodeId node) const {
+    SourceLocation loc = getLocation(node);
+    switch (getKind(node)) {
+        case FlatNodeKind::ConstLong: return std::make_unique<AstExprConstLong>(loc, getLong(node));
+        case FlatNodeKind::ConstBool: return std::make_unique<AstExprConstBool>(loc, getBool(node));
+        case FlatNodeKind::ConstArray: {
+            std::vector<AstExprPtr> elements;
+            for (size_t i = 0; i < getChildCount(node); ++i) {
+                elements.push_back(toTree(getChild(node, i)));
+            }
+            // The parser gives every array literal elements of any type.
+            return std::make_unique<AstExprConstArray>(loc, std::make_unique<Any>(), std::move(elements));
+        }
+        case FlatNodeKind::Variable: return std::make_unique<AstExprVariable>(loc, getName(node));
+        case FlatNodeKind::Index: return std::make_unique<AstExprIndex>(loc, toTree(getLHS(node)), toTree(getRHS(node)));
+        case FlatNodeKind::Call: {
+            std::vector<AstExprPtr> args;
+            for (size_t i = 0; i < getChildCount(node); ++i) {
+                args.push_back(toTree(getChild(node, i)));
+            }
+            return std::make_unique<AstExprCall>(loc, getName(node), std::move(args));
+        }
+        case FlatNodeKind::LetIn:
+            return std::make_unique<AstExprLetIn>(loc, getName(node), toTree(getLetValue(node)), toTree(getLetBody(node)));
+        case FlatNodeKind::Match: {
+            std::vector<AstExprMatchPathPtr> paths;
+            for (size_t i = 0; i < getChildCount(node); ++i) {
+                FlatNodeId path = getChild(node, i);
+                paths.push_back(std::make_unique<AstExprMatchPath>(getLocation(path), toTree(getLHS(path)), toTree(getRHS(path))));
+            }
+            return std::make_unique<AstExprMatch>(loc, std::move(paths));
+        }
+        case FlatNodeKind::MatchPath: break;
+        case FlatNodeKind::Add: return makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(*this, node);
+        case FlatNodeKind::Sub: return makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>>(*this, node);
+        case FlatNodeKind::Mul: return makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>>(*this, node);
+        case FlatNodeKind::Div: return makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>>(*this, node);
+        case FlatNodeKind::Eq: return makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>>(*this, node);
+        case FlatNodeKind::Neq: return makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>>(*this, node);
+        case FlatNodeKind::Leq: return makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>>(*this, node);
+        case FlatNodeKind::Lt: return makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>>(*this, node);
+        case FlatNodeKind::Geq: return makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>>(*this, node);
+        case FlatNodeKind::Gt: return makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>>(*this, node);
+        case FlatNodeKind::And: return makeBinary<AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>>(*this, node);
+        case FlatNodeKind::Or: return makeBinary<AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>>(*this, node);
+    }
+    throw std::logic_error("A match path is not an expression");
+}
+
+std::unique_ptr<AstFunction> FlatAst::toTree(const FlatFunction& func) const {
+    auto tree = std::make_unique<AstFunction>(
+        func.Location, std::make_unique<AstPrototype>(func.PrototypeLocation, func.Name, func.Args), toTree(func.Body));
+    tree->setInternal(func.Internal);
+    return tree;
+}
@@ -0,0 +1,111 @@
+#ifndef FLAT_AST_HPP
+#define FLAT_AST_HPP
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+
+// Index of a node in a FlatAst.
+using FlatNodeId = uint32_t;
+
+enum class FlatNodeKind : uint8_t {
+    ConstLong, ConstBool, ConstArray, Variable, Index, Call, LetIn, Match, MatchPath,
+    Add, Sub, Mul, Div,
+    Eq, Neq, Leq, Lt, Geq, Gt,
+    And, Or
+};
+
+// A function whose body is stored in a FlatAst.
+struct FlatFunction {
+    SourceLocation Location;
+    SourceLocation PrototypeLocation;
+    Symbol Name;
+    std::vector<AstArg> Args;
+    FlatNodeId Body;
+    // See AstFunction::isInternal.
+    bool Internal;
+};
+
+// A compact form of AstExpr trees for large programs. Nodes are stored in
+// parallel arrays without vtables or per-node allocations and refer to their
+// children by index; source locations live in a side table. Children are
+// always added before their parents.
+//
+// Nothing in the arrays depends on the process: names are indices into
+// Names and locations are relative to BaseOffset, so the arrays can be
+// written to disk and read back as they are (see AstCache).
+class FlatAst {
+    std::vector<FlatNodeKind> Kinds;
+    // What the two operands hold depends on the kind:
+    //   ConstLong                 index into Longs
+    //   ConstBool                 the value
+    //   Variable                  index of the name in Names
+    //   binary operators, Index,  the two children: LHS and RHS, indexee and
+    //   MatchPath                 indexer, guard and body
+    //   Call, LetIn, Match,       offset into Lists and number of children,
+    //   ConstArray                see getChild(); calls and lets first store
+    //                             the name index of their callee or variable
+    std::vector<uint32_t> First;
+    std::vector<uint32_t> Second;
+    // A SourceLocation relative to BaseOffset.
+    struct Span {
+        uint32_t StartPos;
+        uint32_t EndPos;
+    };
+    std::vector<Span> Locations;
+    std::vector<uint32_t> Lists;
+    std::vector<long> Longs;
+    std::vector<Symbol> Names;
+    std::unordered_map<Symbol, uint32_t> NameIndices;
+    size_t BaseOffset;
+
+    friend class FlatAstBuilder;
+    friend class AstCache;
+    FlatNodeId addNode(FlatNodeKind kind, uint32_t first, uint32_t second, const SourceLocation& loc);
+    FlatNodeId addListNode(FlatNodeKind kind, std::vector<uint32_t> items, uint32_t count, const SourceLocation& loc);
+    uint32_t addName(Symbol name);
+public:
+    // Locations added later must not lie before baseOffset.
+    explicit FlatAst(size_t baseOffset = 0) : BaseOffset(baseOffset) {}
+
+    FlatNodeId add(const AstExpr& expr);
+    FlatFunction add(const AstFunction& func);
+    // Whether every node refers only to earlier nodes and to names, longs
+    // and list entries that exist, as the accessors below assume. Arrays
+    // read back from disk have to be checked before use.
+    bool isWellFormed() const;
+    // Whether node exists and is an expression rather than a match path.
+    bool isExpression(FlatNodeId node) const { return node < Kinds.size() && Kinds[node] != FlatNodeKind::MatchPath; }
+    // Rebuilds the tree form, for code that only works on AstExpr.
+    AstExprPtr toTree(FlatNodeId node) const;
+    std::unique_ptr<AstFunction> toTree(const FlatFunction& func) const;
+
+    size_t size() const { return Kinds.size(); }
+    FlatNodeKind getKind(FlatNodeId node) const { return Kinds[node]; }
+    SourceLocation getLocation(FlatNodeId node) const {
+        return SourceLocation(BaseOffset + Locations[node].StartPos, BaseOffset + Locations[node].EndPos);
+    }
+
+    long getLong(FlatNodeId node) const { return Longs[First[node]]; }
+    bool getBool(FlatNodeId node) const { return First[node] != 0; }
+    // The name of a Variable, the callee of a Call or the variable of a LetIn.
+    Symbol getName(FlatNodeId node) const {
+        return Names[Kinds[node] == FlatNodeKind::Variable ? First[node] : Lists[First[node]]];
+    }
+    // Operands of binary operators, Index and MatchPath.
+    FlatNodeId getLHS(FlatNodeId node) const { return First[node]; }
+    FlatNodeId getRHS(FlatNodeId node) const { return Second[node]; }
+    FlatNodeId getLetValue(FlatNodeId node) const { return Lists[First[node] + 1]; }
+    FlatNodeId getLetBody(FlatNodeId node) const { return Lists[First[node] + 2]; }
+    // Arguments of a Call, paths of a Match or elements of a ConstArray.
+    size_t getChildCount(FlatNodeId node) const { return Second[node]; }
+    FlatNodeId getChild(FlatNodeId node, size_t index) const {
+        size_t skip = Kinds[node] == FlatNodeKind::Call ? 1 : 0;
+        return Lists[First[node] + skip + index];
+    }
+};
+
+#endif
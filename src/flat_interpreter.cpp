@@ -0,0 +1,245 @@
+#include <climits>
+
+#include "flat_interpreter.hpp"
+#include "interpreter_exception.hpp"
+
+// Drops the bindings made while it is alive and restores the caller's frame.
+class FlatInterpreter::FrameGuard {
+    FlatInterpreter& Interpreter;
+    size_t SavedFrameStart;
+    size_t SavedSize;
+public:
+    explicit FrameGuard(FlatInterpreter& interpreter)
+        : Interpreter(interpreter), SavedFrameStart(interpreter.FrameStart), SavedSize(interpreter.Bindings.size()) {}
+    ~FrameGuard() {
+        Interpreter.Bindings.erase(Interpreter.Bindings.begin() + SavedSize, Interpreter.Bindings.end());
+        Interpreter.FrameStart = SavedFrameStart;
+    }
+    size_t getSavedSize() const { return SavedSize; }
+};
+
+FlatInterpreter::FlatInterpreter(const FlatAst& ast, const std::vector<FlatFunction>& functions) : Ast(ast) {
+    for (const FlatFunction& func : functions) {
+        Functions[func.Name] = &func;
+    }
+}
+
+void FlatInterpreter::setValue(Symbol name, std::unique_ptr<InterpreterValue> value) {
+    Bindings.emplace_back(name, std::move(value));
+}
+
+std::unique_ptr<InterpreterValue> FlatInterpreter::eval(FlatNodeId node) {
+    switch (Ast.getKind(node)) {
+        case FlatNodeKind::ConstLong:
+            return std::make_unique<InterpreterValueLong>(Ast.getLong(node));
+        case FlatNodeKind::ConstBool:
+            return std::make_unique<InterpreterValueBool>(Ast.getBool(node));
+        case FlatNodeKind::ConstArray: {
+            std::vector<std::unique_ptr<InterpreterValue>> elements;
+            for (size_t i = 0; i < Ast.getChildCount(node); ++i) {
+                elements.push_back(eval(Ast.getChild(node, i)));
+            }
+            return std::make_unique<InterpreterValueArray>(elements);
+        }
+        case FlatNodeKind::Variable: {
+            Symbol name = Ast.getName(node);
+            for (size_t i = Bindings.size(); i > FrameStart; --i) {
+                if (Bindings[i - 1].first == name) {
+                    return Bindings[i - 1].second->clone();
+                }
+            }
+            throw UndefinedVariableException(name.str(), Ast.getLocation(node));
+        }
+        case FlatNodeKind::Index:
+            return evalIndex(node);
+        case FlatNodeKind::Call:
+            return evalCall(node);
+        case FlatNodeKind::LetIn: {
+            auto value = eval(Ast.getLetValue(node));
+            FrameGuard guard(*this);
+            Bindings.emplace_back(Ast.getName(node), std::move(value));
+            return eval(Ast.getLetBody(node));
+        }
+        case FlatNodeKind::Match:
+            return eval(selectPath(node));
+        case FlatNodeKind::MatchPath:
+            break;
+
+        case FlatNodeKind::Add: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer binary operation");
+            long result;
+            __builtin_add_overflow(lhs, rhs, &result);
+            return std::make_unique<InterpreterValueLong>(result);
+        }
+        case FlatNodeKind::Sub: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer binary operation");
+            long result;
+            __builtin_sub_overflow(lhs, rhs, &result);
+            return std::make_unique<InterpreterValueLong>(result);
+        }
+        case FlatNodeKind::Mul: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer binary operation");
+            long result;
+            __builtin_mul_overflow(lhs, rhs, &result);
+            return std::make_unique<InterpreterValueLong>(result);
+        }
+        case FlatNodeKind::Div: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer binary operation");
+            if (rhs == 0) {
+                throw DivisionByZeroException(Ast.getLocation(Ast.getRHS(node)));
+            }
+            if (rhs == -1 && lhs == LONG_MIN) {
+                throw DivisionOverflowException(Ast.getLocation(Ast.getRHS(node)));
+            }
+            return std::make_unique<InterpreterValueLong>(lhs / rhs);
+        }
+
+        case FlatNodeKind::Eq: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer comparison");
+            return std::make_unique<InterpreterValueBool>(lhs == rhs);
+        }
+        case FlatNodeKind::Neq: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer comparison");
+            return std::make_unique<InterpreterValueBool>(lhs != rhs);
+        }
+        case FlatNodeKind::Leq: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer comparison");
+            return std::make_unique<InterpreterValueBool>(lhs <= rhs);
+        }
+        case FlatNodeKind::Lt: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer comparison");
+            return std::make_unique<InterpreterValueBool>(lhs < rhs);
+        }
+        case FlatNodeKind::Geq: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer comparison");
+            return std::make_unique<InterpreterValueBool>(lhs >= rhs);
+        }
+        case FlatNodeKind::Gt: {
+            auto [lhs, rhs] = evalLongOperands(node, "integer comparison");
+            return std::make_unique<InterpreterValueBool>(lhs > rhs);
+        }
+
+        case FlatNodeKind::And: {
+            auto [lhs, rhs] = evalBoolOperands(node);
+            return std::make_unique<InterpreterValueBool>(lhs && rhs);
+        }
+        case FlatNodeKind::Or: {
+            auto [lhs, rhs] = evalBoolOperands(node);
+            return std::make_unique<InterpreterValueBool>(lhs || rhs);
+        }
+    }
+    throw InterpreterException("A match path is not an expression", Ast.getLocation(node));
+}
+
+std::pair<long, long> FlatInterpreter::evalLongOperands(FlatNodeId node, const char* operation) {
+    auto valueLHS = eval(Ast.getLHS(node));
+    auto valueRHS = eval(Ast.getRHS(node));
+
+    auto lhsLong = dynamic_cast<InterpreterValueLong*>(valueLHS.get());
+    auto rhsLong = dynamic_cast<InterpreterValueLong*>(valueRHS.get());
+    if (!lhsLong) {
+        throw TypeMismatchException(std::string("LHS of ") + operation + " is not an integer", Ast.getLocation(Ast.getLHS(node)));
+    }
+    if (!rhsLong) {
+        throw TypeMismatchException(std::string("RHS of ") + operation + " is not an integer", Ast.getLocation(Ast.getRHS(node)));
+    }
+    return {lhsLong->getValue(), rhsLong->getValue()};
+}
+
+std::pair<bool, bool> FlatInterpreter::evalBoolOperands(FlatNodeId node) {
+    auto valueLHS = eval(Ast.getLHS(node));
+    auto valueRHS = eval(Ast.getRHS(node));
+
+    auto lhsBool = dynamic_cast<InterpreterValueBool*>(valueLHS.get());
+    auto rhsBool = dynamic_cast<InterpreterValueBool*>(valueRHS.get());
+    if (!lhsBool) {
+        throw TypeMismatchException("LHS of boolean binary operation is not a boolean", Ast.getLocation(Ast.getLHS(node)));
+    }
+    if (!rhsBool) {
+        throw TypeMismatchException("RHS of boolean binary operation is not a boolean", Ast.getLocation(Ast.getRHS(node)));
+    }
+    return {lhsBool->getValue(), rhsBool->getValue()};
+}
+
+std::unique_ptr<InterpreterValue> FlatInterpreter::evalIndex(FlatNodeId node) {
+    FlatNodeId indexer = Ast.getRHS(node);
+    auto indexerValue = eval(indexer);
+    auto indexerLong = dynamic_cast<InterpreterValueLong*>(indexerValue.get());
+    if (!indexerLong) {
+        throw TypeMismatchException("Array index must evaluate to an integer", Ast.getLocation(indexer));
+    }
+    long index = indexerLong->getValue();
+
+    auto indexeeValue = eval(Ast.getLHS(node));
+    auto indexeeArray = dynamic_cast<InterpreterValueArray*>(indexeeValue.get());
+    if (!indexeeArray) {
+        throw TypeMismatchException("Index operation applied to a non-array type", Ast.getLocation(Ast.getLHS(node)));
+    }
+    const auto& elements = indexeeArray->getValue();
+    if (index < 0 || static_cast<size_t>(index) >= elements.size()) {
+        throw IndexOutOfBoundsException(Ast.getLocation(indexer));
+    }
+    return elements[index]->clone();
+}
+
+const FlatFunction& FlatInterpreter::enterCall(FlatNodeId call, size_t frameStart) {
+    Symbol callee = Ast.getName(call);
+    auto it = Functions.find(callee);
+    if (it == Functions.end()) {
+        throw UndefinedFunctionException(callee.str(), Ast.getLocation(call));
+    }
+    std::vector<std::unique_ptr<InterpreterValue>> args;
+    for (size_t i = 0; i < Ast.getChildCount(call); ++i) {
+        args.push_back(eval(Ast.getChild(call, i)));
+    }
+    const FlatFunction& func = *it->second;
+    if (func.Args.size() != args.size()) {
+        throw ArityMismatchException(callee.str(), func.Args.size(), args.size(), Ast.getLocation(call));
+    }
+
+    Bindings.erase(Bindings.begin() + frameStart, Bindings.end());
+    FrameStart = frameStart;
+    for (size_t i = 0; i < args.size(); ++i) {
+        Bindings.emplace_back(func.Args[i].Name, std::move(args[i]));
+    }
+    return func;
+}
+
+std::unique_ptr<InterpreterValue> FlatInterpreter::evalCall(FlatNodeId node) {
+    FrameGuard guard(*this);
+    FlatNodeId body = enterCall(node, guard.getSavedSize()).Body;
+    // Matches, lets and calls in tail position continue in the same frame.
+    while (true) {
+        switch (Ast.getKind(body)) {
+            case FlatNodeKind::Match:
+                body = selectPath(body);
+                break;
+            case FlatNodeKind::LetIn: {
+                auto value = eval(Ast.getLetValue(body));
+                Bindings.emplace_back(Ast.getName(body), std::move(value));
+                body = Ast.getLetBody(body);
+                break;
+            }
+            case FlatNodeKind::Call:
+                body = enterCall(body, guard.getSavedSize()).Body;
+                break;
+            default:
+                return eval(body);
+        }
+    }
+}
+
+FlatNodeId FlatInterpreter::selectPath(FlatNodeId match) {
+    for (size_t i = 0; i < Ast.getChildCount(match); ++i) {
+        FlatNodeId path = Ast.getChild(match, i);
+        auto guard = eval(Ast.getLHS(path));
+        auto guardBool = dynamic_cast<InterpreterValueBool*>(guard.get());
+        if (!guardBool) {
+            throw TypeMismatchException("Match guard must evaluate to a boolean", Ast.getLocation(path));
+        }
+        if (guardBool->getValue()) {
+            return Ast.getRHS(path);
+        }
+    }
+    throw NoMatchFoundException(Ast.getLocation(match));
+}
@@ -0,0 +1,43 @@
+#ifndef FLAT_INTERPRETER_HPP
+#define FLAT_INTERPRETER_HPP
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "flat_ast.hpp"
+#include "interpreter.hpp"
+
+// Runs programs in FlatAst form. Nodes are dispatched with a switch on their
+// kind, and variables live on one binding stack instead of in cloned
+// Contexts. Results and errors are the same as Interpreter's; tail calls
+// also run in constant stack space.
+class FlatInterpreter {
+    const FlatAst& Ast;
+    std::unordered_map<Symbol, const FlatFunction*> Functions;
+    // Innermost binding last. Only the bindings from FrameStart on are
+    // visible, so a callee cannot see its caller's variables.
+    std::vector<std::pair<Symbol, std::unique_ptr<InterpreterValue>>> Bindings;
+    size_t FrameStart = 0;
+
+    class FrameGuard;
+
+    // Both operands are evaluated before either is checked, as in Interpreter.
+    std::pair<long, long> evalLongOperands(FlatNodeId node, const char* operation);
+    std::pair<bool, bool> evalBoolOperands(FlatNodeId node);
+    std::unique_ptr<InterpreterValue> evalIndex(FlatNodeId node);
+    std::unique_ptr<InterpreterValue> evalCall(FlatNodeId node);
+    // Evaluates the arguments of a call, then replaces every binding from
+    // frameStart on with them. Returns the callee.
+    const FlatFunction& enterCall(FlatNodeId call, size_t frameStart);
+    FlatNodeId selectPath(FlatNodeId match);
+public:
+    FlatInterpreter(const FlatAst& ast, const std::vector<FlatFunction>& functions);
+    // Binds a variable for the expressions passed to eval, like the inputs of
+    // the main expression. Functions do not see it.
+    void setValue(Symbol name, std::unique_ptr<InterpreterValue> value);
+    std::unique_ptr<InterpreterValue> eval(FlatNodeId node);
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "llvm/IR/InlineAsm.h"
+
+#include "freestanding_runtime.hpp"
+#include "codegen.hpp"
+
+namespace {
+
+struct SyscallABI {
+    const char *Instruction;
+    const char *Constraints;
+    uint64_t Write;
+    uint64_t ExitGroup;
+};
+
+// The system call number comes first, followed by up to three arguments.
+const SyscallABI X86_64ABI {"syscall", "={rax},{rax},{rdi},{rsi},{rdx},~{rcx},~{r11},~{memory}", 1, 231};
+const SyscallABI AArch64ABI {"svc #0", "={x0},{x8},{x0},{x1},{x2},~{memory}", 64, 94};
+
+const SyscallABI& getSyscallABI(const llvm::Module& module) {
+    llvm::Triple triple(module.getTargetTriple());
+    return triple.getArch() == llvm::Triple::aarch64 ? AArch64ABI : X86_64ABI;
+}
+
+llvm::Value *emitSyscall(llvm::IRBuilder<>& builder, const SyscallABI& abi, uint64_t number,
+                         llvm::Value *arg0, llvm::Value *arg1, llvm::Value *arg2) {
+    llvm::Type *Int64Ty = builder.getInt64Ty();
+    llvm::FunctionType *FT = llvm::FunctionType::get(Int64Ty, {Int64Ty, Int64Ty, Int64Ty, Int64Ty}, false);
+    llvm::InlineAsm *syscall = llvm::InlineAsm::get(FT, abi.Instruction, abi.Constraints, true);
+    return builder.CreateCall(FT, syscall, {builder.getInt64(number), arg0, arg1, arg2});
+}
+
+llvm::Function *getPrintLong(const CodeGenerator& codeGen) {
+    if (llvm::Function *existing = codeGen.TheModule->getFunction("__lang_print_i64")) {
+        return existing;
+    }
+
+    llvm::LLVMContext &ctx = *codeGen.TheContext;
+    llvm::Type *Int8Ty = llvm::Type::getInt8Ty(ctx);
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(ctx);
+    llvm::Function *F = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), {Int64Ty}, false),
+        llvm::Function::InternalLinkage, "__lang_print_i64", codeGen.TheModule.get());
+
+    llvm::IRBuilderBase::InsertPointGuard guard(*codeGen.Builder);
+    llvm::IRBuilder<> &B = *codeGen.Builder;
+    B.SetCurrentDebugLocation(llvm::DebugLoc());
+
+    llvm::BasicBlock *EntryBB = llvm::BasicBlock::Create(ctx, "entry", F);
+    llvm::BasicBlock *DigitBB = llvm::BasicBlock::Create(ctx, "digit", F);
+    llvm::BasicBlock *WriteBB = llvm::BasicBlock::Create(ctx, "write", F);
+
+    // "-9223372036854775808\n" is the longest output.
+    const uint64_t BufferSize = 21;
+
+    B.SetInsertPoint(EntryBB);
+    llvm::Value *value = F->getArg(0);
+    llvm::Value *buffer = B.CreateAlloca(Int8Ty, B.getInt64(BufferSize), "buffer");
+    B.CreateStore(B.getInt8('\n'), B.CreateGEP(Int8Ty, buffer, B.getInt64(BufferSize - 1)));
+    llvm::Value *isNegative = B.CreateICmpSLT(value, B.getInt64(0), "negative");
+    // Negating as unsigned also works for the smallest value.
+    llvm::Value *magnitude = B.CreateSelect(isNegative, B.CreateSub(B.getInt64(0), value), value, "magnitude");
+    B.CreateBr(DigitBB);
+
+    // Digits are written backwards from the end of the buffer.
+    B.SetInsertPoint(DigitBB);
+    llvm::PHINode *pos = B.CreatePHI(Int64Ty, 2, "pos");
+    llvm::PHINode *rest = B.CreatePHI(Int64Ty, 2, "rest");
+    llvm::Value *nextPos = B.CreateSub(pos, B.getInt64(1), "next_pos");
+    llvm::Value *digit = B.CreateURem(rest, B.getInt64(10), "digit");
+    llvm::Value *quotient = B.CreateUDiv(rest, B.getInt64(10), "quotient");
+    B.CreateStore(B.CreateAdd(B.CreateTrunc(digit, Int8Ty), B.getInt8('0')), B.CreateGEP(Int8Ty, buffer, nextPos));
+    pos->addIncoming(B.getInt64(BufferSize - 1), EntryBB);
+    pos->addIncoming(nextPos, DigitBB);
+    rest->addIncoming(magnitude, EntryBB);
+    rest->addIncoming(quotient, DigitBB);
+    B.CreateCondBr(B.CreateICmpNE(quotient, B.getInt64(0)), DigitBB, WriteBB);
+
+    // At most 19 digits were written, so there is always room for the sign.
+    B.SetInsertPoint(WriteBB);
+    llvm::Value *signPos = B.CreateSub(nextPos, B.getInt64(1), "sign_pos");
+    B.CreateStore(B.getInt8('-'), B.CreateGEP(Int8Ty, buffer, signPos));
+    llvm::Value *start = B.CreateSelect(isNegative, signPos, nextPos, "start");
+    const SyscallABI& abi = getSyscallABI(*codeGen.TheModule);
+    emitSyscall(B, abi, abi.Write, B.getInt64(1),
+                B.CreatePtrToInt(B.CreateGEP(Int8Ty, buffer, start), Int64Ty),
+                B.CreateSub(B.getInt64(BufferSize), start));
+    B.CreateRetVoid();
+
+    return F;
+}
+
+}
+
+bool isFreestandingSupported(const llvm::Triple& triple) {
+    return triple.isOSLinux() && (triple.getArch() == llvm::Triple::x86_64 || triple.getArch() == llvm::Triple::aarch64);
+}
+
+void emitFreestandingPrint(const CodeGenerator& codeGen, llvm::Value *value) {
+    codeGen.Builder->CreateCall(getPrintLong(codeGen), {value});
+}
+
+void emitFreestandingExits(const CodeGenerator& codeGen, llvm::Function& entry) {
+    std::vector<llvm::ReturnInst *> returns;
+    for (llvm::BasicBlock& BB : entry) {
+        if (auto *ret = llvm::dyn_cast<llvm::ReturnInst>(BB.getTerminator())) {
+            returns.push_back(ret);
+        }
+    }
+
+    llvm::IRBuilderBase::InsertPointGuard guard(*codeGen.Builder);
+    llvm::IRBuilder<> &B = *codeGen.Builder;
+    const SyscallABI& abi = getSyscallABI(*codeGen.TheModule);
+    for (llvm::ReturnInst *ret : returns) {
+        B.SetInsertPoint(ret);
+        B.SetCurrentDebugLocation(ret->getDebugLoc());
+        emitSyscall(B, abi, abi.ExitGroup, B.getInt64(0), B.getInt64(0), B.getInt64(0));
+        B.CreateUnreachable();
+        ret->eraseFromParent();
+    }
+
+    entry.addFnAttr(llvm::Attribute::NoReturn);
+    entry.addFnAttr(llvm::Attribute::NoUnwind);
+    // The kernel enters with a 16 byte aligned stack instead of the
+    // misalignment a call leaves behind.
+    entry.addFnAttr("stackrealign");
+}
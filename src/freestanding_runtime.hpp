@@ -0,0 +1,23 @@
+#ifndef FREESTANDING_RUNTIME_HPP
+#define FREESTANDING_RUNTIME_HPP
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Value.h"
+#include "llvm/TargetParser/Triple.h"
+
+class CodeGenerator;
+
+// Runtime for programs linked without libc (-nostdlib -static): output is
+// formatted in generated code and goes straight to Linux system calls,
+// which are emitted as inline assembly for the module's target.
+
+bool isFreestandingSupported(const llvm::Triple& triple);
+
+// Prints a value as a decimal number followed by a newline to stdout.
+void emitFreestandingPrint(const CodeGenerator& codeGen, llvm::Value *value);
+
+// Turns every return from the program's entry point into an exit_group
+// system call, since there is no libc startup code to return to.
+void emitFreestandingExits(const CodeGenerator& codeGen, llvm::Function& entry);
+
+#endif
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <climits>
+#include <optional>
+#include <type_traits>
+
+#include "guard_elimination.hpp"
+#include "ast_dispatch.hpp"
+
+namespace {
+
+// Outcomes of comparing two integers, as bits of a set.
+const unsigned Less = 1;
+const unsigned Equal = 2;
+const unsigned Greater = 4;
+const unsigned AnyOrder = Less | Equal | Greater;
+// Outcomes of a boolean expression.
+const unsigned False = 1;
+const unsigned True = 2;
+
+// The outcomes for which a comparison holds, or 0 if kind is none.
+unsigned comparisonOutcomes(AstExprKind kind) {
+    switch (kind) {
+        case AstExprKind::Eq: return Equal;
+        case AstExprKind::Neq: return Less | Greater;
+        case AstExprKind::Leq: return Less | Equal;
+        case AstExprKind::Lt: return Less;
+        case AstExprKind::Geq: return Equal | Greater;
+        case AstExprKind::Gt: return Greater;
+        default: return 0;
+    }
+}
+
+// The outcomes of comparing the operands the other way around.
+unsigned swapOperands(unsigned outcomes) {
+    return (outcomes & Equal) | (outcomes & Less ? Greater : 0) | (outcomes & Greater ? Less : 0);
+}
+
+std::pair<const AstExpr*, const AstExpr*> getOperands(const AstExpr& expr) {
+    return dispatchExpr(expr, [](const auto& node) -> std::pair<const AstExpr*, const AstExpr*> {
+        using Node = std::decay_t<decltype(node)>;
+        if constexpr (std::is_same_v<Node, AstExprConstLong> || std::is_same_v<Node, AstExprConstBool> ||
+                      std::is_same_v<Node, AstExprConstArray> || std::is_same_v<Node, AstExprVariable> ||
+                      std::is_same_v<Node, AstExprIndex> || std::is_same_v<Node, AstExprCall> ||
+                      std::is_same_v<Node, AstExprLetIn> || std::is_same_v<Node, AstExprMatch>) {
+            return {nullptr, nullptr};
+        } else {
+            return {node.getLHS(), node.getRHS()};
+        }
+    });
+}
+
+// Whether the variable is free in expr.
+bool refersTo(const AstExpr& expr, Symbol variable) {
+    if (expr.getKind() == AstExprKind::Variable) {
+        return static_cast<const AstExprVariable&>(expr).getName() == variable;
+    }
+    if (expr.getKind() == AstExprKind::LetIn) {
+        const auto& let = static_cast<const AstExprLetIn&>(expr);
+        return refersTo(*let.getExpr(), variable) || (let.getVariable() != variable && refersTo(*let.getBody(), variable));
+    }
+    bool found = false;
+    forEachChild(expr, [&](const AstExpr& child) { found = found || refersTo(child, variable); });
+    return found;
+}
+
+const AstExprConstLong* asLong(const AstExpr& expr) {
+    return expr.getKind() == AstExprKind::ConstLong ? static_cast<const AstExprConstLong*>(&expr) : nullptr;
+}
+
+// Values an integer expression may still have: a range, minus some values
+// inside it.
+struct Range {
+    long Min = LONG_MIN;
+    long Max = LONG_MAX;
+    std::vector<long> Excluded;
+    bool Empty = false;
+
+    // Restricts the range to the values whose comparison with bound has one
+    // of the outcomes.
+    void restrict(long bound, unsigned outcomes) {
+        if (outcomes == (Less | Greater)) {
+            Excluded.push_back(bound);
+        } else {
+            long min = outcomes & Less ? LONG_MIN : outcomes & Equal ? bound : bound == LONG_MAX ? 0 : bound + 1;
+            long max = outcomes & Greater ? LONG_MAX : outcomes & Equal ? bound : bound == LONG_MIN ? 0 : bound - 1;
+            Empty = Empty || outcomes == 0 || (!(outcomes & (Less | Equal)) && bound == LONG_MAX) ||
+                (!(outcomes & (Equal | Greater)) && bound == LONG_MIN);
+            Min = std::max(Min, min);
+            Max = std::min(Max, max);
+        }
+        while (!Empty && Min < Max && std::count(Excluded.begin(), Excluded.end(), Min)) ++Min;
+        while (!Empty && Min < Max && std::count(Excluded.begin(), Excluded.end(), Max)) --Max;
+        Empty = Empty || Min > Max || (Min == Max && std::count(Excluded.begin(), Excluded.end(), Min));
+    }
+
+    // Possible outcomes of comparing a value of the range with bound.
+    unsigned compare(long bound) const {
+        if (Empty) return 0;
+        unsigned outcomes = 0;
+        if (Min < bound) outcomes |= Less;
+        if (Min <= bound && bound <= Max && !std::count(Excluded.begin(), Excluded.end(), bound)) outcomes |= Equal;
+        if (Max > bound) outcomes |= Greater;
+        return outcomes;
+    }
+};
+
+// What is known to hold where an expression is evaluated: the possible
+// outcomes of a comparison of Lhs with Rhs, or of the boolean Lhs if Rhs is
+// null.
+struct Fact {
+    const AstExpr* Lhs;
+    const AstExpr* Rhs;
+    unsigned Outcomes;
+};
+
+class GuardEliminator : public AstRewriter {
+    AnalysisManager& Analyses;
+    std::vector<Fact> Facts;
+
+    void addFacts(const AstExpr& guard, bool value) {
+        unsigned holds = comparisonOutcomes(guard.getKind());
+        auto [lhs, rhs] = getOperands(guard);
+        if (holds) {
+            Facts.push_back({lhs, rhs, value ? holds : AnyOrder & ~holds});
+        } else if ((guard.getKind() == AstExprKind::And && value) || (guard.getKind() == AstExprKind::Or && !value)) {
+            addFacts(*lhs, value);
+            addFacts(*rhs, value);
+        } else if (guard.getKind() != AstExprKind::ConstBool && guard.getKind() != AstExprKind::And &&
+                   guard.getKind() != AstExprKind::Or) {
+            Facts.push_back({&guard, nullptr, value ? True : False});
+        }
+    }
+
+    // Whether evaluating expr gives an integer without failing: a literal,
+    // a value an evaluated guard already compared, or arithmetic on those
+    // that cannot trap.
+    bool isKnownInteger(const AstExpr& expr) {
+        if (expr.getKind() == AstExprKind::ConstLong) return true;
+        for (const Fact& fact : Facts) {
+            if (fact.Rhs && (isSameExpr(*fact.Lhs, expr) || isSameExpr(*fact.Rhs, expr))) return true;
+        }
+        switch (expr.getKind()) {
+            case AstExprKind::Add:
+            case AstExprKind::Sub:
+            case AstExprKind::Mul:
+            case AstExprKind::Div: {
+                auto [lhs, rhs] = getOperands(expr);
+                return Analyses.isPureOperation(expr) && isKnownInteger(*lhs) && isKnownInteger(*rhs);
+            }
+            default:
+                return false;
+        }
+    }
+
+    // Possible outcomes of comparing lhs with rhs.
+    unsigned possibleOutcomes(const AstExpr& lhs, const AstExpr& rhs) {
+        // The comparison itself would fail for an operand that is no
+        // integer, so only those known to be one go unevaluated.
+        if (isSameExpr(lhs, rhs) && isKnownInteger(lhs)) return Equal;
+        const AstExprConstLong* lhsLong = asLong(lhs);
+        const AstExprConstLong* rhsLong = asLong(rhs);
+        if (lhsLong && !rhsLong) {
+            return swapOperands(possibleOutcomes(rhs, lhs));
+        }
+
+        unsigned outcomes = AnyOrder;
+        Range range;
+        for (const Fact& fact : Facts) {
+            if (!fact.Rhs) continue;
+            bool forward = isSameExpr(*fact.Lhs, lhs);
+            bool backward = !forward && isSameExpr(*fact.Rhs, lhs);
+            if (!forward && !backward) continue;
+            const AstExpr& other = forward ? *fact.Rhs : *fact.Lhs;
+            unsigned known = forward ? fact.Outcomes : swapOperands(fact.Outcomes);
+            if (isSameExpr(other, rhs)) {
+                outcomes &= known;
+            } else if (rhsLong && asLong(other)) {
+                range.restrict(asLong(other)->getValue(), known);
+            }
+        }
+        // Without facts about lhs the range is all integers, which still
+        // decides comparisons with the extremes, but only for an integer.
+        if (rhsLong && isKnownInteger(lhs)) {
+            outcomes &= range.compare(rhsLong->getValue());
+        }
+        return outcomes;
+    }
+
+    // The value of a guard where the facts hold, if they decide it. Facts
+    // only come from guards that were evaluated, so a decided guard could
+    // not have failed.
+    std::optional<bool> decide(const AstExpr& guard) {
+        if (guard.getKind() == AstExprKind::ConstBool) {
+            return static_cast<const AstExprConstBool&>(guard).getValue();
+        }
+        auto [lhs, rhs] = getOperands(guard);
+        if (unsigned holds = comparisonOutcomes(guard.getKind())) {
+            unsigned possible = possibleOutcomes(*lhs, *rhs);
+            // No outcome left means the code is unreachable; leave it be.
+            if (possible == 0) return std::nullopt;
+            if ((possible & holds) == possible) return true;
+            if ((possible & holds) == 0) return false;
+            return std::nullopt;
+        }
+        if (guard.getKind() == AstExprKind::And || guard.getKind() == AstExprKind::Or) {
+            // Both operands are always evaluated, so both must be decided.
+            auto lhsValue = decide(*lhs);
+            auto rhsValue = decide(*rhs);
+            if (!lhsValue || !rhsValue) return std::nullopt;
+            return guard.getKind() == AstExprKind::And ? *lhsValue && *rhsValue : *lhsValue || *rhsValue;
+        }
+        for (const Fact& fact : Facts) {
+            if (!fact.Rhs && isSameExpr(*fact.Lhs, guard)) {
+                return fact.Outcomes == True;
+            }
+        }
+        return std::nullopt;
+    }
+public:
+    explicit GuardEliminator(AnalysisManager& analyses) : Analyses(analyses) {}
+
+    using AstRewriter::visit;
+
+    void visit(const AstExprLetIn& expr) override {
+        auto value = rewrite(*expr.getExpr());
+        // Facts about the variable the let shadows no longer hold in its body.
+        auto shadowed = [&expr](const Fact& fact) {
+            return refersTo(*fact.Lhs, expr.getVariable()) || (fact.Rhs && refersTo(*fact.Rhs, expr.getVariable()));
+        };
+        AstExprPtr body;
+        if (std::any_of(Facts.begin(), Facts.end(), shadowed)) {
+            std::vector<Fact> saved = Facts;
+            Facts.erase(std::remove_if(Facts.begin(), Facts.end(), shadowed), Facts.end());
+            body = rewrite(*expr.getBody());
+            Facts = std::move(saved);
+        } else {
+            body = rewrite(*expr.getBody());
+        }
+
+        bool same = value.get() == expr.getExpr() && body.get() == expr.getBody();
+        Result = same ? expr.clone() : std::make_shared<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+    }
+
+    void visit(const AstExprMatch& expr) override {
+        size_t outerFacts = Facts.size();
+        std::vector<AstExprMatchPathPtr> paths;
+        bool changed = false;
+        for (const auto& path : expr.getPaths()) {
+            AstExprPtr guard = rewrite(*path->getGuard());
+            std::optional<bool> value = decide(*guard);
+            if (value && !*value) {
+                changed = true;
+                continue;
+            }
+            if (value && guard->getKind() != AstExprKind::ConstBool) {
+                guard = std::make_shared<AstExprConstBool>(guard->getLocation(), true);
+            }
+
+            size_t armFacts = Facts.size();
+            addFacts(*guard, true);
+            AstExprPtr body = rewrite(*path->getBody());
+            Facts.resize(armFacts);
+
+            bool same = guard.get() == path->getGuard() && body.get() == path->getBody();
+            changed = changed || !same;
+            paths.push_back(same ? path : std::make_shared<AstExprMatchPath>(path->getLocation(), std::move(guard), std::move(body)));
+            // Later arms are never reached.
+            if (value) {
+                changed = changed || paths.size() < expr.getPaths().size();
+                break;
+            }
+            addFacts(*paths.back()->getGuard(), false);
+        }
+        Facts.resize(outerFacts);
+
+        if (paths.empty()) {
+            // Every guard is known to fail, as the match does at runtime.
+            Result = expr.clone();
+        } else if (paths.front()->getGuard()->getKind() == AstExprKind::ConstBool &&
+                   static_cast<const AstExprConstBool*>(paths.front()->getGuard())->getValue()) {
+            Result = paths.front()->getBody()->clone();
+        } else {
+            Result = changed ? std::make_shared<AstExprMatch>(expr.getLocation(), std::move(paths)) : expr.clone();
+        }
+    }
+};
+
+}
+
+bool GuardEliminationPass::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) {
+    GuardEliminator eliminator(analyses);
+    return rewriteModule(eliminator, functions, mainExpr);
+}
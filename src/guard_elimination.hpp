@@ -0,0 +1,20 @@
+#ifndef GUARD_ELIMINATION_HPP
+#define GUARD_ELIMINATION_HPP
+
+#include "pass_manager.hpp"
+
+// Drops match guards whose outcome is known from the guards before them.
+// An arm is only reached when every earlier guard was false and its body
+// only runs when its own guard was true, so in
+//   match { n < 1 -> a  n >= 1 -> b  true -> c }
+// the second guard always holds: it becomes true and the last arm, which can
+// never be reached, is dropped. Comparisons of the same operands are related
+// to each other, comparisons with integer literals by the range they leave.
+// A guard is only decided from operands that were already evaluated, so no
+// error it could raise is lost.
+class GuardEliminationPass : public AstPass {
+public:
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) override;
+};
+
+#endif
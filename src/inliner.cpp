@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "inliner.hpp"
+#include "ast_dispatch.hpp"
+
+namespace {
+
+bool contains(const std::vector<Symbol>& vars, Symbol var) {
+    return std::binary_search(vars.begin(), vars.end(), var, [](Symbol lhs, Symbol rhs) { return lhs.getId() < rhs.getId(); });
+}
+
+void collectLetVariables(const AstExpr& expr, std::unordered_set<Symbol>& vars) {
+    if (expr.getKind() == AstExprKind::LetIn) {
+        vars.insert(static_cast<const AstExprLetIn&>(expr).getVariable());
+    }
+    forEachChild(expr, [&vars](const AstExpr& child) { collectLetVariables(child, vars); });
+}
+
+// Replaces the parameters of an inlined body, unless a let shadows them.
+class ParameterSubstituter : public AstRewriter {
+    std::unordered_map<Symbol, AstExprPtr> Bindings;
+public:
+    explicit ParameterSubstituter(std::unordered_map<Symbol, AstExprPtr> bindings) : Bindings(std::move(bindings)) {}
+
+    using AstRewriter::visit;
+
+    void visit(const AstExprVariable& expr) override {
+        auto it = Bindings.find(expr.getName());
+        Result = it != Bindings.end() ? it->second : expr.clone();
+    }
+
+    void visit(const AstExprLetIn& expr) override {
+        auto shadowed = Bindings.find(expr.getVariable());
+        if (shadowed == Bindings.end()) {
+            AstRewriter::visit(expr);
+            return;
+        }
+        auto value = rewrite(*expr.getExpr());
+        AstExprPtr binding = std::move(shadowed->second);
+        Bindings.erase(shadowed);
+        auto body = rewrite(*expr.getBody());
+        Bindings.emplace(expr.getVariable(), std::move(binding));
+        Result = std::make_shared<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+    }
+};
+
+class CallInliner : public AstRewriter {
+    AnalysisManager& Analyses;
+    // Functions that may be inlined, with their own calls already inlined.
+    const std::unordered_map<Symbol, const AstFunction*>& Candidates;
+    std::unordered_map<Symbol, std::unordered_set<Symbol>> LetVariables;
+    // Variables known to be bound where the rewritten expression is, with
+    // the number of bindings in scope.
+    std::unordered_map<Symbol, size_t> Bound;
+    size_t NextTemporary = 0;
+
+    const std::unordered_set<Symbol>& getLetVariables(Symbol function, const AstExpr& body) {
+        auto [it, inserted] = LetVariables.try_emplace(function);
+        if (inserted) {
+            collectLetVariables(body, it->second);
+        }
+        return it->second;
+    }
+
+    AstExprPtr inlineCall(const AstExprCall& call, const AstFunction& callee);
+public:
+    CallInliner(AnalysisManager& analyses, const std::unordered_map<Symbol, const AstFunction*>& candidates)
+        : Analyses(analyses), Candidates(candidates) {}
+
+    AstExprPtr rewriteBody(const AstExpr& body, const std::vector<AstArg>& params) {
+        Bound.clear();
+        for (const auto& param : params) {
+            ++Bound[param.Name];
+        }
+        return rewrite(body);
+    }
+
+    using AstRewriter::visit;
+
+    void visit(const AstExprLetIn& expr) override {
+        auto value = rewrite(*expr.getExpr());
+        ++Bound[expr.getVariable()];
+        auto body = rewrite(*expr.getBody());
+        --Bound[expr.getVariable()];
+        bool same = value.get() == expr.getExpr() && body.get() == expr.getBody();
+        Result = same ? expr.clone() : std::make_shared<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+    }
+
+    void visit(const AstExprCall& expr) override {
+        AstRewriter::visit(expr);
+        auto candidate = Candidates.find(expr.getCallee());
+        const auto& call = static_cast<const AstExprCall&>(*Result);
+        // A mismatch is reported at runtime, by the call.
+        if (candidate != Candidates.end() && candidate->second->getPrototype()->getArgs().size() == call.getArgs().size()) {
+            Result = inlineCall(call, *candidate->second);
+        }
+    }
+};
+
+AstExprPtr CallInliner::inlineCall(const AstExprCall& call, const AstFunction& callee) {
+    const auto& params = callee.getPrototype()->getArgs();
+    const auto& args = call.getArgs();
+    const auto& letVariables = getLetVariables(callee.getPrototype()->getName(), *callee.getBody());
+
+    // Literals and bound variables are substituted for their parameter,
+    // unless a let of the body would capture the variable. Everything else
+    // is bound by a let, so it is still evaluated once and in order.
+    std::vector<bool> substituted;
+    for (const auto& arg : args) {
+        bool trivial = arg->getKind() == AstExprKind::ConstLong || arg->getKind() == AstExprKind::ConstBool;
+        if (arg->getKind() == AstExprKind::Variable) {
+            Symbol name = static_cast<const AstExprVariable&>(*arg).getName();
+            auto bound = Bound.find(name);
+            trivial = bound != Bound.end() && bound->second > 0 && !letVariables.count(name);
+        }
+        substituted.push_back(trivial);
+    }
+
+    // The lets would capture a variable of the caller with the name of an
+    // earlier parameter, unless the parameters are renamed.
+    bool captured = false;
+    for (size_t i = 0; i < args.size() && !captured; ++i) {
+        for (size_t j = 0; j < params.size() && !captured; ++j) {
+            if (substituted[j]) continue;
+            if (substituted[i]) {
+                captured = args[i]->getKind() == AstExprKind::Variable &&
+                    static_cast<const AstExprVariable&>(*args[i]).getName() == params[j].Name;
+            } else if (j < i) {
+                captured = contains(Analyses.getFreeVariables(*args[i]), params[j].Name);
+            }
+        }
+    }
+
+    std::unordered_map<Symbol, AstExprPtr> bindings;
+    std::vector<Symbol> names;
+    for (size_t i = 0; i < params.size(); ++i) {
+        names.push_back(params[i].Name);
+        if (substituted[i]) {
+            bindings.emplace(params[i].Name, args[i]);
+        } else if (captured) {
+            // Not a valid identifier, so it cannot clash with a variable of
+            // the caller, only with those of calls inlined before.
+            do {
+                names.back() = Symbol(params[i].Name.str() + ".inl." + std::to_string(NextTemporary++));
+            } while (letVariables.count(names.back()));
+            bindings.emplace(params[i].Name, std::make_shared<AstExprVariable>(params[i].Location, names.back()));
+        }
+    }
+
+    AstExprPtr body = callee.getBody()->clone();
+    if (!bindings.empty()) {
+        body = ParameterSubstituter(std::move(bindings)).rewrite(*body);
+    }
+    for (size_t i = params.size(); i-- > 0;) {
+        if (!substituted[i]) {
+            body = std::make_shared<AstExprLetIn>(call.getLocation(), names[i], args[i], std::move(body));
+        }
+    }
+    return body;
+}
+
+}
+
+InlinePass::InlinePass(size_t threshold, size_t maxBodyCost) : Threshold(threshold), MaxBodyCost(maxBodyCost) {}
+
+bool InlinePass::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) {
+    std::unordered_map<Symbol, size_t> positions;
+    for (size_t i = 0; i < functions.size(); ++i) {
+        positions[functions[i]->getPrototype()->getName()] = i;
+    }
+
+    std::unordered_map<Symbol, const AstFunction*> candidates;
+    CallInliner inliner(analyses, candidates);
+    auto inlineInto = [&](const AstExpr& body, const std::vector<AstArg>& params) {
+        return candidates.empty() || analyses.getCost(body) > MaxBodyCost ? body.clone() : inliner.rewriteBody(body, params);
+    };
+
+    bool changed = false;
+    for (const auto& scc : analyses.getSCCs()) {
+        for (Symbol name : scc) {
+            auto& func = functions[positions.at(name)];
+            const AstPrototype* proto = func->getPrototype();
+            AstExprPtr body = inlineInto(*func->getBody(), proto->getArgs());
+            if (body.get() != func->getBody()) {
+                func = func->withBody(std::move(body));
+                changed = true;
+            }
+        }
+        // Only a body that refers to nothing but its parameters can be moved
+        // into another function.
+        Symbol name = scc.front();
+        const AstFunction& func = *functions[positions.at(name)];
+        if (analyses.getRecursionKind(name) != RecursionKind::None || analyses.getCost(*func.getBody()) > Threshold) {
+            continue;
+        }
+        const auto& params = func.getPrototype()->getArgs();
+        const auto& vars = analyses.getFreeVariables(*func.getBody());
+        bool closed = std::all_of(vars.begin(), vars.end(), [&params](Symbol var) {
+            return std::any_of(params.begin(), params.end(), [var](const AstArg& param) { return param.Name == var; });
+        });
+        if (closed) {
+            candidates.emplace(name, &func);
+        }
+    }
+
+    if (mainExpr && *mainExpr) {
+        // The inputs of the main expression are not known here, so none of
+        // its variables is substituted.
+        AstExprPtr main = inlineInto(**mainExpr, {});
+        changed = changed || main != *mainExpr;
+        *mainExpr = std::move(main);
+    }
+    return changed;
+}
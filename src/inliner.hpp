@@ -0,0 +1,27 @@
+#ifndef INLINER_HPP
+#define INLINER_HPP
+
+#include <cstddef>
+
+#include "pass_manager.hpp"
+
+// Replaces calls of small non-recursive functions of a module by their
+// bodies, e.g. sq(a + 1) becomes let x = a + 1 in x * x. Arguments are bound
+// by lets in their original order, so each is still evaluated exactly once.
+// Functions are visited callees first, so the body substituted for a call
+// already has its own calls inlined.
+class InlinePass : public AstPass {
+    // Largest cost of a body, as AnalysisManager::getCost measures it, that
+    // is substituted for a call.
+    size_t Threshold;
+    // Calls in a body costing more than this are left alone, which bounds
+    // the growth of large functions.
+    size_t MaxBodyCost;
+public:
+    static constexpr size_t DefaultMaxBodyCost = 2000;
+
+    explicit InlinePass(size_t threshold, size_t maxBodyCost = DefaultMaxBodyCost);
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) override;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "interpreter.hpp"
 #include "interpreter_exception.hpp"
+#include "ast_dispatch.hpp"
+#include <climits>
 #include <utility>
 #include <string>
 #include <sstream>
@@ -50,51 +52,84 @@ std::string InterpreterValueArray::toString() const {
 
 
 
-InterpreterValue* Context::getValue(const std::string& name) const {
-    auto it = variables.find(name);
-    if (it != variables.end()) {
-        return it->second.get();
+InterpreterValue* Context::getValue(Symbol name) const {
+    for (const Context* scope = this; scope; scope = scope->parent) {
+        auto it = scope->variables.find(name);
+        if (it != scope->variables.end()) {
+            return it->second.get();
+        }
     }
     return nullptr;
 }
 
-void Context::setValue(const std::string& name, std::unique_ptr<InterpreterValue> value) {
+void Context::setValue(Symbol name, std::unique_ptr<InterpreterValue> value) {
     variables[name] = std::move(value);
 }
 
-const AstFunction* Context::getFunction(const std::string& name) const {
-    auto it = functions.find(name);
-    if (it != functions.end()) {
+const AstFunction* Context::getFunction(Symbol name) const {
+    if (!functions) {
+        return nullptr;
+    }
+    auto it = functions->find(name);
+    if (it != functions->end()) {
         return it->second.get();
     }
     return nullptr;
 }
 
-void Context::addFunction(std::unique_ptr<AstFunction> func) {
-    functions[func->getPrototype()->getName()] = std::move(func);
+void Context::addFunction(std::shared_ptr<const AstFunction> func) {
+    if (!functions) {
+        functions = std::make_shared<FunctionTable>();
+    } else if (functions.use_count() > 1) {
+        functions = std::make_shared<FunctionTable>(*functions);
+    }
+    (*functions)[func->getPrototype()->getName()] = std::move(func);
 }
 
 std::unique_ptr<Context> Context::cloneFunctionContext() const {
     auto funcContext = std::make_unique<Context>();
-    for (const auto & [ key, value ] : functions) {
-        funcContext->addFunction(std::unique_ptr<AstFunction>(value->clone()));
-    }
+    funcContext->functions = functions;
     return funcContext;
 }
 
 std::unique_ptr<Context> Context::clone() const {
-    auto newContext = std::make_unique<Context>();
-    for (const auto & [ key, value ] : functions) {
-        newContext->addFunction(std::unique_ptr<AstFunction>(value->clone()));
-    }
-    for (const auto& [name, val] : this->variables) {
-        newContext->setValue(name, val->clone());
+    auto newContext = cloneFunctionContext();
+    for (const Context* scope = this; scope; scope = scope->parent) {
+        for (const auto& [name, val] : scope->variables) {
+            // Inner scopes come first and shadow the outer ones.
+            if (!newContext->getValue(name)) {
+                newContext->setValue(name, val->clone());
+            }
+        }
     }
     return newContext;
 }
 
+std::unique_ptr<Context> Context::openScope() const {
+    auto scope = cloneFunctionContext();
+    scope->parent = this;
+    return scope;
+}
+
 Interpreter::Interpreter(const Context& initialContext) : CurrentContext(&initialContext) {}
 
+void Interpreter::setFuel(uint64_t steps, size_t maxCallDepth) {
+    Fuel = steps;
+    MaxCallDepth = maxCallDepth;
+}
+
+std::optional<uint64_t> Interpreter::getRemainingFuel() const {
+    return Fuel;
+}
+
+void Interpreter::consumeFuel(const AstExpr& expr) const {
+    if (!Fuel) return;
+    if (*Fuel == 0) {
+        throw FuelExhaustedException(expr.getLocation());
+    }
+    --*Fuel;
+}
+
 std::unique_ptr<InterpreterValue> Interpreter::runWithContext(const AstExpr& expr, const Context& newContext) const {
     
     // We only need const_cast once to get a non-const pointer to 'this'.
@@ -104,14 +139,21 @@ std::unique_ptr<InterpreterValue> Interpreter::runWithContext(const AstExpr& exp
     // The old context will be restored when 'guard' goes out of scope.
     ContextGuard guard(nonConstThis, &newContext); 
 
-    auto result = expr.accept(*nonConstThis);
+    consumeFuel(expr);
+    auto result = dispatch(expr);
     
     // The context is restored automatically when 'guard' is destroyed here.
     return result;
 }
 
 std::unique_ptr<InterpreterValue> Interpreter::eval(const AstExpr& expr) const {
-    return expr.accept(*this);
+    consumeFuel(expr);
+    return dispatch(expr);
+}
+
+std::unique_ptr<InterpreterValue> Interpreter::dispatch(const AstExpr& expr) const {
+    // Qualified, so the calls bind statically and can be inlined.
+    return dispatchExpr(expr, [this](const auto& node) { return Interpreter::visit(node); });
 }
 
 std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprConstLong& expr) const {
@@ -136,7 +178,7 @@ std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprConstArray& ex
 std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprVariable& expr) const {
     auto value = CurrentContext->getValue(expr.getName());
     if (!value) {
-        throw UndefinedVariableException(expr.getName(), expr.getLocation());
+        throw UndefinedVariableException(expr.getName().str(), expr.getLocation());
     }
     return value->clone();
 }
@@ -174,37 +216,83 @@ std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprIndex& expr) c
     return arrayElements[index]->clone();
 }
 
-std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprCall& expr) const {
+const AstFunction* Interpreter::bindArguments(const AstExprCall& expr, std::unique_ptr<Context>& funcContext) const {
     const AstFunction* calleeFunc = CurrentContext->getFunction(expr.getCallee());
     if (!calleeFunc) {
-        throw UndefinedFunctionException(expr.getCallee(), expr.getLocation());
+        throw UndefinedFunctionException(expr.getCallee().str(), expr.getLocation());
     }
     std::vector<std::unique_ptr<InterpreterValue>> evaluatedArgs;
     for (const auto& arg : expr.getArgs()) {
         auto evaluated = this->eval(*arg);
         evaluatedArgs.push_back(std::move(evaluated));
     }
-    std::unique_ptr<Context> funcContext = CurrentContext->cloneFunctionContext();
+    funcContext = CurrentContext->cloneFunctionContext();
     const auto& protoArgs = calleeFunc->getPrototype()->getArgs();
     if (protoArgs.size() != evaluatedArgs.size()) {
-        throw ArityMismatchException(calleeFunc->getPrototype()->getName(), protoArgs.size(), evaluatedArgs.size(), expr.getLocation());
+        throw ArityMismatchException(calleeFunc->getPrototype()->getName().str(), protoArgs.size(), evaluatedArgs.size(), expr.getLocation());
     }
     for (size_t i = 0; i < protoArgs.size(); ++i) {
         funcContext->setValue(protoArgs[i].Name, std::move(evaluatedArgs[i]));
     }
-    return runWithContext(*calleeFunc->getBody(), *funcContext);
+    // The callee's own copy, which lives as long as its context.
+    return funcContext->getFunction(expr.getCallee());
+}
+
+std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprCall& expr) const {
+    // The frame owns the function whose body is evaluated.
+    std::unique_ptr<Context> frame;
+    const AstExpr* body = bindArguments(expr, frame)->getBody();
+
+    if (Fuel && CallDepth >= MaxCallDepth) {
+        throw FuelExhaustedException(expr.getLocation());
+    }
+    CallDepth++;
+    ContextGuard guard(const_cast<Interpreter*>(this), CurrentContext);
+    try {
+        // Matches, lets and calls in tail position continue this loop
+        // instead of recursing, so tail calls run in constant stack space.
+        while (true) {
+            CurrentContext = frame.get();
+            consumeFuel(*body);
+            if (body->getKind() == AstExprKind::Match) {
+                body = &selectPath(static_cast<const AstExprMatch&>(*body));
+            } else if (body->getKind() == AstExprKind::LetIn) {
+                const auto& let = static_cast<const AstExprLetIn&>(*body);
+                // Nothing is evaluated in the frame after a body in tail
+                // position, so the binding can replace a shadowed one.
+                frame->setValue(let.getVariable(), this->eval(*let.getExpr()));
+                body = let.getBody();
+            } else if (body->getKind() == AstExprKind::Call) {
+                std::unique_ptr<Context> callFrame;
+                body = bindArguments(static_cast<const AstExprCall&>(*body), callFrame)->getBody();
+                frame = std::move(callFrame);
+            } else {
+                break;
+            }
+        }
+        auto result = dispatch(*body);
+        CallDepth--;
+        return result;
+    } catch (...) {
+        CallDepth--;
+        throw;
+    }
 }
 
 std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprLetIn& expr) const {
     std::unique_ptr<InterpreterValue> evaluatedExpr = this->eval(*expr.getExpr());
     
-    std::unique_ptr<Context> newContext = CurrentContext->clone();
-    newContext->setValue(expr.getVariable(), std::move(evaluatedExpr));
+    std::unique_ptr<Context> scope = CurrentContext->openScope();
+    scope->setValue(expr.getVariable(), std::move(evaluatedExpr));
     
-    return runWithContext(*expr.getBody(), *newContext);
+    return runWithContext(*expr.getBody(), *scope);
 }
 
 std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprMatch& expr) const {
+    return this->eval(selectPath(expr));
+}
+
+const AstExpr& Interpreter::selectPath(const AstExprMatch& expr) const {
     for (const auto& path : expr.getPaths()) {
         auto evaluated = this->eval(*path->getGuard());
         
@@ -213,7 +301,7 @@ std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprMatch& expr) c
             throw TypeMismatchException("Match guard must evaluate to a boolean", path->getLocation());
         }
         if (evaluatedBool->getValue()) {
-            return this->eval(*path->getBody());
+            return *path->getBody();
         }
     }
     throw NoMatchFoundException(expr.getLocation());
@@ -221,7 +309,7 @@ std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprMatch& expr) c
 
 #define IMPLEMENT_BIN_INT_TO_INT_VISIT(OP_KIND) \
     std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprBinaryIntToInt<BinaryOpKindIntToInt::OP_KIND>& expr) const { \
-        return evalBinaryIntToInt(*expr.getLHS(), *expr.getRHS(), BinaryOpKindIntToInt::OP_KIND); \
+        return evalBinaryIntToInt<BinaryOpKindIntToInt::OP_KIND>(*expr.getLHS(), *expr.getRHS()); \
     }
 
 IMPLEMENT_BIN_INT_TO_INT_VISIT(Add)
@@ -233,7 +321,7 @@ IMPLEMENT_BIN_INT_TO_INT_VISIT(Div)
 
 #define IMPLEMENT_BIN_INT_TO_BOOL_VISIT(OP_KIND) \
     std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprBinaryIntToBool<BinaryOpKindIntToBool::OP_KIND>& expr) const { \
-        return evalBinaryIntToBool(*expr.getLHS(), *expr.getRHS(), BinaryOpKindIntToBool::OP_KIND); \
+        return evalBinaryIntToBool<BinaryOpKindIntToBool::OP_KIND>(*expr.getLHS(), *expr.getRHS()); \
     }
 
 IMPLEMENT_BIN_INT_TO_BOOL_VISIT(Eq)
@@ -247,7 +335,7 @@ IMPLEMENT_BIN_INT_TO_BOOL_VISIT(Gt)
 
 #define IMPLEMENT_BIN_BOOL_TO_BOOL_VISIT(OP_KIND) \
     std::unique_ptr<InterpreterValue> Interpreter::visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::OP_KIND>& expr) const { \
-        return evalBinaryBoolToBool(*expr.getLHS(), *expr.getRHS(), BinaryOpKindBoolToBool::OP_KIND); \
+        return evalBinaryBoolToBool<BinaryOpKindBoolToBool::OP_KIND>(*expr.getLHS(), *expr.getRHS()); \
     }
 
 IMPLEMENT_BIN_BOOL_TO_BOOL_VISIT(And)
@@ -257,8 +345,8 @@ IMPLEMENT_BIN_BOOL_TO_BOOL_VISIT(Or)
 
 
 
-std::unique_ptr<InterpreterValue> Interpreter::evalBinaryIntToInt(
-    const AstExpr& lhs, const AstExpr& rhs, BinaryOpKindIntToInt op) const
+template <BinaryOpKindIntToInt Op>
+std::unique_ptr<InterpreterValue> Interpreter::evalBinaryIntToInt(const AstExpr& lhs, const AstExpr& rhs) const
 {
     // eval arguments using CurrentContext
     auto valueLHS = this->eval(lhs);
@@ -278,25 +366,27 @@ std::unique_ptr<InterpreterValue> Interpreter::evalBinaryIntToInt(
     long rhsVal = rhsLong->getValue();
     long result;
 
-    if (op == BinaryOpKindIntToInt::Add) {
-        result = lhsVal + rhsVal;
-    } else if (op == BinaryOpKindIntToInt::Sub) {
-        result = lhsVal - rhsVal;
-    } else if (op == BinaryOpKindIntToInt::Mul) {
-        result = lhsVal * rhsVal;
-    } else if (op == BinaryOpKindIntToInt::Div) {
+    // Wraps around on overflow, like the compiled code.
+    if constexpr (Op == BinaryOpKindIntToInt::Add) {
+        __builtin_add_overflow(lhsVal, rhsVal, &result);
+    } else if constexpr (Op == BinaryOpKindIntToInt::Sub) {
+        __builtin_sub_overflow(lhsVal, rhsVal, &result);
+    } else if constexpr (Op == BinaryOpKindIntToInt::Mul) {
+        __builtin_mul_overflow(lhsVal, rhsVal, &result);
+    } else {
         if (rhsVal == 0) {
             throw DivisionByZeroException(rhs.getLocation());
         }
+        if (rhsVal == -1 && lhsVal == LONG_MIN) {
+            throw DivisionOverflowException(rhs.getLocation());
+        }
         result = lhsVal / rhsVal;
-    } else {
-        throw InterpreterException("Invalid IntToInt operation kind", lhs.getLocation());
     }
     return std::make_unique<InterpreterValueLong>(result);
 }
 
-std::unique_ptr<InterpreterValue> Interpreter::evalBinaryIntToBool(
-    const AstExpr& lhs, const AstExpr& rhs, BinaryOpKindIntToBool op) const
+template <BinaryOpKindIntToBool Op>
+std::unique_ptr<InterpreterValue> Interpreter::evalBinaryIntToBool(const AstExpr& lhs, const AstExpr& rhs) const
 {
     auto valueLHS = this->eval(lhs);
     auto valueRHS = this->eval(rhs);
@@ -315,19 +405,18 @@ std::unique_ptr<InterpreterValue> Interpreter::evalBinaryIntToBool(
     long rhsVal = rhsLong->getValue();
     bool result;
 
-    if (op == BinaryOpKindIntToBool::Eq) result = lhsVal == rhsVal;
-    else if (op == BinaryOpKindIntToBool::Neq) result = lhsVal != rhsVal;
-    else if (op == BinaryOpKindIntToBool::Leq) result = lhsVal <= rhsVal;
-    else if (op == BinaryOpKindIntToBool::Lt) result = lhsVal < rhsVal;
-    else if (op == BinaryOpKindIntToBool::Geq) result = lhsVal >= rhsVal;
-    else if (op == BinaryOpKindIntToBool::Gt) result = lhsVal > rhsVal;
-    else throw InterpreterException("Invalid IntToBool operation kind", lhs.getLocation());
+    if constexpr (Op == BinaryOpKindIntToBool::Eq) result = lhsVal == rhsVal;
+    else if constexpr (Op == BinaryOpKindIntToBool::Neq) result = lhsVal != rhsVal;
+    else if constexpr (Op == BinaryOpKindIntToBool::Leq) result = lhsVal <= rhsVal;
+    else if constexpr (Op == BinaryOpKindIntToBool::Lt) result = lhsVal < rhsVal;
+    else if constexpr (Op == BinaryOpKindIntToBool::Geq) result = lhsVal >= rhsVal;
+    else result = lhsVal > rhsVal;
 
     return std::make_unique<InterpreterValueBool>(result);
 }
 
-std::unique_ptr<InterpreterValue> Interpreter::evalBinaryBoolToBool(
-    const AstExpr& lhs, const AstExpr& rhs, BinaryOpKindBoolToBool op) const
+template <BinaryOpKindBoolToBool Op>
+std::unique_ptr<InterpreterValue> Interpreter::evalBinaryBoolToBool(const AstExpr& lhs, const AstExpr& rhs) const
 {
     auto valueLHS = this->eval(lhs);
     auto valueRHS = this->eval(rhs);
@@ -345,9 +434,8 @@ std::unique_ptr<InterpreterValue> Interpreter::evalBinaryBoolToBool(
     bool lhsVal = lhsBool->getValue();
     bool rhsVal = rhsBool->getValue();
     bool result;
-    if (op == BinaryOpKindBoolToBool::And) result = lhsVal && rhsVal;
-    else if (op == BinaryOpKindBoolToBool::Or) result = lhsVal || rhsVal;
-    else throw InterpreterException("Invalid BoolToBool operation kind", lhs.getLocation());
+    if constexpr (Op == BinaryOpKindBoolToBool::And) result = lhsVal && rhsVal;
+    else result = lhsVal || rhsVal;
 
     return std::make_unique<InterpreterValueBool>(result);
 }
\ No newline at end of file
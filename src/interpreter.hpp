@@ -48,15 +48,25 @@ public:
 
 class Context {
 private:
-    std::unordered_map<std::string, std::unique_ptr<InterpreterValue>> variables;
-    std::unordered_map<std::string, std::unique_ptr<AstFunction>> functions;
+    using FunctionTable = std::unordered_map<Symbol, std::shared_ptr<const AstFunction>>;
+
+    std::unordered_map<Symbol, std::unique_ptr<InterpreterValue>> variables;
+    // Shared with the contexts cloned from this one, and copied by the first
+    // of them to add a function.
+    std::shared_ptr<FunctionTable> functions;
+    // The context a let scope was opened in, which has the variables not
+    // bound here.
+    const Context* parent = nullptr;
 public:
-    InterpreterValue* getValue(const std::string& name) const;
-    void setValue(const std::string& name, std::unique_ptr<InterpreterValue> value);
-    const AstFunction* getFunction(const std::string& name) const;
-    void addFunction(std::unique_ptr<AstFunction> func);
+    InterpreterValue* getValue(Symbol name) const;
+    void setValue(Symbol name, std::unique_ptr<InterpreterValue> value);
+    const AstFunction* getFunction(Symbol name) const;
+    void addFunction(std::shared_ptr<const AstFunction> func);
     std::unique_ptr<Context> cloneFunctionContext() const;
     std::unique_ptr<Context> clone() const;
+    // A scope for the body of a let, which sees the variables of this context
+    // without copying them and must not outlive it.
+    std::unique_ptr<Context> openScope() const;
 
     void debugPrint() const {
         std::cout << "--- Context Debug Print ---" << std::endl;
@@ -70,8 +80,8 @@ public:
         }
         
         // Print Functions
-        std::cout << "Functions (" << functions.size() << "):" << std::endl;
-        for (const auto& pair : functions) {
+        std::cout << "Functions (" << (functions ? functions->size() : 0) << "):" << std::endl;
+        for (const auto& pair : functions ? *functions : FunctionTable {}) {
             // Assume AstFunction has a 'getName()' or similar debug method
             std::cout << "  - Name: '" << pair.first << "', Function: [Function details here]" << std::endl;
         }
@@ -85,6 +95,11 @@ class Interpreter : public AstValueVisitor {
 private:
     // Mark as mutable to allow modification in const methods
     mutable const Context* CurrentContext = nullptr;
+
+    // Remaining evaluation steps and call depth limit, if evaluation is bounded.
+    mutable std::optional<uint64_t> Fuel;
+    size_t MaxCallDepth = 0;
+    mutable size_t CallDepth = 0;
     
     // Allow ContextGuard to access private member CurrentContext
     friend class ContextGuard;
@@ -92,6 +107,11 @@ private:
 public:
     Interpreter(const Context& initialContext);
     std::unique_ptr<InterpreterValue> eval(const AstExpr& expr) const;
+    // Bounds evaluation to the given number of steps and nested calls.
+    // FuelExhaustedException is thrown once either limit is exceeded.
+    void setFuel(uint64_t steps, size_t maxCallDepth);
+    // Steps left, if evaluation is bounded.
+    std::optional<uint64_t> getRemainingFuel() const;
 private:
     std::unique_ptr<InterpreterValue> visit(const AstExprConstLong& expr) const override;
     std::unique_ptr<InterpreterValue> visit(const AstExprConstBool& expr) const override;
@@ -117,13 +137,20 @@ private:
     std::unique_ptr<InterpreterValue> visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>& expr) const override;
     std::unique_ptr<InterpreterValue> visit(const AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>& expr) const override;
 
-    std::unique_ptr<InterpreterValue> evalBinaryIntToInt(
-        const AstExpr& lhs, const AstExpr& rhs, BinaryOpKindIntToInt op) const;
-    std::unique_ptr<InterpreterValue> evalBinaryIntToBool(
-        const AstExpr& lhs, const AstExpr& rhs, BinaryOpKindIntToBool op) const;
-    std::unique_ptr<InterpreterValue> evalBinaryBoolToBool(
-        const AstExpr& lhs, const AstExpr& rhs, BinaryOpKindBoolToBool op) const;
+    // Calls the visit() for the node's kind without virtual dispatch.
+    std::unique_ptr<InterpreterValue> dispatch(const AstExpr& expr) const;
+
+    template <BinaryOpKindIntToInt Op>
+    std::unique_ptr<InterpreterValue> evalBinaryIntToInt(const AstExpr& lhs, const AstExpr& rhs) const;
+    template <BinaryOpKindIntToBool Op>
+    std::unique_ptr<InterpreterValue> evalBinaryIntToBool(const AstExpr& lhs, const AstExpr& rhs) const;
+    template <BinaryOpKindBoolToBool Op>
+    std::unique_ptr<InterpreterValue> evalBinaryBoolToBool(const AstExpr& lhs, const AstExpr& rhs) const;
 
+    void consumeFuel(const AstExpr& expr) const;
+    // Evaluates the arguments of a call into a new context for the callee.
+    const AstFunction* bindArguments(const AstExprCall& expr, std::unique_ptr<Context>& funcContext) const;
+    const AstExpr& selectPath(const AstExprMatch& expr) const;
     std::unique_ptr<InterpreterValue> runWithContext(const AstExpr& expr, const Context& newContext) const;
 };
 
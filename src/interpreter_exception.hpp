@@ -43,6 +43,13 @@ public:
         : InterpreterException("Division by zero", loc) {}
 };
 
+// The quotient of the smallest long and -1 does not fit in a long.
+class DivisionOverflowException : public InterpreterException {
+public:
+    DivisionOverflowException(const SourceLocation& loc)
+        : InterpreterException("Division overflows", loc) {}
+};
+
 class NoMatchFoundException : public InterpreterException {
 public:
     NoMatchFoundException(const SourceLocation& loc)
@@ -55,4 +62,10 @@ public:
         : InterpreterException("Index out of bounds", loc) {}
 };
 
+class FuelExhaustedException : public InterpreterException {
+public:
+    FuelExhaustedException(const SourceLocation& loc)
+        : InterpreterException("Evaluation exceeded its step or call depth limit", loc) {}
+};
+
 #endif
\ No newline at end of file
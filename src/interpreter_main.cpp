@@ -1,10 +1,53 @@
 #include "runner.hpp"
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
+    std::vector<std::filesystem::path> importPaths;
+    std::vector<long> inputs;
+    char* file = nullptr;
+    bool validArgs = true;
+    RunOptions options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-I" && i + 1 < argc) {
+            importPaths.push_back(argv[++i]);
+        } else if (arg == "--flat-ast" && !file) {
+            options.FlatAst = true;
+        } else if (arg == "--lazy-parse" && !file) {
+            options.LazyBodies = true;
+        } else if (arg == "--ast-cache" && i + 1 < argc && !file) {
+            options.AstCacheDir = argv[++i];
+        } else if (arg == "--inline-threshold" && i + 1 < argc && !file) {
+            try {
+                options.InlineThreshold = std::stoull(argv[++i]);
+            } catch (const std::exception&) {
+                validArgs = false;
+                break;
+            }
+        } else if (arg == "--no-redundancy-elim" && !file) {
+            options.EliminateRedundancy = false;
+        } else if (!file && (arg.empty() || arg[0] != '-')) {
+            file = argv[i];
+        } else if (file) {
+            // Values for the program's `input` declaration.
+            try {
+                size_t parsed;
+                inputs.push_back(std::stol(arg, &parsed));
+                validArgs = parsed == arg.size();
+            } catch (const std::exception&) {
+                validArgs = false;
+            }
+            if (!validArgs) break;
+        } else {
+            validArgs = false;
+            break;
+        }
+    }
+
+    if (!file || !validArgs) {
+        std::cerr << "Usage: " << argv[0] << " [-I <import dir>]... [--flat-ast] [--lazy-parse] [--ast-cache <dir>] [--inline-threshold <cost>] [--no-redundancy-elim] <filename> [<input>]..." << std::endl;
         return 1;
     }
 
-    return runFileAndPrint(argv[1]);
-}
\ No newline at end of file
+    return runFileAndPrint(file, importPaths, inputs, options);
+}
@@ -1,3 +1,5 @@
+#include <charconv>
+
 #include "lexer.hpp"
 
 std::string tokenToString(Token token) {
@@ -7,6 +9,8 @@ std::string tokenToString(Token token) {
         case TokenKind::Let: return "let";
         case TokenKind::In: return "in";
         case TokenKind::Match: return "match";
+        case TokenKind::Import: return "import";
+        case TokenKind::Input: return "input";
         case TokenKind::LParen: return "(";
         case TokenKind::RParen: return ")";
         case TokenKind::LBrace: return "{";
@@ -28,7 +32,7 @@ std::string tokenToString(Token token) {
         case TokenKind::Gt: return ">";
         case TokenKind::And: return "&&";
         case TokenKind::Or: return "||";
-        case TokenKind::Identifier: return token.Text;
+        case TokenKind::Identifier: return std::string(token.Text);
         case TokenKind::Number: return std::to_string(token.Value);
         case TokenKind::True: return "true";
         case TokenKind::False: return "false";
@@ -37,46 +41,59 @@ std::string tokenToString(Token token) {
     }
 }
 
-void Lexer::parseIdentifierOrKeyword() {
-    size_t startPos = CurrentPos;
-    std::string text;
-    char c = peek();
-    while (isIdentifierChar(c)) {
-        text += c;
-        consume();
-        c = peek();
+namespace {
+
+TokenKind keywordOrIdentifier(std::string_view text) {
+    switch (text.size()) {
+        case 2:
+            if (text == "fn") return TokenKind::Fn;
+            if (text == "in") return TokenKind::In;
+            break;
+        case 3:
+            if (text == "let") return TokenKind::Let;
+            break;
+        case 4:
+            if (text == "true") return TokenKind::True;
+            break;
+        case 5:
+            if (text[0] == 'm' && text == "match") return TokenKind::Match;
+            if (text[0] == 'i' && text == "input") return TokenKind::Input;
+            if (text[0] == 'f' && text == "false") return TokenKind::False;
+            break;
+        case 6:
+            if (text == "import") return TokenKind::Import;
+            break;
     }
+    return TokenKind::Identifier;
+}
 
-    TokenKind kind;
-    if (text == "fn") kind = TokenKind::Fn;
-    else if (text == "let") kind = TokenKind::Let;
-    else if (text == "in") kind = TokenKind::In;
-    else if (text == "match") kind = TokenKind::Match;
-    else if (text == "true") kind = TokenKind::True;
-    else if (text == "false") kind = TokenKind::False;
-    else kind = TokenKind::Identifier;
+}
+
+void Lexer::parseIdentifierOrKeyword() {
+    size_t startPos = CurrentPos;
+    CurrentPos = skipIdentifierChars(Input.data() + CurrentPos, Input.data() + Input.size()) - Input.data();
+    std::string_view text = textFrom(startPos);
 
-    CurrentToken = Token{kind, text, -1, SourceLocation{startPos, CurrentPos}};
+    TokenKind kind = keywordOrIdentifier(text);
+    Symbol name = kind == TokenKind::Identifier ? Symbol(text) : Symbol();
+    CurrentToken = Token{kind, text, -1, locationFrom(startPos), name};
 }
 
 void Lexer::parseNumber() {
     size_t startPos = CurrentPos;
-    std::string text;
-    char c = peek();
-    while (isdigit(c)) {
-        text += c;
-        consume();
-        c = peek();
+    CurrentPos = skipDigitChars(Input.data() + CurrentPos, Input.data() + Input.size()) - Input.data();
+    std::string_view text = textFrom(startPos);
+    long value = 0;
+    if (std::from_chars(text.data(), text.data() + text.size(), value).ec != std::errc()) {
+        throw LexerException("Number '" + std::string(text) + "' is out of range", locationFrom(startPos));
     }
-    CurrentToken = Token{TokenKind::Number, text, std::stol(text), SourceLocation{startPos, CurrentPos}};
+    CurrentToken = Token{TokenKind::Number, text, value, locationFrom(startPos), {}};
 }
 
 void Lexer::parseOperator() {
     size_t startPos = CurrentPos;
-    std::string text;
     char c1 = consume();
     char c2 = peek();
-    text += c1;
 
     TokenKind kind;
     if (c1 == '(') kind = TokenKind::LParen;
@@ -89,7 +106,7 @@ void Lexer::parseOperator() {
     else if (c1 == '+') kind = TokenKind::Add;
     else if (c1 == '-') {
         if (c2 == '>') {
-            text += consume();
+            consume();
             kind = TokenKind::Arrow;
         } else {
             kind = TokenKind::Sub;
@@ -99,49 +116,49 @@ void Lexer::parseOperator() {
     else if (c1 == '/') kind = TokenKind::Div;
     else if (c1 == '=') {
         if (c2 == '=') {
-            text += consume();
+            consume();
             kind = TokenKind::Eq;
         } else {
             kind = TokenKind::Equal;
         }
     } else if (c1 == '>') {
         if (c2 == '=') {
-            text += consume();
+            consume();
             kind = TokenKind::Geq;
         } else {
             kind = TokenKind::Gt;
         }
     } else if (c1 == '<') {
         if (c2 == '=') {
-            text += consume();
+            consume();
             kind = TokenKind::Leq;
         } else {
             kind = TokenKind::Lt;
         }
     } else if (c1 == '!') {
         if (c2 == '=') {
-            text += consume();
+            consume();
             kind = TokenKind::Neq;
         } else {
-            throw LexerException("Unrecognized token '!'", SourceLocation{startPos, CurrentPos});
+            throw LexerException("Unrecognized token '!'", locationFrom(startPos));
         }
     } else if (c1 == '&') {
         if (c2 == '&') {
-            text += consume();
+            consume();
             kind = TokenKind::And;
         } else {
-            throw LexerException("Unrecognized token '&'", SourceLocation{startPos, CurrentPos});
+            throw LexerException("Unrecognized token '&'", locationFrom(startPos));
         }
     } else if (c1 == '|') {
         if (c2 == '|') {
-            text += consume();
+            consume();
             kind = TokenKind::Or;
         } else {
-            throw LexerException("Unrecognized token '|'", SourceLocation{startPos, CurrentPos});
+            throw LexerException("Unrecognized token '|'", locationFrom(startPos));
         }
     } else {
-        throw LexerException("Unrecognized token '" + std::string(1, c1) + "'", SourceLocation{startPos, CurrentPos});
+        throw LexerException("Unrecognized token '" + std::string(1, c1) + "'", locationFrom(startPos));
     }
 
-    CurrentToken = Token{kind, text, -1, SourceLocation{startPos, CurrentPos}};
+    CurrentToken = Token{kind, textFrom(startPos), -1, locationFrom(startPos), {}};
 }
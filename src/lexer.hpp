@@ -1,17 +1,21 @@
 #ifndef LEXER_HPP
 #define LEXER_HPP
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <optional>
 #include <iostream>
 
+#include "char_scan.hpp"
 #include "source_location.hpp"
 #include "lexer_exception.hpp"
+#include "symbol.hpp"
 
-enum class TokenKind {
+enum class TokenKind : uint8_t {
     Eof,
-    Fn, Let, In, Match,
+    Fn, Let, In, Match, Import, Input,
     LParen, RParen, LBrace, RBrace, LBracket, RBracket,
     Equal, Comma, Arrow,
     Add, Sub, Mul, Div,
@@ -23,17 +27,23 @@ enum class TokenKind {
     Unknown
 };
 
+// Text views the lexer's input, so a token must not outlive the source.
 struct Token {
     TokenKind Kind;
-    std::string Text;
+    std::string_view Text;
     long Value;
     SourceLocation Location;
+    // The interned identifier, for Identifier tokens.
+    Symbol Name;
 };
 
 std::string tokenToString(Token kind);
 
 class Lexer {
-    const std::string& Input;
+    std::string_view Input;
+    // Offset of Input within the global location space shared by all loaded
+    // files, see ModuleLoader.
+    size_t BaseOffset;
     size_t CurrentPos = 0;
     std::optional<Token> CurrentToken;
 
@@ -46,10 +56,14 @@ class Lexer {
         return Input[CurrentPos++];
     }
     void skipWhitespace() {
-        while (isspace(peek())) consume();
+        CurrentPos = skipWhitespaceChars(Input.data() + CurrentPos, Input.data() + Input.size()) - Input.data();
     }
-    bool isIdentifierChar(char c) {
-        return isalnum(c) || c == '_';
+
+    SourceLocation locationFrom(size_t startPos) const {
+        return SourceLocation{BaseOffset + startPos, BaseOffset + CurrentPos};
+    }
+    std::string_view textFrom(size_t startPos) const {
+        return Input.substr(startPos, CurrentPos - startPos);
     }
 
     void parseIdentifierOrKeyword();
@@ -57,7 +71,7 @@ class Lexer {
     void parseOperator();
 
 public:
-    Lexer(const std::string& input) : Input(input) {
+    Lexer(std::string_view input, size_t baseOffset = 0) : Input(input), BaseOffset(baseOffset) {
         nextToken();
     }
 
@@ -66,21 +80,21 @@ public:
     }
 
     size_t getCurrentPosition() {
-        return CurrentPos;
+        return BaseOffset + CurrentPos;
     }
 
     Token nextToken() {
         skipWhitespace();
         if (CurrentPos >= Input.length()) {
-            CurrentToken = Token{TokenKind::Eof, "", -1, SourceLocation{CurrentPos, CurrentPos}};
+            CurrentToken = Token{TokenKind::Eof, {}, -1, locationFrom(CurrentPos), {}};
             return *CurrentToken;
         }
 
         char c = peek();
 
-        if (isalpha(c) || c == '_') {
+        if (isIdentifierStartChar(c)) {
             parseIdentifierOrKeyword();
-        } else if (isdigit(c)) {
+        } else if (isDigitChar(c)) {
             parseNumber();
         } else {
             parseOperator();
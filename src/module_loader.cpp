@@ -0,0 +1,183 @@
+#include "module_loader.hpp"
+#include "parallel_parser.hpp"
+#include "parser.hpp"
+#include "parser_exception.hpp"
+#include "runner.hpp"
+#include "tail_recursion.hpp"
+
+ModuleLoader::ModuleLoader(std::vector<std::filesystem::path> searchPaths, bool rootHasMainExpr, bool lazyBodies)
+    : SearchPaths(std::move(searchPaths)), RootHasMainExpr(rootHasMainExpr), LazyBodies(lazyBodies) {}
+
+SourceModule* ModuleLoader::findLoaded(const std::filesystem::path& path) const {
+    for (SourceModule* module : Modules) {
+        if (module->Path == path) {
+            return module;
+        }
+    }
+    return nullptr;
+}
+
+std::filesystem::path ModuleLoader::resolveImport(const SourceModule& importer, const AstImport& import) const {
+    std::string fileName = import.Name + ".lang";
+
+    std::vector<std::filesystem::path> candidates;
+    candidates.push_back(importer.Path.parent_path() / fileName);
+    for (const auto& searchPath : SearchPaths) {
+        candidates.push_back(searchPath / fileName);
+    }
+
+    for (const auto& candidate : candidates) {
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(candidate, ec)) {
+            return std::filesystem::weakly_canonical(candidate);
+        }
+    }
+    throw ParserException("Could not find module '" + import.Name + "'", import.Location);
+}
+
+SourceModule& ModuleLoader::loadModule(const std::filesystem::path& path, bool isRoot) {
+    Owned.push_back(std::make_unique<SourceModule>());
+    SourceModule* module = Owned.back().get();
+    module->Name = path.stem().string();
+    module->Path = path;
+    module->Source = SourceBuffer::fromFile(path.string());
+    module->BaseOffset = NextBaseOffset;
+    module->IsRoot = isRoot;
+    // Leave a gap so an end-of-file location never aliases the next file.
+    NextBaseOffset += module->Source.size() + 1;
+
+    if (Cache) {
+        module->CacheKey = AstCache::getKey(module->Source.text(), isRoot && RootHasMainExpr);
+        module->Cached = Cache->lookup(module->CacheKey, module->BaseOffset);
+    }
+    if (module->Cached) {
+        module->Imports = module->Cached->Imports;
+    } else {
+        module->Tokens = TokenBuffer(module->Source.text(), module->BaseOffset);
+        Parser parser(module->Tokens);
+        module->Imports = parser.parseImports();
+    }
+
+    InProgress.insert(path);
+    for (const auto& import : module->Imports) {
+        std::filesystem::path importPath = resolveImport(*module, import);
+        if (InProgress.count(importPath)) {
+            throw ParserException("Import cycle: module '" + import.Name + "' is already being imported", import.Location);
+        }
+
+        SourceModule* dependency = findLoaded(importPath);
+        if (!dependency) {
+            dependency = &loadModule(importPath, false);
+        }
+        bool alreadyListed = false;
+        for (auto* existing : module->Dependencies) {
+            alreadyListed = alreadyListed || existing == dependency;
+        }
+        if (!alreadyListed) {
+            module->Dependencies.push_back(dependency);
+        }
+    }
+    InProgress.erase(path);
+
+    Modules.push_back(module);
+    return *module;
+}
+
+void ModuleLoader::setAstCache(std::filesystem::path directory) {
+    Cache.emplace(std::move(directory));
+}
+
+SourceModule& ModuleLoader::load(const std::string& rootPath) {
+    std::error_code ec;
+    std::filesystem::path path = std::filesystem::weakly_canonical(rootPath, ec);
+    if (ec) {
+        path = rootPath;
+    }
+    return loadModule(path, true);
+}
+
+void ModuleLoader::parse(SourceModule& module) {
+    if (module.Parsed) return;
+
+    if (module.Cached) {
+        const FlatAst& ast = module.Cached->Ast;
+        for (const FlatFunction& func : module.Cached->Functions) {
+            module.Functions.push_back(ast.toTree(func));
+        }
+        module.MainInputs = module.Cached->MainInputs;
+        if (module.Cached->MainExpr) {
+            module.MainExpr = ast.toTree(*module.Cached->MainExpr);
+        }
+        module.Cached.reset();
+        module.Parsed = true;
+        return;
+    }
+
+    Parser header(module.Tokens);
+    header.parseImports();
+    size_t pos = header.getPosition();
+    if (!LazyBodies) {
+        module.Functions = parseFunctionsInParallel(module.Tokens, pos);
+    }
+
+    // Picks up where the parallel parse stopped, reporting its first error.
+    Parser parser(module.Tokens, pos);
+    while (parser.get().Kind == TokenKind::Fn) {
+        auto func = LazyBodies ? parser.parseLazyFunction() : parser.parseFunction();
+        if (!func) {
+            throw ParserException("Parsing failed while defining a function.", SourceLocation{module.BaseOffset, module.BaseOffset});
+        }
+        module.Functions.push_back(std::move(func));
+    }
+    // Turns accumulating recursion into tail calls, which the interpreter
+    // and LLVM (from -O1) run in constant stack space.
+    introduceAccumulators(module.Functions);
+
+    if (parser.get().Kind == TokenKind::Import) {
+        throw ParserException("Imports must come before any function definition", parser.get().Location);
+    }
+
+    if (module.IsRoot && RootHasMainExpr) {
+        module.MainInputs = parser.parseInputs();
+        auto resultExpr = parser.parseExpression();
+        if (!resultExpr) {
+            throw ParserException("Parsing failed for the main expression.", parser.get().Location);
+        }
+        module.MainExpr = std::move(resultExpr);
+    } else if (parser.get().Kind != TokenKind::Eof) {
+        std::string kind = module.IsRoot ? "Library '" : "Imported module '";
+        throw ParserException(kind + module.Name + "' may only contain function definitions, found " + tokenToString(parser.get()) + " instead", parser.get().Location);
+    }
+
+    if (!LazyBodies) {
+        module.Tokens = TokenBuffer();
+    }
+    module.Parsed = true;
+
+    // Lazy bodies would all have to be parsed to be stored.
+    if (Cache && !LazyBodies) {
+        CachedModule cached {module.Imports, FlatAst(module.BaseOffset), {}, module.MainInputs, std::nullopt};
+        for (const auto& func : module.Functions) {
+            cached.Functions.push_back(cached.Ast.add(*func));
+        }
+        if (module.MainExpr) {
+            cached.MainExpr = cached.Ast.add(*module.MainExpr);
+        }
+        Cache->store(module.CacheKey, cached);
+    }
+}
+
+const std::vector<SourceModule*>& ModuleLoader::getModules() const {
+    return Modules;
+}
+
+const SourceModule* ModuleLoader::findModule(size_t pos) const {
+    // Includes modules whose imports are still being resolved, so errors in
+    // an import header can be reported against the right file.
+    for (const auto& module : Owned) {
+        if (pos >= module->BaseOffset && pos <= module->BaseOffset + module->Source.size()) {
+            return module.get();
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,71 @@
+#ifndef MODULE_LOADER_HPP
+#define MODULE_LOADER_HPP
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "ast_cache.hpp"
+#include "source_buffer.hpp"
+#include "token_buffer.hpp"
+
+// One source file of a program. Every file gets its own range in a single
+// global location space starting at BaseOffset, so a SourceLocation alone is
+// enough to find the file it points into.
+struct SourceModule {
+    std::string Name;
+    std::filesystem::path Path;
+    SourceBuffer Source;
+    // Lexed when the module is loaded and released once it is parsed, unless
+    // function bodies are parsed lazily from it.
+    TokenBuffer Tokens;
+    size_t BaseOffset;
+    bool IsRoot = false;
+    bool Parsed = false;
+    std::vector<AstImport> Imports;
+    // Set when the AST cache had this module; parse() expands it instead of
+    // lexing and parsing the source.
+    std::optional<CachedModule> Cached;
+    uint64_t CacheKey = 0;
+    std::vector<SourceModule*> Dependencies;
+    std::vector<std::unique_ptr<AstFunction>> Functions;
+    // Values the main expression is evaluated for, from `input a, b in ...`.
+    std::vector<AstArg> MainInputs;
+    AstExprPtr MainExpr;
+};
+
+// Resolves `import name` declarations to `name.lang` files, first next to the
+// importing file and then in the search paths. Loading only reads the import
+// header of each file; function bodies are parsed on demand with parse().
+class ModuleLoader {
+    std::vector<std::filesystem::path> SearchPaths;
+    std::vector<std::unique_ptr<SourceModule>> Owned;
+    // Fully loaded modules. Dependencies always come before the modules
+    // importing them; the root module is last.
+    std::vector<SourceModule*> Modules;
+    std::set<std::filesystem::path> InProgress;
+    size_t NextBaseOffset = 0;
+    // A library root only defines functions, like an imported module.
+    bool RootHasMainExpr;
+    // Defer parsing each function body until it is first used.
+    bool LazyBodies;
+    std::optional<AstCache> Cache;
+
+    SourceModule* findLoaded(const std::filesystem::path& path) const;
+    std::filesystem::path resolveImport(const SourceModule& importer, const AstImport& import) const;
+    SourceModule& loadModule(const std::filesystem::path& path, bool isRoot);
+public:
+    explicit ModuleLoader(std::vector<std::filesystem::path> searchPaths = {}, bool rootHasMainExpr = true, bool lazyBodies = false);
+    // Reuses modules parsed by earlier runs; call before load().
+    void setAstCache(std::filesystem::path directory);
+    SourceModule& load(const std::string& rootPath);
+    void parse(SourceModule& module);
+    const std::vector<SourceModule*>& getModules() const;
+    const SourceModule* findModule(size_t pos) const;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#include <llvm/Transforms/IPO/SCCP.h>
+
+#include "optimizer.hpp"
+
+Optimizer::Optimizer(unsigned level, bool specializeFunctions) : Level(level), SpecializeFunctions(specializeFunctions) {
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+    if (Level > 0) {
+        FPM = PB.buildFunctionSimplificationPipeline(getOptimizationLevel(), llvm::ThinOrFullLTOPhase::None);
+    }
+}
+
+llvm::OptimizationLevel Optimizer::getOptimizationLevel() const {
+    switch (Level) {
+        case 0: return llvm::OptimizationLevel::O0;
+        case 1: return llvm::OptimizationLevel::O1;
+        case 2: return llvm::OptimizationLevel::O2;
+        default: return llvm::OptimizationLevel::O3;
+    }
+}
+
+unsigned Optimizer::getLevel() const {
+    return Level;
+}
+
+void Optimizer::optimizeFunction(llvm::Function& func) {
+    if (Level == 0) return;
+    FPM.run(func, FAM);
+    // The function may later be cloned or linked over; drop cached analyses
+    // so nothing keeps pointing into it.
+    FAM.clear(func, func.getName());
+}
+
+void Optimizer::optimizeLinkedProgram(llvm::Module& module, const std::set<std::string>& entryPoints) {
+    for (llvm::Function& F : module.functions()) {
+        if (!F.isDeclaration() && !entryPoints.count(std::string(F.getName()))) {
+            F.setLinkage(llvm::GlobalValue::InternalLinkage);
+        }
+    }
+
+    if (Level == 0) return;
+    llvm::ModulePassManager MPM;
+    if (SpecializeFunctions) {
+        // Clones internal functions for call sites with constant arguments;
+        // the number and size of clones follow LLVM's own cost model.
+        MPM.addPass(llvm::IPSCCPPass(llvm::IPSCCPOptions(/*AllowFuncSpec=*/true)));
+    }
+    MPM.addPass(PB.buildLTODefaultPipeline(getOptimizationLevel(), nullptr));
+    MPM.run(module, MAM);
+    MAM.clear();
+    FAM.clear();
+}
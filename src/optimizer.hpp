@@ -0,0 +1,37 @@
+#ifndef OPTIMIZER_HPP
+#define OPTIMIZER_HPP
+
+#include <set>
+#include <string>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+
+// Runs LLVM's optimization pipeline on generated code at a fixed -O level.
+// Level 0 leaves the IR untouched.
+class Optimizer {
+    unsigned Level;
+    bool SpecializeFunctions;
+    llvm::PassBuilder PB;
+    llvm::LoopAnalysisManager LAM;
+    llvm::FunctionAnalysisManager FAM;
+    llvm::CGSCCAnalysisManager CGAM;
+    llvm::ModuleAnalysisManager MAM;
+    llvm::FunctionPassManager FPM;
+
+    llvm::OptimizationLevel getOptimizationLevel() const;
+public:
+    // With specializeFunctions, link-time optimization also clones functions
+    // for call sites passing constant arguments.
+    explicit Optimizer(unsigned level, bool specializeFunctions = false);
+    unsigned getLevel() const;
+    void optimizeFunction(llvm::Function& func);
+    // Link-time optimization of a whole program: everything but the entry
+    // points is internalized so functions imported from other modules can be
+    // inlined across module boundaries and dropped once unused.
+    void optimizeLinkedProgram(llvm::Module& module, const std::set<std::string>& entryPoints);
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "parallel_parser.hpp"
+#include "parser.hpp"
+
+namespace {
+
+// Below this many definitions per thread, starting threads costs more than it saves.
+constexpr size_t MinFunctionsPerThread = 64;
+// Workers claim this many definitions at a time.
+constexpr size_t FunctionsPerClaim = 16;
+
+// Token index of each definition's `fn`, followed by the index after the last
+// one. Stops at the first definition whose braces do not balance.
+std::vector<size_t> findFunctionBoundaries(const TokenBuffer& tokens, size_t pos) {
+    std::vector<size_t> boundaries;
+    while (tokens.getKind(pos) == TokenKind::Fn) {
+        size_t end = pos + 1;
+        while (tokens.getKind(end) != TokenKind::LBrace && tokens.getKind(end) != TokenKind::Fn && tokens.getKind(end) != TokenKind::Eof) {
+            ++end;
+        }
+        if (tokens.getKind(end) != TokenKind::LBrace) break;
+
+        size_t depth = 0;
+        do {
+            TokenKind kind = tokens.getKind(end);
+            if (kind == TokenKind::LBrace) {
+                ++depth;
+            } else if (kind == TokenKind::RBrace) {
+                --depth;
+            } else if (kind == TokenKind::Eof) {
+                break;
+            }
+            ++end;
+        } while (depth > 0);
+        if (depth > 0) break;
+
+        boundaries.push_back(pos);
+        pos = end;
+    }
+    boundaries.push_back(pos);
+    return boundaries;
+}
+
+}
+
+std::vector<std::unique_ptr<AstFunction>> parseFunctionsInParallel(const TokenBuffer& tokens, size_t& pos, unsigned threads) {
+    std::vector<size_t> boundaries = findFunctionBoundaries(tokens, pos);
+    size_t count = boundaries.size() - 1;
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count / MinFunctionsPerThread));
+
+    // A null entry marks a piece that has to be parsed again sequentially.
+    std::vector<std::unique_ptr<AstFunction>> functions(count);
+    std::atomic<size_t> nextClaim = 0;
+    auto work = [&]() {
+        while (true) {
+            size_t first = nextClaim.fetch_add(FunctionsPerClaim);
+            if (first >= count) return;
+            size_t last = std::min(count, first + FunctionsPerClaim);
+            for (size_t i = first; i < last; ++i) {
+                try {
+                    Parser parser(tokens, boundaries[i]);
+                    auto func = parser.parseFunction();
+                    if (parser.getPosition() == boundaries[i + 1]) {
+                        functions[i] = std::move(func);
+                    }
+                } catch (...) {
+                    // Reported by the sequential parse.
+                }
+            }
+        }
+    };
+
+    if (threads <= 1) {
+        work();
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned i = 1; i < threads; ++i) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    auto failed = std::find(functions.begin(), functions.end(), nullptr);
+    pos = boundaries[failed - functions.begin()];
+    functions.erase(failed, functions.end());
+    return functions;
+}
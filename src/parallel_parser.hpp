@@ -0,0 +1,21 @@
+#ifndef PARALLEL_PARSER_HPP
+#define PARALLEL_PARSER_HPP
+
+#include <memory>
+#include <vector>
+
+#include "ast.hpp"
+#include "token_buffer.hpp"
+
+// Parses the run of `fn` definitions starting at token pos. Definitions are
+// delimited by balanced braces, so a scan over the token kinds splits the run
+// into pieces that are parsed independently on worker threads. Returns the
+// functions in source order and advances pos past the last one.
+//
+// Stops before the first piece that fails to parse or does not end where the
+// scan expected it to, leaving pos at its `fn`. Parsing on from there reports
+// the same error a sequential parse would. threads = 0 uses one thread per
+// core.
+std::vector<std::unique_ptr<AstFunction>> parseFunctionsInParallel(const TokenBuffer& tokens, size_t& pos, unsigned threads = 0);
+
+#endif
@@ -1,152 +1,126 @@
 #include "parser.hpp"
 #include "source_location.hpp"
-#include <functional>
+#include <array>
 
-bool Parser::consume(TokenKind kind) {
-    if (get().Kind == kind) {
+bool Parser::consume(TokenKind expected) {
+    if (kind() == expected) {
         nextToken();
         return true;
     }
     return false;
 }
 
-int Parser::getOpPrecedence(TokenKind kind) {
-    switch (kind) {
-        case TokenKind::Or: return 10;
-        case TokenKind::And: return 20;
-        case TokenKind::Eq: case TokenKind::Neq: return 30;
-        case TokenKind::Lt: case TokenKind::Leq: case TokenKind::Gt: case TokenKind::Geq: return 40;
-        case TokenKind::Add: case TokenKind::Sub: return 50;
-        case TokenKind::Mul: case TokenKind::Div: return 60;
-        default: return -1;
-    }
+namespace {
+
+using BinaryNodeFactory = AstExprPtr (*)(AstExprPtr, AstExprPtr);
+
+template <typename Node>
+AstExprPtr makeBinary(AstExprPtr LHS, AstExprPtr RHS) {
+    SourceLocation loc = mergeLocations(LHS->getLocation(), RHS->getLocation());
+    return std::make_unique<Node>(loc, std::move(LHS), std::move(RHS));
 }
 
-std::unique_ptr<AstExpr> Parser::parseExpression() {
-    size_t startlexerPos = getLexerPosition();
-    auto LHS = parsePrimary();
-    if (!LHS) throw ParserException("Invalid LHS", SourceLocation {startlexerPos, getLexerPosition()});
-    LHS = parsePostfix(std::move(LHS));
+struct BinaryOperator {
+    // 0 for tokens that are not binary operators. All operators are left
+    // associative.
+    int Precedence;
+    BinaryNodeFactory Make;
+};
 
-    std::function<std::unique_ptr<AstExpr>(int, std::unique_ptr<AstExpr>)> 
-    parseBinOpRHS = [&](int exprPrec, std::unique_ptr<AstExpr> LHS) {
-        while (true) {
-            int tokenPrec = getOpPrecedence(get().Kind);
-            if (tokenPrec < exprPrec) return LHS;
+constexpr size_t TokenKindCount = static_cast<size_t>(TokenKind::Unknown) + 1;
+
+constexpr std::array<BinaryOperator, TokenKindCount> makeBinaryOperatorTable() {
+    std::array<BinaryOperator, TokenKindCount> table {};
+    auto set = [&table](TokenKind kind, int precedence, BinaryNodeFactory make) {
+        table[static_cast<size_t>(kind)] = BinaryOperator {precedence, make};
+    };
+    set(TokenKind::Or, 10, makeBinary<AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>>);
+    set(TokenKind::And, 20, makeBinary<AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>>);
+    set(TokenKind::Eq, 30, makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>>);
+    set(TokenKind::Neq, 30, makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>>);
+    set(TokenKind::Lt, 40, makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>>);
+    set(TokenKind::Leq, 40, makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>>);
+    set(TokenKind::Gt, 40, makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>>);
+    set(TokenKind::Geq, 40, makeBinary<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>>);
+    set(TokenKind::Add, 50, makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>);
+    set(TokenKind::Sub, 50, makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>>);
+    set(TokenKind::Mul, 60, makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>>);
+    set(TokenKind::Div, 60, makeBinary<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>>);
+    return table;
+}
+
+constexpr std::array<BinaryOperator, TokenKindCount> BinaryOperators = makeBinaryOperatorTable();
+
+const BinaryOperator* binaryOperator(TokenKind kind) {
+    const BinaryOperator& op = BinaryOperators[static_cast<size_t>(kind)];
+    return op.Precedence > 0 ? &op : nullptr;
+}
+
+}
+
+// Operator precedence parsing with explicit operand and operator stacks.
+// Parentheses are handled here as well, so neither long operator chains nor
+// deeply nested parentheses use native stack; only let, match, call
+// arguments and array elements recurse.
+AstExprPtr Parser::parseExpression() {
+    std::vector<AstExprPtr> operands;
+    // A null entry is an open parenthesis.
+    std::vector<const BinaryOperator*> operators;
+    size_t openParens = 0;
+
+    auto reduce = [&]() {
+        auto RHS = std::move(operands.back());
+        operands.pop_back();
+        operands.back() = operators.back()->Make(std::move(operands.back()), std::move(RHS));
+        operators.pop_back();
+    };
 
-            TokenKind binOp = get().Kind;
+    while (true) {
+        while (kind() == TokenKind::LParen) {
+            operators.push_back(nullptr);
+            ++openParens;
             nextToken();
+        }
 
-            auto RHS = parsePrimary();
-            if (!RHS) return std::unique_ptr<AstExpr>(nullptr);
-            RHS = parsePostfix(std::move(RHS));
+        size_t operandLexerPos = getLexerPosition();
+        auto operand = parsePrimary();
+        if (!operand) {
+            // A missing right operand is left for the caller to report.
+            if (!operators.empty() && operators.back()) return nullptr;
+            throw ParserException("Invalid LHS", SourceLocation {operandLexerPos, getLexerPosition()});
+        }
+        operands.push_back(parsePostfix(std::move(operand)));
 
-            int nextPrec = getOpPrecedence(get().Kind);
-            if (tokenPrec < nextPrec) {
-                RHS = parseBinOpRHS(tokenPrec + 1, std::move(RHS));
-                if (!RHS) return std::unique_ptr<AstExpr>(nullptr);
-            }
+        while (kind() == TokenKind::RParen && openParens > 0) {
+            while (operators.back()) reduce();
+            operators.pop_back();
+            --openParens;
+            nextToken();
+            operands.back() = parsePostfix(std::move(operands.back()));
+        }
 
-            // Create the binary expression node based on the operator kind
-            switch (binOp) {
-                case TokenKind::Add:
-                    LHS = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Sub:
-                    LHS = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Mul:
-                    LHS = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Div:
-                    LHS = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Eq:
-                    LHS = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Neq:
-                    LHS = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Neq>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Leq:
-                    LHS = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Leq>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Lt:
-                    LHS = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Geq:
-                    LHS = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Geq>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Gt:
-                    LHS = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Gt>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::And:
-                    LHS = std::make_unique<AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                case TokenKind::Or:
-                    LHS = std::make_unique<AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>>(
-                        mergeLocations(LHS->getLocation(), RHS->getLocation()),
-                        std::move(LHS),
-                        std::move(RHS)
-                    );
-                    break;
-                default:
-                    return std::unique_ptr<AstExpr>(nullptr); // Should not happen
-            }
+        const BinaryOperator* op = binaryOperator(kind());
+        if (!op) break;
+        while (!operators.empty() && operators.back() && operators.back()->Precedence >= op->Precedence) {
+            reduce();
         }
-    };
-    return parseBinOpRHS(0, std::move(LHS));
+        operators.push_back(op);
+        nextToken();
+    }
+
+    if (openParens > 0) {
+        throw ParserException("Expected ')' after expression, found " + tokenToString(get()) + " instead", location());
+    }
+    while (!operators.empty()) reduce();
+    return std::move(operands.back());
 }
 
-std::vector<std::unique_ptr<AstExpr>> Parser::parseCallArgs() {
-    std::vector<std::unique_ptr<AstExpr>> args;
+std::vector<AstExprPtr> Parser::parseCallArgs() {
+    std::vector<AstExprPtr> args;
 
     // We assume the '(' has already been consumed by the caller (parsePostfix)
     
-    if (get().Kind != TokenKind::RParen) {
+    if (kind() != TokenKind::RParen) {
         while (true) {
             size_t callArgExprLexerPosition = getLexerPosition();
             if (auto arg = parseExpression()) {
@@ -155,57 +129,56 @@ std::vector<std::unique_ptr<AstExpr>> Parser::parseCallArgs() {
                 throw ParserException("Invalid Call Argument ", SourceLocation {callArgExprLexerPosition, getLexerPosition()});
             }
 
-            Token nextToken = get();
-            if (get().Kind == TokenKind::RParen) break;
+            if (kind() == TokenKind::RParen) break;
             if (!consume(TokenKind::Comma)) {
-                throw ParserException("Expected ',' or ')' after argument, found " + tokenToString(nextToken) + " instead", nextToken.Location);
+                throw ParserException("Expected ',' or ')' after argument, found " + tokenToString(get()) + " instead", location());
             }
         }
     }
     return args;
 }
 
-std::unique_ptr<AstExpr> Parser::parsePostfix(std::unique_ptr<AstExpr> LHS) {
+AstExprPtr Parser::parsePostfix(AstExprPtr LHS) {
     // Loop to handle chained postfix operators: func(1)[2].field
     while (true) {
-        Token currentToken = get();
+        SourceLocation opLocation = location();
 
         // 1. Array Indexing: LHS[index]
-        if (currentToken.Kind == TokenKind::LBracket) {
+        if (kind() == TokenKind::LBracket) {
             nextToken(); // Consume '['
             
             auto index = parseExpression();
             if (!index) {
-                throw ParserException("Expected index expression in array indexing", get().Location);
+                throw ParserException("Expected index expression in array indexing", location());
             }
 
-            Token endToken = get();
+            SourceLocation endLocation = location();
             if (!consume(TokenKind::RBracket)) {
-                throw ParserException("Expected ']' to close array index", endToken.Location);
+                throw ParserException("Expected ']' to close array index", location());
             }
             
-            SourceLocation indexLoc = mergeLocations(LHS->getLocation(), endToken.Location);
+            SourceLocation indexLoc = mergeLocations(LHS->getLocation(), endLocation);
             LHS = std::make_unique<AstExprIndex>(indexLoc, std::move(LHS), std::move(index));
             // Continue loop for more postfix ops (e.g., array[i][j])
         } 
         
         // 2. Function Call: LHS(args...)
-        else if (currentToken.Kind == TokenKind::LParen) {
+        else if (kind() == TokenKind::LParen) {
             nextToken(); // Consume '('
             
-            std::vector<std::unique_ptr<AstExpr>> args = parseCallArgs();
+            std::vector<AstExprPtr> args = parseCallArgs();
             
-            Token endToken = get();
+            SourceLocation endLocation = location();
             if (!consume(TokenKind::RParen)) {
-                throw ParserException("Expected ')' after argument list", endToken.Location);
+                throw ParserException("Expected ')' after argument list", location());
             }
             
-            SourceLocation callLoc = mergeLocations(LHS->getLocation(), endToken.Location);
+            SourceLocation callLoc = mergeLocations(LHS->getLocation(), endLocation);
 
-            if (auto var = dynamic_cast<AstExprVariable*>(LHS.get())) {
+            if (auto var = dynamic_cast<const AstExprVariable*>(LHS.get())) {
                 LHS = std::make_unique<AstExprCall>(callLoc, var->getName(), std::move(args));
             } else {
-                throw ParserException("Function calls must currently use a identifier as the function.", currentToken.Location);
+                throw ParserException("Function calls must currently use a identifier as the function.", opLocation);
             }
         }
         // No more postfix operators found
@@ -216,37 +189,27 @@ std::unique_ptr<AstExpr> Parser::parsePostfix(std::unique_ptr<AstExpr> LHS) {
 }
 
 
-std::unique_ptr<AstExpr> Parser::parsePrimary() {
-    Token currentToken = get();
-    switch (currentToken.Kind) {
+AstExprPtr Parser::parsePrimary() {
+    switch (kind()) {
         case TokenKind::Number: {
-            auto val = std::make_unique<AstExprConstLong>(currentToken.Location, currentToken.Value);
+            auto val = std::make_unique<AstExprConstLong>(location(), Tokens.getValue(Pos));
             nextToken();
             return val;
         }
         case TokenKind::True: {
-            auto val = std::make_unique<AstExprConstBool>(currentToken.Location, true);
+            auto val = std::make_unique<AstExprConstBool>(location(), true);
             nextToken();
             return val;
         }
         case TokenKind::False: {
-            auto val = std::make_unique<AstExprConstBool>(currentToken.Location, false);
+            auto val = std::make_unique<AstExprConstBool>(location(), false);
             nextToken();
             return val;
         }
         case TokenKind::Identifier: {
-            Token nameToken = get();
-            nextToken();
-            return std::make_unique<AstExprVariable>(nameToken.Location, nameToken.Text);
-        }
-        case TokenKind::LParen: {
+            auto var = std::make_unique<AstExprVariable>(location(), Tokens.getName(Pos));
             nextToken();
-            auto expr = parseExpression();
-            Token end = get();
-            if (!expr || !consume(TokenKind::RParen)) {
-                throw ParserException("Expected ')' after expression, found " + tokenToString(end) + " instead", end.Location);
-            }
-            return expr;
+            return var;
         }
         case TokenKind::LBracket: return parseArrayLiteral();
         case TokenKind::Let: return parseLetIn();
@@ -256,54 +219,50 @@ std::unique_ptr<AstExpr> Parser::parsePrimary() {
     }
 }
 
-std::unique_ptr<AstExpr> Parser::parseLetIn() {
-    Token letToken = get();
+AstExprPtr Parser::parseLetIn() {
+    SourceLocation letLocation = location();
     nextToken(); // consume 'let'
-    if (get().Kind != TokenKind::Identifier) {
-        throw ParserException("Expected identifier after 'let', found " + tokenToString(get()) + " instead", get().Location);
+    if (kind() != TokenKind::Identifier) {
+        throw ParserException("Expected identifier after 'let', found " + tokenToString(get()) + " instead", location());
     }
-    std::string varName = get().Text;
+    Symbol varName = Tokens.getName(Pos);
     nextToken(); // consume identifier
 
-    Token equalToken = get();
     if (!consume(TokenKind::Equal)) {
-        throw ParserException("Expected '=' after variable name, found " + tokenToString(equalToken) + " instead", equalToken.Location);
+        throw ParserException("Expected '=' after variable name, found " + tokenToString(get()) + " instead", location());
     }
 
     size_t letExprLexerPos = getLexerPosition();
     auto expr = parseExpression();
     if (!expr) throw ParserException("Invalid let expression in let in", SourceLocation {letExprLexerPos, getLexerPosition()});
 
-    Token inToken = get();
     if (!consume(TokenKind::In)) {
-        throw ParserException("Expected 'in' after expression, found " + tokenToString(inToken) + " instead", inToken.Location);
+        throw ParserException("Expected 'in' after expression, found " + tokenToString(get()) + " instead", location());
     }
 
     size_t inExprLexerPos = getLexerPosition();
     auto body = parseExpression();
     if (!body) throw ParserException("Invalid in expression in let in", SourceLocation {inExprLexerPos, getLexerPosition()});
 
-    return std::make_unique<AstExprLetIn>(mergeLocations(letToken.Location, body->getLocation()), varName, std::move(expr), std::move(body));
+    return std::make_unique<AstExprLetIn>(mergeLocations(letLocation, body->getLocation()), varName, std::move(expr), std::move(body));
 }
 
-std::unique_ptr<AstExpr> Parser::parseMatch() {
-    SourceLocation startLocation = get().Location;
+AstExprPtr Parser::parseMatch() {
+    SourceLocation startLocation = location();
     nextToken(); // consume 'match'
-    Token lbraceToken = get();
     if (!consume(TokenKind::LBrace)) {
-        throw ParserException("Expected '{' after 'match', found " + tokenToString(lbraceToken) + " instead", lbraceToken.Location);
+        throw ParserException("Expected '{' after 'match', found " + tokenToString(get()) + " instead", location());
     }
 
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
-    while (get().Kind != TokenKind::RBrace && get().Kind != TokenKind::Eof) {
+    std::vector<AstExprMatchPathPtr> paths;
+    while (kind() != TokenKind::RBrace && kind() != TokenKind::Eof) {
 
         size_t guardExprLexerPos = getLexerPosition();
         auto guard = parseExpression();
         if (!guard) throw ParserException("Invalid guard condition", SourceLocation {guardExprLexerPos, getLexerPosition()});
 
-        Token arrowToken = get();
         if (!consume(TokenKind::Arrow)) {
-            throw ParserException("Expected '->' after guard condition, found " + tokenToString(arrowToken) + " instead", arrowToken.Location);
+            throw ParserException("Expected '->' after guard condition, found " + tokenToString(get()) + " instead", location());
         }
 
         size_t matchPathExprLexerPos = getLexerPosition();
@@ -314,99 +273,181 @@ std::unique_ptr<AstExpr> Parser::parseMatch() {
         consume(TokenKind::Comma); // Optional comma
     }
 
-    SourceLocation endLocation = get().Location;
-    Token rbraceToken = get();
+    SourceLocation endLocation = location();
     if (!consume(TokenKind::RBrace)) {
-        throw ParserException("Expected '}' after match paths, found " + tokenToString(rbraceToken) + " instead", rbraceToken.Location);
+        throw ParserException("Expected '}' after match paths, found " + tokenToString(get()) + " instead", location());
     }
     return std::make_unique<AstExprMatch>(mergeLocations(startLocation, endLocation), std::move(paths));
 }
 
-std::unique_ptr<AstExpr> Parser::parseArrayLiteral() {
-    Token startToken = get();
+AstExprPtr Parser::parseArrayLiteral() {
+    SourceLocation startLocation = location();
     nextToken(); // Consume '['
     
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     
-    if (get().Kind != TokenKind::RBracket) {
+    if (kind() != TokenKind::RBracket) {
         while (true) {
             auto element = parseExpression();
-            if (!element) throw ParserException("Expected array element expression", get().Location);
+            if (!element) throw ParserException("Expected array element expression", location());
             elements.push_back(std::move(element));
 
-            if (get().Kind == TokenKind::RBracket) break;
+            if (kind() == TokenKind::RBracket) break;
             
             if (!consume(TokenKind::Comma)) {
-                throw ParserException("Expected ',' or ']' in array literal", get().Location);
+                throw ParserException("Expected ',' or ']' in array literal", location());
             }
         }
     }
     
-    Token endToken = get();
+    SourceLocation endLocation = location();
     if (!consume(TokenKind::RBracket)) {
-        throw ParserException("Expected ']' at end of array literal", endToken.Location);
+        throw ParserException("Expected ']' at end of array literal", location());
     }
     
-    SourceLocation arrayLoc = mergeLocations(startToken.Location, endToken.Location);
+    SourceLocation arrayLoc = mergeLocations(startLocation, endLocation);
     auto elementType = std::make_unique<Any>();
     
     return std::make_unique<AstExprConstArray>(arrayLoc, std::move(elementType), std::move(elements));
 }
 
 std::unique_ptr<AstPrototype> Parser::parsePrototype() {
-    if (get().Kind != TokenKind::Identifier) {
-        throw ParserException("Expected function name, found " + tokenToString(get()) + " instead", get().Location);
+    if (kind() != TokenKind::Identifier) {
+        throw ParserException("Expected function name, found " + tokenToString(get()) + " instead", location());
     }
-    Token funcNameToken = get();
+    SourceLocation nameLocation = location();
+    Symbol name = Tokens.getName(Pos);
     nextToken(); // consume name
 
-    Token lbraceToken = get();
     if (!consume(TokenKind::LParen)) {
-        throw ParserException("Expected '(' after function name, found " + tokenToString(lbraceToken) + " instead", lbraceToken.Location);
+        throw ParserException("Expected '(' after function name, found " + tokenToString(get()) + " instead", location());
     }
 
     std::vector<AstArg> args;
-    while (get().Kind == TokenKind::Identifier) {
-        args.push_back(AstArg {get().Location, get().Text});
+    while (kind() == TokenKind::Identifier) {
+        args.push_back(AstArg {location(), Tokens.getName(Pos)});
         nextToken();
-        if (get().Kind == TokenKind::Comma) {
+        if (kind() == TokenKind::Comma) {
             nextToken();
         }
     }
 
-    Token endToken = get();
+    SourceLocation endLocation = location();
     if (!consume(TokenKind::RParen)) {
-        throw ParserException("Expected ')' after argument list, found " + tokenToString(endToken) + " instead", endToken.Location);
+        throw ParserException("Expected ')' after argument list, found " + tokenToString(get()) + " instead", location());
+    }
+    return std::make_unique<AstPrototype>(mergeLocations(nameLocation, endLocation), name, std::move(args));
+}
+
+std::vector<AstImport> Parser::parseImports() {
+    std::vector<AstImport> imports;
+    while (kind() == TokenKind::Import) {
+        Token importToken = get();
+        nextToken(); // consume 'import'
+        Token nameToken = get();
+        if (nameToken.Kind != TokenKind::Identifier) {
+            throw ParserException("Expected module name after 'import', found " + tokenToString(nameToken) + " instead", nameToken.Location);
+        }
+        nextToken(); // consume module name
+        imports.push_back(AstImport {mergeLocations(importToken.Location, nameToken.Location), std::string(nameToken.Text)});
+    }
+    return imports;
+}
+
+// Parses the optional `input a, b in` header of a main expression.
+std::vector<AstArg> Parser::parseInputs() {
+    std::vector<AstArg> inputs;
+    if (!consume(TokenKind::Input)) {
+        return inputs;
+    }
+
+    while (true) {
+        Token nameToken = get();
+        if (nameToken.Kind != TokenKind::Identifier) {
+            throw ParserException("Expected input name, found " + tokenToString(nameToken) + " instead", nameToken.Location);
+        }
+        nextToken(); // consume input name
+        inputs.push_back(AstArg {nameToken.Location, nameToken.Name});
+        if (!consume(TokenKind::Comma)) break;
+    }
+
+    if (!consume(TokenKind::In)) {
+        throw ParserException("Expected 'in' after inputs, found " + tokenToString(get()) + " instead", location());
     }
-    return std::make_unique<AstPrototype>(mergeLocations(funcNameToken.Location, endToken.Location), funcNameToken.Text, std::move(args));
+    return inputs;
 }
 
 std::unique_ptr<AstFunction> Parser::parseFunction() {
-    Token startToken = get();
+    SourceLocation startLocation = location();
     nextToken(); // consume 'fn'
     size_t protoStartLexerPos = getLexerPosition();
     auto proto = parsePrototype();
     if (!proto) throw ParserException("Invalid function prototype", SourceLocation {protoStartLexerPos, getLexerPosition()});
 
-    Token lbraceToken = get();
     if (!consume(TokenKind::LBrace)) {
-        throw ParserException("Expected '{' after function prototype, found " + tokenToString(lbraceToken) + " instead", lbraceToken.Location);
+        throw ParserException("Expected '{' after function prototype, found " + tokenToString(get()) + " instead", location());
     }
     size_t bodyStartLexerPos = getLexerPosition();
     auto body = parseExpression();
     if (!body) throw ParserException("Invalid function body", SourceLocation {bodyStartLexerPos, getLexerPosition()});
 
-    Token endToken = get();
+    SourceLocation endLocation = location();
     if (!consume(TokenKind::RBrace)) {
-        throw ParserException("Expected '}' after function body, found " + tokenToString(endToken) + " instead", endToken.Location);
+        throw ParserException("Expected '}' after function body, found " + tokenToString(get()) + " instead", location());
+    }
+
+    return std::make_unique<AstFunction>(mergeLocations(startLocation, endLocation), std::move(proto), std::move(body));
+}
+
+std::unique_ptr<AstFunction> Parser::parseLazyFunction() {
+    size_t start = Pos;
+    SourceLocation startLocation = location();
+    nextToken(); // consume 'fn'
+    auto proto = parsePrototype();
+
+    size_t bodyStart = Pos;
+    bool balanced = false;
+    bool recursive = false;
+    if (kind() == TokenKind::LBrace) {
+        size_t depth = 0;
+        for (; kind() != TokenKind::Eof; nextToken()) {
+            if (kind() == TokenKind::LBrace) {
+                ++depth;
+            } else if (kind() == TokenKind::RBrace && --depth == 0) {
+                balanced = true;
+                break;
+            }
+            recursive = recursive || (kind() == TokenKind::Identifier && Tokens.getName(Pos) == proto->getName());
+        }
+    }
+    // Malformed and self-recursive definitions are parsed as usual, which
+    // also reports errors exactly where an eager parse would.
+    if (!balanced || recursive) {
+        Pos = start;
+        return parseFunction();
     }
 
-    return std::make_unique<AstFunction>(mergeLocations(startToken.Location, endToken.Location), std::move(proto), std::move(body));
+    SourceLocation endLocation = location();
+    nextToken(); // consume '}'
+    const TokenBuffer& tokens = Tokens;
+    size_t bodyEnd = Pos;
+    auto parseBody = [&tokens, bodyStart, bodyEnd]() {
+        Parser parser(tokens, bodyStart);
+        parser.nextToken(); // consume '{'
+        size_t bodyStartLexerPos = parser.getLexerPosition();
+        auto body = parser.parseExpression();
+        if (!body) throw ParserException("Invalid function body", SourceLocation {bodyStartLexerPos, parser.getLexerPosition()});
+        if (parser.kind() != TokenKind::RBrace || parser.Pos + 1 != bodyEnd) {
+            throw ParserException("Expected '}' after function body, found " + tokenToString(parser.get()) + " instead", parser.location());
+        }
+        return body;
+    };
+    return std::make_unique<AstFunction>(mergeLocations(startLocation, endLocation), std::move(proto), parseBody);
 }
 
 std::optional<std::unique_ptr<AstFunction>> Parser::parseTopLevelFunction() {
-    if (get().Kind == TokenKind::Fn) {
+    if (kind() == TokenKind::Fn) {
         return parseFunction();
     }
-    throw ParserException("Expected top function definition, found " + tokenToString(get()) + " instead", get().Location);
+    throw ParserException("Expected top function definition, found " + tokenToString(get()) + " instead", location());
 }
\ No newline at end of file
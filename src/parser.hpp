@@ -1,29 +1,42 @@
-#include "lexer.hpp"
+#include "token_buffer.hpp"
 #include "interpreter.hpp"
 #include "parser_exception.hpp"
 
 class Parser {
-    Lexer TheLexer;
+    const TokenBuffer& Tokens;
+    size_t Pos = 0;
 
-    std::unique_ptr<AstExpr> parsePrimary();
-    std::unique_ptr<AstExpr> parseLetIn();
-    std::unique_ptr<AstExpr> parseMatch();
-    std::unique_ptr<AstExpr> parseVariable();
+    AstExprPtr parsePrimary();
+    AstExprPtr parseLetIn();
+    AstExprPtr parseMatch();
+    AstExprPtr parseVariable();
     std::unique_ptr<AstPrototype> parsePrototype();
-    std::unique_ptr<AstExpr> parseArrayLiteral();
-    std::vector<std::unique_ptr<AstExpr>> parseCallArgs();
-    std::unique_ptr<AstExpr> parsePostfix(std::unique_ptr<AstExpr> LHS);
+    AstExprPtr parseArrayLiteral();
+    std::vector<AstExprPtr> parseCallArgs();
+    AstExprPtr parsePostfix(AstExprPtr LHS);
     
-    void nextToken() { TheLexer.nextToken(); }
-    bool consume(TokenKind kind);
+    // Eof is the last token and is never consumed.
+    void nextToken() { if (Pos + 1 < Tokens.size()) ++Pos; }
+    TokenKind kind() const { return Tokens.getKind(Pos); }
+    SourceLocation location() const { return Tokens.getLocation(Pos); }
+    bool consume(TokenKind expected);
     void reportError(const std::string& msg);
-    int getOpPrecedence(TokenKind kind);
 
 public:
-    Parser(const std::string& input) : TheLexer(input) {}
-    const Token& get() const { return TheLexer.get(); }
-    size_t getLexerPosition() { return TheLexer.getCurrentPosition(); }
-    std::unique_ptr<AstExpr> parseExpression();
+    explicit Parser(const TokenBuffer& tokens, size_t pos = 0) : Tokens(tokens), Pos(pos) {}
+    Token get() const { return Tokens.get(Pos); }
+    // Index of the current token in the buffer.
+    size_t getPosition() const { return Pos; }
+    // End of the current token, like the lexer's position after reading it.
+    size_t getLexerPosition() const { return location().EndPos; }
+    AstExprPtr parseExpression();
+    std::vector<AstImport> parseImports();
+    std::vector<AstArg> parseInputs();
     std::unique_ptr<AstFunction> parseFunction();
+    // Parses only the prototype and skips the body by matching braces; the
+    // body is parsed on first use from the token buffer, which has to outlive
+    // the function. Bodies that mention the function's own name are parsed
+    // right away, so the tail recursion rewrite still sees every candidate.
+    std::unique_ptr<AstFunction> parseLazyFunction();
     std::optional<std::unique_ptr<AstFunction>> parseTopLevelFunction();
 };
\ No newline at end of file
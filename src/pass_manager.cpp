@@ -0,0 +1,46 @@
+#include "pass_manager.hpp"
+
+void PassManager::addPass(std::unique_ptr<AstPass> pass) {
+    Passes.push_back(std::move(pass));
+}
+
+bool PassManager::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr) {
+    AnalysisManager analyses(functions);
+    bool changed = false;
+    for (const auto& pass : Passes) {
+        if (pass->run(functions, mainExpr, analyses)) {
+            analyses.invalidate();
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+bool rewriteModule(AstRewriter& rewriter, std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr) {
+    // Nothing is replaced before every body was rewritten, as the analyses
+    // the rewriter consults point into the functions.
+    std::vector<std::unique_ptr<AstFunction>> rewritten(functions.size());
+    bool changed = false;
+    for (size_t i = 0; i < functions.size(); ++i) {
+        auto func = rewriter.rewrite(*functions[i]);
+        if (func->getBody() != functions[i]->getBody()) {
+            rewritten[i] = std::move(func);
+            changed = true;
+        }
+    }
+    AstExprPtr main;
+    if (mainExpr && *mainExpr) {
+        main = rewriter.rewrite(**mainExpr);
+        changed = changed || main != *mainExpr;
+    }
+
+    for (size_t i = 0; i < functions.size(); ++i) {
+        if (rewritten[i]) {
+            functions[i] = std::move(rewritten[i]);
+        }
+    }
+    if (main) {
+        *mainExpr = std::move(main);
+    }
+    return changed;
+}
@@ -0,0 +1,37 @@
+#ifndef PASS_MANAGER_HPP
+#define PASS_MANAGER_HPP
+
+#include <memory>
+#include <vector>
+
+#include "ast.hpp"
+#include "ast_analysis.hpp"
+#include "ast_rewriter.hpp"
+
+// A transformation of the functions of one module and, for the root
+// module, its main expression, which is null otherwise.
+class AstPass {
+public:
+    virtual ~AstPass() = default;
+    // Returns whether anything changed. A pass that leaves a function alone
+    // keeps it, body included, so that cached facts about it stay valid.
+    virtual bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr,
+                     AnalysisManager& analyses) = 0;
+};
+
+// Runs passes in the order they were added. Analyses are shared between
+// them and invalidated after every pass that changed the module.
+class PassManager {
+    std::vector<std::unique_ptr<AstPass>> Passes;
+public:
+    void addPass(std::unique_ptr<AstPass> pass);
+    // Returns whether any pass changed the module.
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr);
+};
+
+// Rewrites every function body and the main expression, keeping the
+// functions whose body the rewriter returned unchanged. Returns whether
+// anything changed.
+bool rewriteModule(AstRewriter& rewriter, std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr);
+
+#endif
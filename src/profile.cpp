@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include "llvm/IR/MDBuilder.h"
+
+#include "profile.hpp"
+#include "codegen.hpp"
+#include "compile_cache.hpp"
+#include "runner.hpp"
+
+uint64_t FunctionProfile::getArmCount(unsigned matchIndex, unsigned armIndex) const {
+    auto it = ArmCounts.find({matchIndex, armIndex});
+    if (it != ArmCounts.end()) {
+        return it->second;
+    }
+    return 0;
+}
+
+
+ProfileGenerator::ProfileGenerator(std::string outputPath) : OutputPath(std::move(outputPath)) {}
+
+void ProfileGenerator::emitIncrement(const CodeGenerator& codeGen, const std::string& record, const std::string& globalName) {
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(*codeGen.TheContext);
+    auto *counter = new llvm::GlobalVariable(
+        *codeGen.TheModule,
+        Int64Ty,
+        false, // isConstant
+        llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantInt::get(Int64Ty, 0),
+        globalName
+    );
+    Counters.push_back(Counter{record, counter});
+
+    llvm::Value *count = codeGen.Builder->CreateLoad(Int64Ty, counter, "prof.count");
+    llvm::Value *incremented = codeGen.Builder->CreateAdd(count, llvm::ConstantInt::get(Int64Ty, 1), "prof.inc");
+    codeGen.Builder->CreateStore(incremented, counter);
+}
+
+void ProfileGenerator::emitFunctionEntry(const CodeGenerator& codeGen, const AstFunction& func) {
+    const std::string& name = func.getPrototype()->getName().str();
+    emitIncrement(codeGen,
+        "function " + name + " " + std::to_string(hashFunctionBody(func)),
+        "__prof." + name + ".entry");
+}
+
+void ProfileGenerator::emitArmEntry(const CodeGenerator& codeGen, const std::string& funcName, unsigned matchIndex, unsigned armIndex) {
+    emitIncrement(codeGen,
+        "arm " + funcName + " " + std::to_string(matchIndex) + " " + std::to_string(armIndex),
+        "__prof." + funcName + ".m" + std::to_string(matchIndex) + ".a" + std::to_string(armIndex));
+}
+
+void ProfileGenerator::emitWriteProfile(const CodeGenerator& codeGen) {
+    llvm::LLVMContext &ctx = *codeGen.TheContext;
+    llvm::Type *i8PtrTy = llvm::PointerType::get(llvm::Type::getInt8Ty(ctx), 0);
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(ctx);
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(ctx);
+
+    llvm::FunctionCallee fopenFunc = codeGen.TheModule->getOrInsertFunction(
+        "fopen", llvm::FunctionType::get(i8PtrTy, {i8PtrTy, i8PtrTy}, false));
+    llvm::FunctionCallee fprintfFunc = codeGen.TheModule->getOrInsertFunction(
+        "fprintf", llvm::FunctionType::get(Int32Ty, {i8PtrTy, i8PtrTy}, true));
+    llvm::FunctionCallee fcloseFunc = codeGen.TheModule->getOrInsertFunction(
+        "fclose", llvm::FunctionType::get(Int32Ty, {i8PtrTy}, false));
+
+    llvm::Function *writer = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(ctx), false),
+        llvm::Function::InternalLinkage,
+        "__lang_profile_write",
+        codeGen.TheModule.get()
+    );
+
+    {
+        llvm::IRBuilderBase::InsertPointGuard guard(*codeGen.Builder);
+        llvm::IRBuilder<> &B = *codeGen.Builder;
+        // The writer has no source of its own to attribute instructions to.
+        B.SetCurrentDebugLocation(llvm::DebugLoc());
+
+        llvm::BasicBlock *EntryBB = llvm::BasicBlock::Create(ctx, "entry", writer);
+        llvm::BasicBlock *WriteBB = llvm::BasicBlock::Create(ctx, "write", writer);
+        llvm::BasicBlock *DoneBB = llvm::BasicBlock::Create(ctx, "done", writer);
+
+        B.SetInsertPoint(EntryBB);
+        llvm::Value *file = B.CreateCall(fopenFunc, {
+            B.CreateGlobalStringPtr(OutputPath, "prof.path"),
+            B.CreateGlobalStringPtr("w", "prof.mode")
+        }, "prof.file");
+        llvm::Value *failed = B.CreateIsNull(file, "prof.failed");
+        B.CreateCondBr(failed, DoneBB, WriteBB);
+
+        B.SetInsertPoint(WriteBB);
+        for (const auto& counter : Counters) {
+            llvm::Value *count = B.CreateLoad(Int64Ty, counter.Global, "prof.count");
+            B.CreateCall(fprintfFunc, {file, B.CreateGlobalStringPtr(counter.Record + " %llu\n", "prof.record"), count});
+        }
+        B.CreateCall(fcloseFunc, {file});
+        B.CreateBr(DoneBB);
+
+        B.SetInsertPoint(DoneBB);
+        B.CreateRetVoid();
+    }
+
+    codeGen.Builder->CreateCall(writer);
+}
+
+
+void ProfileData::read(const std::string& path) {
+    std::ifstream fileStream(path);
+    if (!fileStream.is_open()) {
+        throw FileError("Error: Could not open profile " + path);
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(fileStream, line)) {
+        lineNumber++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string kind, name;
+        fields >> kind >> name;
+
+        if (kind == "function") {
+            uint64_t hash, count;
+            if (!(fields >> hash >> count)) {
+                throw FileError("Error: Malformed profile " + path + " at line " + std::to_string(lineNumber));
+            }
+            FunctionProfile& profile = Functions[name];
+            if (profile.Hash != hash) {
+                // Only combine runs of the same version of the function.
+                profile = FunctionProfile();
+                profile.Hash = hash;
+            }
+            profile.EntryCount += count;
+        } else if (kind == "arm") {
+            unsigned matchIndex, armIndex;
+            uint64_t count;
+            if (!(fields >> matchIndex >> armIndex >> count)) {
+                throw FileError("Error: Malformed profile " + path + " at line " + std::to_string(lineNumber));
+            }
+            Functions[name].ArmCounts[{matchIndex, armIndex}] += count;
+        } else {
+            throw FileError("Error: Malformed profile " + path + " at line " + std::to_string(lineNumber));
+        }
+    }
+
+    computeHotThreshold();
+}
+
+void ProfileData::computeHotThreshold() {
+    // Functions are hot if they are among the most frequently entered ones
+    // that together account for 90% of all function entries.
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    for (const auto& [name, profile] : Functions) {
+        counts.push_back(profile.EntryCount);
+        total += profile.EntryCount;
+    }
+    std::sort(counts.rbegin(), counts.rend());
+
+    HotThreshold = std::numeric_limits<uint64_t>::max();
+    uint64_t covered = 0;
+    for (uint64_t count : counts) {
+        if (total == 0 || covered * 10 >= total * 9) break;
+        covered += count;
+        HotThreshold = count;
+    }
+}
+
+const FunctionProfile *ProfileData::lookup(const AstFunction& func) const {
+    auto it = Functions.find(func.getPrototype()->getName().str());
+    if (it == Functions.end() || it->second.Hash != hashFunctionBody(func)) {
+        return nullptr;
+    }
+    return &it->second;
+}
+
+void ProfileData::annotateFunction(llvm::Function& F, const FunctionProfile& profile) const {
+    F.setEntryCount(profile.EntryCount);
+    if (profile.EntryCount == 0) {
+        F.addFnAttr(llvm::Attribute::Cold);
+    } else if (profile.EntryCount >= HotThreshold) {
+        F.addFnAttr(llvm::Attribute::Hot);
+    }
+}
+
+void ProfileData::annotateBranch(llvm::BranchInst& branch, uint64_t takenCount, uint64_t notTakenCount) const {
+    if (takenCount == 0 && notTakenCount == 0) return;
+
+    // Branch weights are 32 bit; scale both down by the same factor.
+    uint64_t scale = std::max(takenCount, notTakenCount) / std::numeric_limits<uint32_t>::max() + 1;
+    llvm::MDBuilder MDB(branch.getContext());
+    branch.setMetadata(llvm::LLVMContext::MD_prof, MDB.createBranchWeights(
+        static_cast<uint32_t>(takenCount / scale),
+        static_cast<uint32_t>(notTakenCount / scale)));
+}
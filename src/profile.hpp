@@ -0,0 +1,72 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+
+#include "ast.hpp"
+
+class CodeGenerator;
+
+// Counters are identified by function name plus, for match arms, the index
+// of the match within the function (in code generation order) and the index
+// of the arm. Each function also records a structural hash of its body so
+// profiles collected from an older version of the source are ignored.
+//
+// Profile file format, one record per line:
+//   function <name> <hash> <entry count>
+//   arm <name> <match index> <arm index> <count>
+
+struct FunctionProfile {
+    uint64_t Hash = 0;
+    uint64_t EntryCount = 0;
+    std::map<std::pair<unsigned, unsigned>, uint64_t> ArmCounts;
+
+    uint64_t getArmCount(unsigned matchIndex, unsigned armIndex) const;
+};
+
+// Instruments generated code with counters and emits a function that writes
+// them to a profile file when the program exits.
+class ProfileGenerator {
+    struct Counter {
+        std::string Record;
+        llvm::GlobalVariable *Global;
+    };
+
+    std::string OutputPath;
+    std::vector<Counter> Counters;
+
+    void emitIncrement(const CodeGenerator& codeGen, const std::string& record, const std::string& globalName);
+public:
+    explicit ProfileGenerator(std::string outputPath);
+    void emitFunctionEntry(const CodeGenerator& codeGen, const AstFunction& func);
+    void emitArmEntry(const CodeGenerator& codeGen, const std::string& funcName, unsigned matchIndex, unsigned armIndex);
+    // Emits the writer function and a call to it at the current insert point.
+    void emitWriteProfile(const CodeGenerator& codeGen);
+};
+
+// Profile read back from one or more runs of an instrumented program.
+class ProfileData {
+    std::map<std::string, FunctionProfile> Functions;
+    uint64_t HotThreshold = 0;
+
+    void computeHotThreshold();
+public:
+    // Counts from repeated reads are summed, so profiles of several runs can
+    // be combined.
+    void read(const std::string& path);
+    // Returns nullptr if there is no profile for the function or it was
+    // collected from a different version of its body.
+    const FunctionProfile *lookup(const AstFunction& func) const;
+    void annotateFunction(llvm::Function& F, const FunctionProfile& profile) const;
+    void annotateBranch(llvm::BranchInst& branch, uint64_t takenCount, uint64_t notTakenCount) const;
+};
+
+#endif
@@ -1,6 +1,4 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
 #include <stdexcept>
@@ -9,6 +7,11 @@
 #include <utility>
 
 #include "interpreter.hpp"
+#include "flat_interpreter.hpp"
+#include "ast_interner.hpp"
+#include "cse.hpp"
+#include "guard_elimination.hpp"
+#include "inliner.hpp"
 #include "parser.hpp"
 #include "lexer.hpp"
 #include "runner.hpp"
@@ -17,48 +20,25 @@
 #include "interpreter_exception.hpp"
 
 
-std::string readFile(const std::string& filePath) {
-    std::ifstream fileStream(filePath);
-    if (!fileStream.is_open()) {
-        throw FileError("Error: Could not open file " + filePath);
-    }
-    std::stringstream buffer;
-    buffer << fileStream.rdbuf();
-    return buffer.str();
-}
-
-std::pair<size_t, size_t> getLineAndCol(const std::string& source, size_t pos) {
-    size_t line = 1;
-    size_t col = 1;
-    for (size_t i = 0; i < pos && i < source.length(); ++i) {
-        if (source[i] == '\n') {
-            line++;
-            col = 1;
-        } else {
-            col++;
-        }
-    }
-    return {line, col};
-}
-
-void printAffectedCode(const std::string& source, const SourceLocation& loc, const std::string& filePath) {
-    auto [line, col] = getLineAndCol(source, loc.StartPos);
+void printAffectedCode(const SourceBuffer& source, const SourceLocation& loc, const std::string& filePath) {
+    auto [line, col] = source.getLineAndCol(loc.StartPos);
     
     std::cout << filePath << ":" << line << ":" << col << std::endl;
 
-    size_t lineStart = source.rfind('\n', loc.StartPos);
-    if (lineStart == std::string::npos) {
+    std::string_view text = source.text();
+    size_t lineStart = text.rfind('\n', loc.StartPos);
+    if (lineStart == std::string_view::npos) {
         lineStart = 0;
     } else {
         lineStart += 1;
     }
 
-    size_t lineEnd = source.find('\n', loc.EndPos);
-    if (lineEnd == std::string::npos) {
-        lineEnd = source.length();
+    size_t lineEnd = text.find('\n', loc.EndPos);
+    if (lineEnd == std::string_view::npos) {
+        lineEnd = text.length();
     }
 
-    std::string affectedCode = source.substr(lineStart, lineEnd - lineStart);
+    std::string_view affectedCode = text.substr(lineStart, lineEnd - lineStart);
     std::cout << affectedCode << std::endl;
 
     size_t currentLineStart = lineStart;
@@ -77,30 +57,80 @@ void printAffectedCode(const std::string& source, const SourceLocation& loc, con
     std::cout << std::endl;
 }
 
+void printAffectedCode(const ModuleLoader& loader, const SourceLocation& loc, const std::string& fallbackPath) {
+    if (const SourceModule* module = loader.findModule(loc.StartPos)) {
+        SourceLocation localLoc {loc.StartPos - module->BaseOffset, loc.EndPos - module->BaseOffset};
+        printAffectedCode(module->Source, localLoc, module->Path.string());
+        return;
+    }
+    // A location outside every loaded file has no source text to show.
+    std::cout << fallbackPath << std::endl;
+}
 
-std::unique_ptr<InterpreterValue> runFile(char file[]) {
-    std::string filePath = file;
-    std::string sourceCode = readFile(filePath);
 
-    Parser parser(sourceCode);
-    Context globalContext;
+std::unique_ptr<InterpreterValue> runFile(char file[], ModuleLoader& loader, const std::vector<long>& inputs, bool flatAst,
+                                          size_t inlineThreshold, bool eliminateRedundancy) {
+    SourceModule& root = loader.load(file);
 
-    while (parser.get().Kind == TokenKind::Fn) {
-        auto func = parser.parseFunction();
-        if (!func) {
-            throw ParserException("Parsing failed while defining a function.", SourceLocation{0, 0});
+    // Interning shares the repeated subtrees of parsed and rewritten code.
+    PassManager passes;
+    passes.addPass(std::make_unique<InternPass>());
+    if (inlineThreshold > 0) {
+        passes.addPass(std::make_unique<InlinePass>(inlineThreshold));
+    }
+    if (eliminateRedundancy) {
+        passes.addPass(std::make_unique<GuardEliminationPass>());
+        passes.addPass(std::make_unique<CommonSubexpressionPass>());
+    }
+
+    Context globalContext;
+    FlatAst flat;
+    std::vector<FlatFunction> flatFunctions;
+    std::unordered_map<Symbol, const SourceModule*> definingModules;
+
+    // Passes only look at one module, so each is parsed, optimized and,
+    // for the flat form, flattened and dropped before the next is parsed.
+    for (SourceModule* module : loader.getModules()) {
+        loader.parse(*module);
+        passes.run(module->Functions, module->IsRoot ? &module->MainExpr : nullptr);
+        for (auto& func : module->Functions) {
+            Symbol name = func->getPrototype()->getName();
+            auto defined = definingModules.find(name);
+            if (defined != definingModules.end() && defined->second != module) {
+                throw ParserException("Function '" + name.str() + "' is already defined in module '" + defined->second->Name + "'", func->getPrototype()->getLocation());
+            }
+            definingModules[name] = module;
+            if (flatAst) {
+                flatFunctions.push_back(flat.add(*func));
+                func.reset();
+            } else {
+                globalContext.addFunction(std::move(func));
+            }
         }
-        globalContext.addFunction(std::move(func));
+        module->Functions.clear();
     }
-    
-    auto resultExpr = parser.parseExpression();
 
-    if (!resultExpr) {
-        throw ParserException("Parsing failed for the main expression.", parser.get().Location);
+    const auto& resultExpr = root.MainExpr;
+
+    if (inputs.size() != root.MainInputs.size()) {
+        throw InterpreterException("Program expects " + std::to_string(root.MainInputs.size()) + " inputs, got " + std::to_string(inputs.size()), resultExpr->getLocation());
+    }
+
+    std::unique_ptr<InterpreterValue> result;
+    if (flatAst) {
+        FlatNodeId mainNode = flat.add(*resultExpr);
+        FlatInterpreter interpreter(flat, flatFunctions);
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            interpreter.setValue(root.MainInputs[i].Name, std::make_unique<InterpreterValueLong>(inputs[i]));
+        }
+        result = interpreter.eval(mainNode);
+    } else {
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            globalContext.setValue(root.MainInputs[i].Name, std::make_unique<InterpreterValueLong>(inputs[i]));
+        }
+        Interpreter interpreter = Interpreter(globalContext);
+        result = interpreter.eval(*resultExpr);
     }
-    
-    Interpreter interpreter = Interpreter(globalContext);
-    std::unique_ptr<InterpreterValue> result = interpreter.eval(*resultExpr);
 
     if (result) {
         if (dynamic_cast<InterpreterValueLong*>(result.get()) || dynamic_cast<InterpreterValueBool*>(result.get())) {
@@ -114,9 +144,14 @@ std::unique_ptr<InterpreterValue> runFile(char file[]) {
 }
 
 
-int runFileAndPrint(char file[]) {
+int runFileAndPrint(char file[], const std::vector<std::filesystem::path>& importPaths, const std::vector<long>& inputs, const RunOptions& options) {
+    ModuleLoader loader(importPaths, true, options.LazyBodies);
+    if (options.AstCacheDir) {
+        loader.setAstCache(*options.AstCacheDir);
+    }
     try {
-        std::unique_ptr<InterpreterValue> result = runFile(file);
+        std::unique_ptr<InterpreterValue> result = runFile(file, loader, inputs, options.FlatAst, options.LazyBodies ? 0 : options.InlineThreshold,
+                                                                 !options.LazyBodies && options.EliminateRedundancy);
         if (result) {
             if (auto longResult = dynamic_cast<InterpreterValueLong*>(result.get())) {
                 std::cout << "Execution result: " << longResult->getValue() << std::endl;
@@ -126,30 +161,15 @@ int runFileAndPrint(char file[]) {
         }
     } catch (const LexerException& e) {
         std::cerr << "Lexer Error: " << e.what() << std::endl;
-        try {
-            std::string sourceCode = readFile(file);
-            printAffectedCode(sourceCode, e.Location, file);
-        } catch (const std::exception& fileE) {
-            std::cerr << "Could not read file for error display: " << fileE.what() << std::endl;
-        }
+        printAffectedCode(loader, e.Location, file);
         return 1;
     } catch (const ParserException& e) {
         std::cerr << "Parser Error: " << e.what() << std::endl;
-        try {
-            std::string sourceCode = readFile(file);
-            printAffectedCode(sourceCode, e.Location, file);
-        } catch (const std::exception& fileE) {
-            std::cerr << "Could not read file for error display: " << fileE.what() << std::endl;
-        }
+        printAffectedCode(loader, e.Location, file);
         return 1;
     } catch (const InterpreterException& e) {
         std::cerr << "Runtime Error: " << e.what() << std::endl;
-        try {
-            std::string sourceCode = readFile(file);
-            printAffectedCode(sourceCode, e.Location, file);
-        } catch (const std::exception& fileE) {
-            std::cerr << "Could not read file for error display: " << fileE.what() << std::endl;
-        }
+        printAffectedCode(loader, e.Location, file);
         return 1;
     } catch (const std::exception& e) {
         std::cerr << "Fatal Error: " << e.what() << std::endl;
@@ -3,7 +3,11 @@
 
 #include <string>
 #include <memory>
+#include <filesystem>
+#include <optional>
+#include <vector>
 #include "interpreter.hpp"
+#include "module_loader.hpp"
 
 class FileError : public std::runtime_error {
 public:
@@ -11,11 +15,31 @@ public:
 };
 
 
-std::string readFile(const std::string& filePath);
-std::pair<size_t, size_t> getLineAndCol(const std::string& source, size_t pos);
-void printAffectedCode(const std::string& source, const SourceLocation& loc, const std::string& filePath);
-std::unique_ptr<InterpreterValue> runFile(char file[]);
-int runFileAndPrint(char file[]);
+struct RunOptions {
+    // Run the program with FlatInterpreter instead of Interpreter.
+    bool FlatAst = false;
+    // Only parse function bodies once they are called.
+    bool LazyBodies = false;
+    // Reuse parsed modules from this directory, see AstCache.
+    std::optional<std::filesystem::path> AstCacheDir;
+    // Largest function body inlined into its callers, see InlinePass; 0
+    // disables inlining. Lazy bodies are never inlined, since that would
+    // need all of them parsed.
+    size_t InlineThreshold = 30;
+    // Drop match guards implied by earlier ones and evaluate repeated pure
+    // subexpressions once, see GuardEliminationPass and
+    // CommonSubexpressionPass. Not done for lazy bodies either.
+    bool EliminateRedundancy = true;
+};
+
+void printAffectedCode(const SourceBuffer& source, const SourceLocation& loc, const std::string& filePath);
+void printAffectedCode(const ModuleLoader& loader, const SourceLocation& loc, const std::string& fallbackPath);
+// With flatAst the program is run by FlatInterpreter instead of Interpreter.
+// Small functions are inlined unless inlineThreshold is 0, and redundant
+// guards and subexpressions eliminated with eliminateRedundancy.
+std::unique_ptr<InterpreterValue> runFile(char file[], ModuleLoader& loader, const std::vector<long>& inputs = {}, bool flatAst = false,
+                                          size_t inlineThreshold = 0, bool eliminateRedundancy = false);
+int runFileAndPrint(char file[], const std::vector<std::filesystem::path>& importPaths = {}, const std::vector<long>& inputs = {}, const RunOptions& options = {});
 
 
 #endif
\ No newline at end of file
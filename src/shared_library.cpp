@@ -0,0 +1,135 @@
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+
+#include "shared_library.hpp"
+#include "runner.hpp"
+
+static void emitObjectFile(llvm::Module& module, const std::string& objectPath) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    std::string error;
+    const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+    if (!target) {
+        throw FileError("Error: No code generator for " + triple + ": " + error);
+    }
+
+    std::unique_ptr<llvm::TargetMachine> machine(target->createTargetMachine(
+        triple, "generic", "", llvm::TargetOptions(), llvm::Reloc::PIC_));
+    module.setTargetTriple(triple);
+    module.setDataLayout(machine->createDataLayout());
+    module.setPICLevel(llvm::PICLevel::BigPIC);
+
+    std::error_code ec;
+    llvm::ToolOutputFile out(objectPath, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        throw FileError("Error: Could not open file " + objectPath + ": " + ec.message());
+    }
+
+    llvm::legacy::PassManager passes;
+    if (machine->addPassesToEmitFile(passes, out.os(), nullptr, llvm::CGFT_ObjectFile)) {
+        throw FileError("Error: Cannot emit object files for " + triple);
+    }
+    passes.run(module);
+    out.os().flush();
+    out.keep();
+}
+
+void emitSharedLibrary(llvm::Module& module, const std::string& outputPath) {
+    std::string objectPath = outputPath + ".o";
+    emitObjectFile(module, objectPath);
+
+    auto linker = llvm::sys::findProgramByName("cc");
+    if (!linker) {
+        std::filesystem::remove(objectPath);
+        throw FileError("Error: Could not find the system C compiler 'cc' to link " + outputPath);
+    }
+
+    std::vector<llvm::StringRef> args = {*linker, "-shared", "-o", outputPath, objectPath};
+    std::string error;
+    int status = llvm::sys::ExecuteAndWait(*linker, args, std::nullopt, {}, 0, 0, &error);
+    std::filesystem::remove(objectPath);
+    if (status != 0) {
+        throw FileError("Error: Linking " + outputPath + " failed" + (error.empty() ? "" : ": " + error));
+    }
+}
+
+bool isValidCIdentifier(const std::string& name) {
+    static const std::set<std::string> keywords = {
+        "_Alignas", "_Alignof", "_Atomic", "_Bool", "_Complex", "_Generic", "_Imaginary", "_Noreturn",
+        "_Static_assert", "_Thread_local", "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand",
+        "bitor", "bool", "break", "case", "catch", "char", "char8_t", "char16_t", "char32_t", "class",
+        "compl", "concept", "const", "const_cast", "consteval", "constexpr", "constinit", "continue",
+        "co_await", "co_return", "co_yield", "decltype", "default", "delete", "do", "double",
+        "dynamic_cast", "else", "enum", "explicit", "export", "extern", "false", "float", "for", "friend",
+        "goto", "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept", "not", "not_eq",
+        "nullptr", "operator", "or", "or_eq", "private", "protected", "public", "register",
+        "reinterpret_cast", "requires", "restrict", "return", "short", "signed", "sizeof", "static",
+        "static_assert", "static_cast", "struct", "switch", "template", "this", "thread_local", "throw",
+        "true", "try", "typedef", "typeid", "typename", "typeof", "union", "unsigned", "using", "virtual",
+        "void", "volatile", "wchar_t", "while", "xor", "xor_eq",
+    };
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0]))) {
+        return false;
+    }
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') {
+            return false;
+        }
+    }
+    return !keywords.count(name);
+}
+
+void writeCHeader(const std::string& headerPath, const std::vector<const AstFunction*>& functions,
+                  const std::string& symbolPrefix, const std::string& sourceName) {
+    std::string guard;
+    for (char c : std::filesystem::path(headerPath).filename().string()) {
+        guard += std::isalnum(static_cast<unsigned char>(c)) ? std::toupper(static_cast<unsigned char>(c)) : '_';
+    }
+    if (guard.empty() || std::isdigit(static_cast<unsigned char>(guard[0]))) {
+        guard = "LANG_" + guard;
+    }
+
+    std::ofstream header(headerPath);
+    if (!header.is_open()) {
+        throw FileError("Error: Could not open file " + headerPath);
+    }
+
+    header << "// Generated by the fun-lang compiler from " << sourceName << ". Do not edit.\n"
+           << "#ifndef " << guard << "\n"
+           << "#define " << guard << "\n\n"
+           << "#include <stdint.h>\n\n"
+           << "#ifdef __cplusplus\n"
+           << "extern \"C\" {\n"
+           << "#endif\n\n";
+
+    for (const AstFunction* func : functions) {
+        header << "int64_t " << symbolPrefix << func->getPrototype()->getName() << "(";
+        const auto& args = func->getPrototype()->getArgs();
+        if (args.empty()) {
+            header << "void";
+        }
+        for (size_t i = 0; i < args.size(); ++i) {
+            header << (i > 0 ? ", " : "") << "int64_t /* " << args[i].Name << " */";
+        }
+        header << ");\n";
+    }
+
+    header << "\n#ifdef __cplusplus\n"
+           << "}\n"
+           << "#endif\n\n"
+           << "#endif\n";
+}
@@ -0,0 +1,26 @@
+#ifndef SHARED_LIBRARY_HPP
+#define SHARED_LIBRARY_HPP
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Module.h"
+
+#include "ast.hpp"
+
+// Compiles the module for the host and links it into a shared library with
+// the system C compiler driver.
+void emitSharedLibrary(llvm::Module& module, const std::string& outputPath);
+
+// Whether name can be declared in a C or C++ header: an identifier that is
+// no keyword of either language.
+bool isValidCIdentifier(const std::string& name);
+
+// Writes a C/C++ header declaring the given functions under their exported
+// symbol names, <symbolPrefix><name>, which have to be valid C identifiers.
+// Every argument and result is an int64_t. Parameters are left unnamed, as
+// their names may be C keywords; they are kept in comments.
+void writeCHeader(const std::string& headerPath, const std::vector<const AstFunction*>& functions,
+                  const std::string& symbolPrefix, const std::string& sourceName);
+
+#endif
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source_buffer.hpp"
+#include "runner.hpp"
+
+SourceBuffer::SourceBuffer(SourceBuffer&& other) noexcept
+    : Mapped(std::exchange(other.Mapped, nullptr)),
+      MappedSize(std::exchange(other.MappedSize, 0)),
+      Owned(std::move(other.Owned)),
+      LineStarts(std::move(other.LineStarts)) {}
+
+SourceBuffer& SourceBuffer::operator=(SourceBuffer&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        Mapped = std::exchange(other.Mapped, nullptr);
+        MappedSize = std::exchange(other.MappedSize, 0);
+        Owned = std::move(other.Owned);
+        LineStarts = std::move(other.LineStarts);
+    }
+    return *this;
+}
+
+SourceBuffer::~SourceBuffer() {
+    unmap();
+}
+
+void SourceBuffer::unmap() {
+    if (Mapped) {
+        munmap(const_cast<char*>(Mapped), MappedSize);
+        Mapped = nullptr;
+        MappedSize = 0;
+    }
+}
+
+SourceBuffer SourceBuffer::fromFile(const std::string& filePath) {
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw FileError("Error: Could not open file " + filePath);
+    }
+
+    SourceBuffer buffer;
+    struct stat info;
+    // An empty file cannot be mapped, and is simply an empty buffer.
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        size_t size = static_cast<size_t>(info.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            // The lexer reads the file once from front to back.
+            madvise(mapping, size, MADV_SEQUENTIAL);
+            buffer.Mapped = static_cast<const char*>(mapping);
+            buffer.MappedSize = size;
+            close(fd);
+            return buffer;
+        }
+    }
+    close(fd);
+
+    std::ifstream fileStream(filePath, std::ios::binary);
+    if (!fileStream.is_open()) {
+        throw FileError("Error: Could not open file " + filePath);
+    }
+    buffer.Owned.assign(std::istreambuf_iterator<char>(fileStream), std::istreambuf_iterator<char>());
+    if (fileStream.bad()) {
+        throw FileError("Error: Could not read file " + filePath);
+    }
+    return buffer;
+}
+
+std::pair<size_t, size_t> SourceBuffer::getLineAndCol(size_t pos) const {
+    std::string_view source = text();
+    if (LineStarts.empty()) {
+        LineStarts.push_back(0);
+        const char* begin = source.data();
+        const char* end = begin + source.size();
+        for (const char* p = begin; p < end; ++p) {
+            p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+            if (!p) break;
+            LineStarts.push_back(p - begin + 1);
+        }
+    }
+
+    pos = std::min(pos, source.size());
+    auto lineIt = std::upper_bound(LineStarts.begin(), LineStarts.end(), pos) - 1;
+    return {static_cast<size_t>(lineIt - LineStarts.begin()) + 1, pos - *lineIt + 1};
+}
@@ -0,0 +1,46 @@
+#ifndef SOURCE_BUFFER_HPP
+#define SOURCE_BUFFER_HPP
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The text of one source file. Regular files are mapped read-only instead of
+// copied, so the lexer, error messages and debug info all work on the same
+// single copy of the file.
+class SourceBuffer {
+    // Points into the mapping, or is null when the text lives in Owned.
+    const char* Mapped = nullptr;
+    size_t MappedSize = 0;
+    // Files that cannot be mapped, like pipes, and in-memory sources.
+    std::string Owned;
+    // Offset of the first character of each line, built on the first lookup.
+    mutable std::vector<size_t> LineStarts;
+
+    void unmap();
+public:
+    SourceBuffer() = default;
+    explicit SourceBuffer(std::string text) : Owned(std::move(text)) {}
+    SourceBuffer(SourceBuffer&& other) noexcept;
+    SourceBuffer& operator=(SourceBuffer&& other) noexcept;
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+    ~SourceBuffer();
+
+    // Throws FileError if the file cannot be opened or read.
+    static SourceBuffer fromFile(const std::string& filePath);
+
+    std::string_view text() const {
+        return Mapped ? std::string_view(Mapped, MappedSize) : std::string_view(Owned);
+    }
+    size_t size() const {
+        return Mapped ? MappedSize : Owned.size();
+    }
+
+    // 1-based line and column of a position in the text. Positions past the
+    // end are clamped to it. Not safe to call concurrently with itself.
+    std::pair<size_t, size_t> getLineAndCol(size_t pos) const;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "specializer.hpp"
+#include "ast_rewriter.hpp"
+#include "ast_walker.hpp"
+#include "const_eval.hpp"
+
+namespace {
+
+class NodeCounter : public AstWalker {
+public:
+    size_t Count = 0;
+
+    void walk(const AstExpr& expr) override {
+        ++Count;
+        AstWalker::walk(expr);
+    }
+};
+
+// Replaces the parameters bound to literals, unless a let shadows them.
+class ParameterSubstituter : public AstRewriter {
+    std::unordered_map<Symbol, const AstExpr*> Bindings;
+public:
+    explicit ParameterSubstituter(std::unordered_map<Symbol, const AstExpr*> bindings) : Bindings(std::move(bindings)) {}
+
+    using AstRewriter::visit;
+
+    void visit(const AstExprVariable& expr) override {
+        auto it = Bindings.find(expr.getName());
+        Result = it != Bindings.end() ? it->second->clone() : expr.clone();
+    }
+
+    void visit(const AstExprLetIn& expr) override {
+        auto value = rewrite(*expr.getExpr());
+        auto shadowed = Bindings.find(expr.getVariable());
+        const AstExpr* binding = nullptr;
+        if (shadowed != Bindings.end()) {
+            binding = shadowed->second;
+            Bindings.erase(shadowed);
+        }
+        auto body = rewrite(*expr.getBody());
+        if (binding) {
+            Bindings[expr.getVariable()] = binding;
+        }
+        Result = std::make_unique<AstExprLetIn>(expr.getLocation(), expr.getVariable(), std::move(value), std::move(body));
+    }
+};
+
+// Drops match arms that can never be taken and collapses a match whose
+// first remaining guard always holds.
+class MatchSimplifier : public AstRewriter {
+public:
+    using AstRewriter::visit;
+
+    void visit(const AstExprMatch& expr) override {
+        std::vector<AstExprMatchPathPtr> paths;
+        for (const auto& path : expr.getPaths()) {
+            auto guard = rewrite(*path->getGuard());
+            auto constGuard = guard->getKind() == AstExprKind::ConstBool ? static_cast<const AstExprConstBool*>(guard.get()) : nullptr;
+            if (constGuard && !constGuard->getValue()) continue;
+
+            auto body = rewrite(*path->getBody());
+            if (paths.empty() && constGuard) {
+                Result = std::move(body);
+                return;
+            }
+            paths.push_back(std::make_unique<AstExprMatchPath>(path->getLocation(), std::move(guard), std::move(body)));
+        }
+        // Without any arm left the match fails at runtime, so keep it as is.
+        if (paths.empty()) {
+            AstRewriter::visit(expr);
+            return;
+        }
+        Result = std::make_unique<AstExprMatch>(expr.getLocation(), std::move(paths));
+    }
+};
+
+const AstExpr* asLiteral(const AstExpr& expr) {
+    if (expr.getKind() == AstExprKind::ConstLong || expr.getKind() == AstExprKind::ConstBool) {
+        return &expr;
+    }
+    return nullptr;
+}
+
+std::string literalName(const AstExpr& literal) {
+    if (literal.getKind() == AstExprKind::ConstLong) {
+        return std::to_string(static_cast<const AstExprConstLong&>(literal).getValue());
+    }
+    return static_cast<const AstExprConstBool&>(literal).getValue() ? "true" : "false";
+}
+
+}
+
+size_t countNodes(const AstExpr& expr) {
+    NodeCounter counter;
+    counter.walk(expr);
+    return counter.Count;
+}
+
+class FunctionSpecializer::CallSiteRewriter : public AstRewriter {
+    FunctionSpecializer& Specializer;
+public:
+    explicit CallSiteRewriter(FunctionSpecializer& specializer) : Specializer(specializer) {}
+
+    using AstRewriter::visit;
+
+    void visit(const AstExprCall& expr) override {
+        std::vector<AstExprPtr> args;
+        std::vector<const AstExpr*> literals;
+        for (const auto& arg : expr.getArgs()) {
+            args.push_back(rewrite(*arg));
+            literals.push_back(asLiteral(*args.back()));
+        }
+
+        bool anyLiteral = std::any_of(literals.begin(), literals.end(), [](const AstExpr* arg) { return arg != nullptr; });
+        std::optional<std::string> clone;
+        if (anyLiteral) {
+            clone = Specializer.specialize(expr.getCallee(), literals);
+        }
+        if (!clone) {
+            Result = args == expr.getArgs() ? expr.clone() : std::make_unique<AstExprCall>(expr.getLocation(), expr.getCallee(), std::move(args));
+            return;
+        }
+
+        std::vector<AstExprPtr> remaining;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (!literals[i]) {
+                remaining.push_back(std::move(args[i]));
+            }
+        }
+        Result = std::make_unique<AstExprCall>(expr.getLocation(), *clone, std::move(remaining));
+    }
+};
+
+FunctionSpecializer::FunctionSpecializer(const Context& functions, size_t budget, uint64_t fuel, size_t maxCallDepth)
+    : Functions(functions), Fuel(fuel), MaxCallDepth(maxCallDepth), Budget(budget) {}
+
+AstExprPtr FunctionSpecializer::rewriteCallSites(const AstExpr& expr) {
+    CallSiteRewriter rewriter(*this);
+    return rewriter.rewrite(expr);
+}
+
+std::optional<std::string> FunctionSpecializer::specialize(Symbol callee, const std::vector<const AstExpr*>& args) {
+    const AstFunction* func = Functions.getFunction(callee);
+    // A function is defined only after its own body, so a clone placed
+    // before it must not fall back to calling it.
+    if (!func || callee == CurrentFunction || func->getPrototype()->getArgs().size() != args.size()) {
+        return std::nullopt;
+    }
+
+    std::string name = callee.str();
+    for (const AstExpr* arg : args) {
+        name += "." + (arg ? literalName(*arg) : "_");
+    }
+
+    auto existing = Specializations.find(name);
+    if (existing != Specializations.end()) {
+        // A clone still being built is only defined for calls from itself.
+        bool building = std::find(InProgress.begin(), InProgress.end(), name) != InProgress.end();
+        if (building && InProgress.back() != name) {
+            return std::nullopt;
+        }
+        return existing->second;
+    }
+
+    const AstPrototype* proto = func->getPrototype();
+    std::unordered_map<Symbol, const AstExpr*> bindings;
+    std::vector<AstArg> remainingArgs;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i]) {
+            bindings[proto->getArgs()[i].Name] = args[i];
+        } else {
+            remainingArgs.push_back(proto->getArgs()[i]);
+        }
+    }
+
+    ParameterSubstituter substituter(std::move(bindings));
+    ConstantEvaluator evaluator(Functions, Fuel, MaxCallDepth);
+    MatchSimplifier simplifier;
+    auto body = simplifier.rewrite(*evaluator.rewrite(*substituter.rewrite(*func->getBody())));
+
+    size_t size = countNodes(*body);
+    if (size > Budget) {
+        Specializations[name] = std::nullopt;
+        return std::nullopt;
+    }
+    Budget -= size;
+    Specializations[name] = name;
+
+    InProgress.push_back(name);
+    body = rewriteCallSites(*body);
+    InProgress.pop_back();
+
+    Output.push_back(std::make_unique<AstFunction>(
+        func->getLocation(),
+        std::make_unique<AstPrototype>(proto->getLocation(), name, std::move(remainingArgs)),
+        std::move(body)
+    ));
+    Output.back()->setInternal(true);
+    return name;
+}
+
+void FunctionSpecializer::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr) {
+    std::vector<std::unique_ptr<AstFunction>> result;
+    for (auto& func : functions) {
+        CurrentFunction = func->getPrototype()->getName();
+        auto body = rewriteCallSites(*func->getBody());
+
+        std::move(Output.begin(), Output.end(), std::back_inserter(result));
+        Output.clear();
+        result.push_back(func->withBody(std::move(body)));
+    }
+
+    CurrentFunction = Symbol();
+    if (mainExpr && *mainExpr) {
+        *mainExpr = rewriteCallSites(**mainExpr);
+        std::move(Output.begin(), Output.end(), std::back_inserter(result));
+        Output.clear();
+    }
+    functions = std::move(result);
+}
+
+SpecializationPass::SpecializationPass(size_t budget, uint64_t fuel, size_t maxCallDepth)
+    : Budget(budget), Fuel(fuel), MaxCallDepth(maxCallDepth) {}
+
+bool SpecializationPass::run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr,
+                             AnalysisManager& analyses) {
+    (void) analyses;
+    Context functionContext;
+    std::vector<const AstExpr*> bodies;
+    for (const auto& func : functions) {
+        functionContext.addFunction(func->clone());
+        bodies.push_back(func->getBody());
+    }
+    const AstExpr* main = mainExpr ? mainExpr->get() : nullptr;
+
+    FunctionSpecializer specializer(functionContext, Budget, Fuel, MaxCallDepth);
+    specializer.run(functions, mainExpr);
+
+    bool changed = functions.size() != bodies.size() || (mainExpr && mainExpr->get() != main);
+    for (size_t i = 0; !changed && i < functions.size(); ++i) {
+        changed = functions[i]->getBody() != bodies[i];
+    }
+    return changed;
+}
@@ -0,0 +1,61 @@
+#ifndef SPECIALIZER_HPP
+#define SPECIALIZER_HPP
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "ast.hpp"
+#include "interpreter.hpp"
+#include "pass_manager.hpp"
+
+// Number of expression nodes in a function body, the code size measure used
+// by the specializer's budget.
+size_t countNodes(const AstExpr& expr);
+
+// Clones functions for call sites that pass literal arguments, e.g.
+// power(x, 3) becomes a call to power._.3(x). The literals are substituted
+// into the clone, which is then simplified by compile-time evaluation and by
+// dropping match arms whose guard became a constant. Calls in the simplified
+// clone are specialized in turn until the budget of cloned nodes runs out.
+class FunctionSpecializer {
+    const Context& Functions;
+    uint64_t Fuel;
+    size_t MaxCallDepth;
+    size_t Budget;
+
+    std::map<std::string, std::optional<std::string>> Specializations;
+    std::vector<std::string> InProgress;
+    Symbol CurrentFunction;
+    std::vector<std::unique_ptr<AstFunction>> Output;
+
+    class CallSiteRewriter;
+    AstExprPtr rewriteCallSites(const AstExpr& expr);
+public:
+    // Only functions of the given context are specialized. Budget bounds the
+    // total number of nodes in all clones.
+    FunctionSpecializer(const Context& functions, size_t budget, uint64_t fuel, size_t maxCallDepth);
+
+    // Name of the clone of callee for the given arguments, which are null
+    // where they are not literals, if one exists or fits into the budget.
+    std::optional<std::string> specialize(Symbol callee, const std::vector<const AstExpr*>& args);
+
+    // Rewrites the call sites in a module. Clones are placed before the first
+    // function calling them, since code generation needs callees defined first.
+    void run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr);
+};
+
+// Runs a FunctionSpecializer over a module, cloning only its own functions.
+class SpecializationPass : public AstPass {
+    size_t Budget;
+    uint64_t Fuel;
+    size_t MaxCallDepth;
+public:
+    SpecializationPass(size_t budget, uint64_t fuel, size_t maxCallDepth);
+    bool run(std::vector<std::unique_ptr<AstFunction>>& functions, AstExprPtr* mainExpr, AnalysisManager& analyses) override;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "symbol.hpp"
+
+namespace {
+
+class SymbolTable {
+    std::shared_mutex Mutex;
+    // A deque keeps the names in place, so views and references stay valid.
+    std::deque<std::string> Names;
+    std::unordered_map<std::string_view, uint32_t> Ids;
+public:
+    SymbolTable() {
+        intern("");
+    }
+
+    uint32_t intern(std::string_view name) {
+        {
+            std::shared_lock lock(Mutex);
+            auto it = Ids.find(name);
+            if (it != Ids.end()) return it->second;
+        }
+        std::unique_lock lock(Mutex);
+        auto it = Ids.find(name);
+        if (it != Ids.end()) return it->second;
+        uint32_t id = static_cast<uint32_t>(Names.size());
+        Names.emplace_back(name);
+        Ids.emplace(Names.back(), id);
+        return id;
+    }
+
+    const std::string& name(uint32_t id) {
+        std::shared_lock lock(Mutex);
+        return Names[id];
+    }
+};
+
+SymbolTable& symbolTable() {
+    static SymbolTable table;
+    return table;
+}
+
+}
+
+Symbol::Symbol() : Id(0) {}
+
+Symbol::Symbol(std::string_view name) : Id(symbolTable().intern(name)) {}
+
+const std::string& Symbol::str() const {
+    return symbolTable().name(Id);
+}
+
+std::ostream& operator<<(std::ostream& out, Symbol symbol) {
+    return out << symbol.str();
+}
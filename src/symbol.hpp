@@ -0,0 +1,41 @@
+#ifndef SYMBOL_HPP
+#define SYMBOL_HPP
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+// An identifier interned into a process-wide table, so that comparing,
+// hashing and copying names is O(1). Interning is thread-safe. Ids depend on
+// the order names were first seen, so anything persisted or ordered has to
+// use str() instead.
+class Symbol {
+    uint32_t Id;
+public:
+    // The empty name.
+    Symbol();
+    Symbol(std::string_view name);
+    Symbol(const std::string& name) : Symbol(std::string_view(name)) {}
+    Symbol(const char* name) : Symbol(std::string_view(name)) {}
+
+    uint32_t getId() const { return Id; }
+    const std::string& str() const;
+
+    bool operator==(Symbol other) const { return Id == other.Id; }
+    bool operator!=(Symbol other) const { return Id != other.Id; }
+};
+
+std::ostream& operator<<(std::ostream& out, Symbol symbol);
+
+namespace std {
+template <>
+struct hash<Symbol> {
+    size_t operator()(Symbol symbol) const noexcept {
+        return hash<uint32_t>()(symbol.getId());
+    }
+};
+}
+
+#endif
@@ -0,0 +1,262 @@
+#include <optional>
+#include <set>
+#include <utility>
+
+#include "tail_recursion.hpp"
+#include "ast_rewriter.hpp"
+#include "ast_walker.hpp"
+
+namespace {
+
+using AddExpr = AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>;
+using MulExpr = AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>;
+using AndExpr = AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::And>;
+using OrExpr = AstExprBinaryBoolToBool<BinaryOpKindBoolToBool::Or>;
+
+// Operators that can be reassociated. Both engines evaluate both operands of
+// && and || and nothing has side effects, so all of them also commute.
+enum class AccumulatorOp { Add, Mul, And, Or };
+
+const Symbol AccumulatorName(".acc");
+
+std::optional<AccumulatorOp> accumulatorOp(const AstExpr& expr) {
+    if (dynamic_cast<const AddExpr*>(&expr)) return AccumulatorOp::Add;
+    if (dynamic_cast<const MulExpr*>(&expr)) return AccumulatorOp::Mul;
+    if (dynamic_cast<const AndExpr*>(&expr)) return AccumulatorOp::And;
+    if (dynamic_cast<const OrExpr*>(&expr)) return AccumulatorOp::Or;
+    return std::nullopt;
+}
+
+template <typename Node>
+std::pair<const AstExpr*, const AstExpr*> operandsOf(const AstExpr& expr) {
+    const auto& node = static_cast<const Node&>(expr);
+    return {node.getLHS(), node.getRHS()};
+}
+
+std::pair<const AstExpr*, const AstExpr*> operands(const AstExpr& expr, AccumulatorOp op) {
+    switch (op) {
+        case AccumulatorOp::Add: return operandsOf<AddExpr>(expr);
+        case AccumulatorOp::Mul: return operandsOf<MulExpr>(expr);
+        case AccumulatorOp::And: return operandsOf<AndExpr>(expr);
+        default: return operandsOf<OrExpr>(expr);
+    }
+}
+
+AstExprPtr makeOp(AccumulatorOp op, const SourceLocation& loc, AstExprPtr lhs, AstExprPtr rhs) {
+    switch (op) {
+        case AccumulatorOp::Add: return std::make_unique<AddExpr>(loc, std::move(lhs), std::move(rhs));
+        case AccumulatorOp::Mul: return std::make_unique<MulExpr>(loc, std::move(lhs), std::move(rhs));
+        case AccumulatorOp::And: return std::make_unique<AndExpr>(loc, std::move(lhs), std::move(rhs));
+        default: return std::make_unique<OrExpr>(loc, std::move(lhs), std::move(rhs));
+    }
+}
+
+AstExprPtr makeIdentity(AccumulatorOp op, const SourceLocation& loc) {
+    switch (op) {
+        case AccumulatorOp::Add: return std::make_unique<AstExprConstLong>(loc, 0L);
+        case AccumulatorOp::Mul: return std::make_unique<AstExprConstLong>(loc, 1L);
+        case AccumulatorOp::And: return std::make_unique<AstExprConstBool>(loc, true);
+        default: return std::make_unique<AstExprConstBool>(loc, false);
+    }
+}
+
+bool isCallTo(const AstExpr& expr, Symbol name) {
+    auto call = dynamic_cast<const AstExprCall*>(&expr);
+    return call && call->getCallee() == name;
+}
+
+// True if expr is a self-call, possibly nested in operands of op.
+bool accumulates(const AstExpr& expr, Symbol name, AccumulatorOp op) {
+    if (isCallTo(expr, name)) return true;
+    if (accumulatorOp(expr) != op) return false;
+    auto [lhs, rhs] = operands(expr, op);
+    return accumulates(*lhs, name, op) || accumulates(*rhs, name, op);
+}
+
+// Operators applied to self-calls in tail position.
+void collectTailOps(const AstExpr& expr, Symbol name, std::set<AccumulatorOp>& ops) {
+    if (auto match = dynamic_cast<const AstExprMatch*>(&expr)) {
+        for (const auto& path : match->getPaths()) {
+            collectTailOps(*path->getBody(), name, ops);
+        }
+    } else if (auto let = dynamic_cast<const AstExprLetIn*>(&expr)) {
+        collectTailOps(*let->getBody(), name, ops);
+    } else if (auto op = accumulatorOp(expr); op && accumulates(expr, name, *op)) {
+        ops.insert(*op);
+    }
+}
+
+// Whether expr evaluates to a value of the accumulator's type whenever it
+// succeeds, as the pending operation only type checks values of that type.
+bool hasAccumulatorType(const AstExpr& expr, AccumulatorOp op) {
+    switch (expr.getKind()) {
+        case AstExprKind::ConstLong:
+        case AstExprKind::Add:
+        case AstExprKind::Sub:
+        case AstExprKind::Mul:
+        case AstExprKind::Div:
+            return op == AccumulatorOp::Add || op == AccumulatorOp::Mul;
+        case AstExprKind::ConstBool:
+        case AstExprKind::Eq:
+        case AstExprKind::Neq:
+        case AstExprKind::Leq:
+        case AstExprKind::Lt:
+        case AstExprKind::Geq:
+        case AstExprKind::Gt:
+        case AstExprKind::And:
+        case AstExprKind::Or:
+            return op == AccumulatorOp::And || op == AccumulatorOp::Or;
+        default:
+            return false;
+    }
+}
+
+// True if every value returned without a self-call, which the helper
+// combines with the accumulator, provably has the accumulator's type.
+// Otherwise a base case like [1, 2] would fail in the rewritten function.
+bool tailValuesTyped(const AstExpr& expr, Symbol name, AccumulatorOp op) {
+    if (auto match = dynamic_cast<const AstExprMatch*>(&expr)) {
+        for (const auto& path : match->getPaths()) {
+            if (!tailValuesTyped(*path->getBody(), name, op)) return false;
+        }
+        return true;
+    }
+    if (auto let = dynamic_cast<const AstExprLetIn*>(&expr)) {
+        return tailValuesTyped(*let->getBody(), name, op);
+    }
+    if (isCallTo(expr, name)) return true;
+    if (accumulatorOp(expr) == op) {
+        auto [lhs, rhs] = operands(expr, op);
+        if (accumulates(*rhs, name, op)) return tailValuesTyped(*rhs, name, op);
+        if (accumulates(*lhs, name, op)) return tailValuesTyped(*lhs, name, op);
+    }
+    return hasAccumulatorType(expr, op);
+}
+
+// Self-calls with the wrong number of arguments are left to fail as written.
+class ArityChecker : public AstWalker {
+    Symbol Name;
+    size_t Arity;
+public:
+    bool Mismatch = false;
+
+    ArityChecker(Symbol name, size_t arity) : Name(name), Arity(arity) {}
+
+    using AstWalker::visit;
+
+    void visit(const AstExprCall& expr) override {
+        if (expr.getCallee() == Name && expr.getArgs().size() != Arity) {
+            Mismatch = true;
+        }
+        AstWalker::visit(expr);
+    }
+};
+
+// Builds the helper's body, in which every self-call goes to the helper.
+class AccumulatorRewriter : public AstRewriter {
+    Symbol Name;
+    Symbol Helper;
+    AccumulatorOp Op;
+
+    AstExprPtr callHelper(const AstExprCall& call, AstExprPtr acc) {
+        std::vector<AstExprPtr> args;
+        args.push_back(std::move(acc));
+        for (const auto& arg : call.getArgs()) {
+            args.push_back(rewrite(*arg));
+        }
+        return std::make_unique<AstExprCall>(call.getLocation(), Helper, std::move(args));
+    }
+public:
+    AccumulatorRewriter(Symbol name, Symbol helper, AccumulatorOp op)
+        : Name(name), Helper(helper), Op(op) {}
+
+    using AstRewriter::visit;
+
+    // Calls outside tail position start a fresh accumulation.
+    void visit(const AstExprCall& expr) override {
+        if (expr.getCallee() != Name) {
+            AstRewriter::visit(expr);
+            return;
+        }
+        Result = callHelper(expr, makeIdentity(Op, expr.getLocation()));
+    }
+
+    // Returns acc op expr for an expression in tail position, moving the
+    // operands of self-calls into the accumulator.
+    AstExprPtr accumulate(const AstExpr& expr, AstExprPtr acc) {
+        if (auto match = dynamic_cast<const AstExprMatch*>(&expr)) {
+            std::vector<AstExprMatchPathPtr> paths;
+            for (const auto& path : match->getPaths()) {
+                auto guard = rewrite(*path->getGuard());
+                auto body = accumulate(*path->getBody(), acc);
+                paths.push_back(std::make_unique<AstExprMatchPath>(path->getLocation(), std::move(guard), std::move(body)));
+            }
+            return std::make_unique<AstExprMatch>(match->getLocation(), std::move(paths));
+        }
+        if (auto let = dynamic_cast<const AstExprLetIn*>(&expr)) {
+            auto value = rewrite(*let->getExpr());
+            auto body = accumulate(*let->getBody(), std::move(acc));
+            return std::make_unique<AstExprLetIn>(let->getLocation(), let->getVariable(), std::move(value), std::move(body));
+        }
+        if (isCallTo(expr, Name)) {
+            return callHelper(static_cast<const AstExprCall&>(expr), std::move(acc));
+        }
+        if (accumulatorOp(expr) == Op) {
+            auto [lhs, rhs] = operands(expr, Op);
+            if (accumulates(*rhs, Name, Op)) {
+                return accumulate(*rhs, makeOp(Op, expr.getLocation(), std::move(acc), rewrite(*lhs)));
+            }
+            if (accumulates(*lhs, Name, Op)) {
+                return accumulate(*lhs, makeOp(Op, expr.getLocation(), std::move(acc), rewrite(*rhs)));
+            }
+        }
+        return makeOp(Op, expr.getLocation(), std::move(acc), rewrite(expr));
+    }
+};
+
+}
+
+void introduceAccumulators(std::vector<std::unique_ptr<AstFunction>>& functions) {
+    std::vector<std::unique_ptr<AstFunction>> result;
+    for (auto& func : functions) {
+        // Lazy bodies never mention their own function, see parseLazyFunction.
+        if (!func->isBodyParsed()) {
+            result.push_back(std::move(func));
+            continue;
+        }
+        const AstPrototype* proto = func->getPrototype();
+        Symbol name = proto->getName();
+
+        std::set<AccumulatorOp> ops;
+        collectTailOps(*func->getBody(), name, ops);
+        ArityChecker arity(name, proto->getArgs().size());
+        arity.walk(*func->getBody());
+        // One accumulator can only carry one kind of pending operation.
+        if (ops.size() != 1 || arity.Mismatch || !tailValuesTyped(*func->getBody(), name, *ops.begin())) {
+            result.push_back(std::move(func));
+            continue;
+        }
+
+        AccumulatorOp op = *ops.begin();
+        Symbol helper(name.str() + ".acc");
+        const SourceLocation& loc = func->getLocation();
+
+        std::vector<AstArg> helperArgs{AstArg(loc, AccumulatorName)};
+        helperArgs.insert(helperArgs.end(), proto->getArgs().begin(), proto->getArgs().end());
+        AccumulatorRewriter rewriter(name, helper, op);
+        auto helperBody = rewriter.accumulate(*func->getBody(), std::make_unique<AstExprVariable>(loc, AccumulatorName));
+        result.push_back(std::make_unique<AstFunction>(
+            loc, std::make_unique<AstPrototype>(proto->getLocation(), helper, std::move(helperArgs)), std::move(helperBody)));
+        result.back()->setInternal(true);
+
+        std::vector<AstExprPtr> callArgs;
+        callArgs.push_back(makeIdentity(op, loc));
+        for (const AstArg& arg : proto->getArgs()) {
+            callArgs.push_back(std::make_unique<AstExprVariable>(arg.Location, arg.Name));
+        }
+        auto wrapperBody = std::make_unique<AstExprCall>(func->getBody()->getLocation(), helper, std::move(callArgs));
+        result.push_back(std::make_unique<AstFunction>(
+            loc, std::make_unique<AstPrototype>(proto->getLocation(), name, proto->getArgs()), std::move(wrapperBody)));
+    }
+    functions = std::move(result);
+}
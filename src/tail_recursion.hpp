@@ -0,0 +1,16 @@
+#ifndef TAIL_RECURSION_HPP
+#define TAIL_RECURSION_HPP
+
+#include <memory>
+#include <vector>
+
+#include "ast.hpp"
+
+// Rewrites functions that return an associative operation (+, *, &&, ||)
+// applied to a call of themselves, like n * factorial(n - 1), into a
+// tail-recursive helper f.acc that carries the pending operations in an
+// accumulator. f keeps its signature and calls the helper with the
+// operator's identity. Helpers are placed before the function they serve.
+void introduceAccumulators(std::vector<std::unique_ptr<AstFunction>>& functions);
+
+#endif
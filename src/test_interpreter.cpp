@@ -1,7 +1,24 @@
+#include <climits>
+#include <fstream>
 #include <stdexcept>
 #include <iostream>
 
+#include <unistd.h>
+
+#include "ast_analysis.hpp"
+#include "ast_cache.hpp"
+#include "ast_dispatch.hpp"
+#include "ast_interner.hpp"
+#include "const_eval.hpp"
+#include "cse.hpp"
+#include "guard_elimination.hpp"
+#include "inliner.hpp"
+#include "source_buffer.hpp"
 #include "interpreter.hpp"
+#include "flat_interpreter.hpp"
+#include "parallel_parser.hpp"
+#include "parser.hpp"
+#include "tail_recursion.hpp"
 #include "interpreter_exception.hpp"
 #include "tests.hpp"
 
@@ -27,6 +44,26 @@ bool getBoolResult(std::unique_ptr<InterpreterValue> result_val) {
     return result_bool_ptr->getValue();
 }
 
+// Parses a sequence of fn definitions.
+std::vector<std::unique_ptr<AstFunction>> parseFunctions(std::string_view source) {
+    TokenBuffer tokens(source);
+    Parser parser(tokens);
+    std::vector<std::unique_ptr<AstFunction>> functions;
+    while (parser.get().Kind == TokenKind::Fn) {
+        functions.push_back(parser.parseFunction());
+    }
+    return functions;
+}
+
+// A call of callee with literal arguments.
+AstExprCall makeCall(Symbol callee, const std::vector<long>& values) {
+    std::vector<AstExprPtr> args;
+    for (long value : values) {
+        args.push_back(std::make_shared<AstExprConstLong>(SourceLocation {0, 0}, value));
+    }
+    return AstExprCall(SourceLocation {0, 0}, callee, std::move(args));
+}
+
 
 
 std::unique_ptr<InterpreterValue> evaluateExpression(std::unique_ptr<AstExpr> expr) {
@@ -78,7 +115,7 @@ std::unique_ptr<InterpreterValue> evaluateExpression(std::unique_ptr<AstExpr> ex
         std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "n"),
         std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L)
     );
-    std::vector<std::unique_ptr<AstExpr>> factCallArgs;
+    std::vector<AstExprPtr> factCallArgs;
     factCallArgs.push_back(std::move(factRecurseArg));
     auto factRecurseCall = std::make_unique<AstExprCall>(SourceLocation {0, 0}, "factorial", std::move(factCallArgs));
     auto factMatchBody2 = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Mul>>(
@@ -87,7 +124,7 @@ std::unique_ptr<InterpreterValue> evaluateExpression(std::unique_ptr<AstExpr> ex
         std::move(factRecurseCall)
     );
     auto factMatchPath2 = std::make_unique<AstExprMatchPath>(SourceLocation {0, 0}, std::move(factMatchGuard2), std::move(factMatchBody2));
-    std::vector<std::unique_ptr<AstExprMatchPath>> factPaths;
+    std::vector<AstExprMatchPathPtr> factPaths;
     factPaths.push_back(std::move(factMatchPath1));
     factPaths.push_back(std::move(factMatchPath2));
     auto factorialBody = std::make_unique<AstExprMatch>(SourceLocation {0, 0}, std::move(factPaths));
@@ -165,7 +202,7 @@ TEST_CASE(NestedBinaryExpressions) {
 
 
 TEST_CASE(FunctionCall) {
-    std::vector<std::unique_ptr<AstExpr>> args;
+    std::vector<AstExprPtr> args;
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 12L));
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 34L));
     auto call_expr = std::make_unique<AstExprCall>(SourceLocation {0, 0}, "add", std::move(args));
@@ -185,7 +222,7 @@ TEST_CASE(LetIn) {
         std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 5L)
     );
 
-    std::vector<std::unique_ptr<AstExpr>> args;
+    std::vector<AstExprPtr> args;
     args.push_back(std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "x"));
     args.push_back(std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "y"));
 
@@ -242,11 +279,27 @@ TEST_CASE(DivisionByZero) {
     ASSERT_THROWS(interpreter.eval(*expr), DivisionByZeroException);
 }
 
+TEST_CASE(OverflowWrapsExceptInDivision) {
+    auto add = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(
+        SourceLocation {0, 0},
+        std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, LONG_MAX),
+        std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L)
+    );
+    ASSERT_EQ(LONG_MIN, getLongResult(evaluateExpression(std::move(add))));
+
+    auto div = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Div>>(
+        SourceLocation {0, 0},
+        std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, LONG_MIN),
+        std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, -1L)
+    );
+    Interpreter interpreter = Interpreter(Context());
+    ASSERT_THROWS(interpreter.eval(*div), DivisionOverflowException);
+}
+
 TEST_CASE(FunctionCallWithWrongNumberOfArguments) {
-    std::vector<std::unique_ptr<AstExpr>> args;
+    std::vector<AstExprPtr> args;
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 10L)); // missing one argument
     auto call_expr = std::make_unique<AstExprCall>(SourceLocation {0, 0}, "add", std::move(args));
-    Interpreter interpreter = Interpreter(Context());
     Context context;
     // Set up 'add' function again for local context testing
     auto addFuncBody = std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(SourceLocation {0, 0}, std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "x"), std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "y"));
@@ -254,6 +307,7 @@ TEST_CASE(FunctionCallWithWrongNumberOfArguments) {
     auto addFunc = std::make_unique<AstFunction>(SourceLocation {0, 0}, std::move(addFuncProto), std::move(addFuncBody));
     context.addFunction(std::move(addFunc));
 
+    Interpreter interpreter = Interpreter(context);
     ASSERT_THROWS(interpreter.eval(*call_expr), ArityMismatchException);
 }
 
@@ -264,7 +318,7 @@ TEST_CASE(UnknownVariable) {
 }
 
 TEST_CASE(UnknownFunction) {
-    std::vector<std::unique_ptr<AstExpr>> args;
+    std::vector<AstExprPtr> args;
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L));
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 2L));
     auto expr = std::make_unique<AstExprCall>(SourceLocation {0, 0}, "unknown_func", std::move(args));
@@ -392,12 +446,12 @@ TEST_CASE(LetInNestedFunctions) {
     auto exprX = std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 5L);
     auto exprY = std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 10L);
 
-    std::vector<std::unique_ptr<AstExpr>> argsAdd;
+    std::vector<AstExprPtr> argsAdd;
     argsAdd.push_back(std::make_unique<AstExprVariable>(SourceLocation{0, 0}, "x"));
     argsAdd.push_back(std::make_unique<AstExprVariable>(SourceLocation{0, 0}, "y"));
     auto addCall = std::make_unique<AstExprCall>(SourceLocation{0, 0}, "add", std::move(argsAdd));
 
-    std::vector<std::unique_ptr<AstExpr>> argsMult;
+    std::vector<AstExprPtr> argsMult;
     argsMult.push_back(std::move(addCall));
     argsMult.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 2L));
     auto multCall = std::make_unique<AstExprCall>(SourceLocation{0, 0}, "multiply", std::move(argsMult));
@@ -493,7 +547,7 @@ TEST_CASE(BooleanOr_TypeError) {
 }
 
 TEST_CASE(Match_FirstPathTrue) {
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
+    std::vector<AstExprMatchPathPtr> paths;
     paths.push_back(std::make_unique<AstExprMatchPath>(
         SourceLocation{0, 0},
         std::make_unique<AstExprConstBool>(SourceLocation{0, 0}, true),
@@ -510,7 +564,7 @@ TEST_CASE(Match_FirstPathTrue) {
 }
 
 TEST_CASE(Match_SecondPathTrue) {
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
+    std::vector<AstExprMatchPathPtr> paths;
     paths.push_back(std::make_unique<AstExprMatchPath>(
         SourceLocation{0, 0},
         std::make_unique<AstExprConstBool>(SourceLocation{0, 0}, false),
@@ -527,7 +581,7 @@ TEST_CASE(Match_SecondPathTrue) {
 }
 
 TEST_CASE(Match_NoPathTrue) {
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
+    std::vector<AstExprMatchPathPtr> paths;
     paths.push_back(std::make_unique<AstExprMatchPath>(
         SourceLocation{0, 0},
         std::make_unique<AstExprConstBool>(SourceLocation{0, 0}, false),
@@ -572,7 +626,7 @@ TEST_CASE(Match_WithLetInAndCalls) {
 
     auto path2 = std::make_unique<AstExprMatchPath>(SourceLocation{0, 0}, std::move(guard2), std::move(body2));
     
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
+    std::vector<AstExprMatchPathPtr> paths;
     paths.push_back(std::move(path1));
     paths.push_back(std::move(path2));
 
@@ -585,7 +639,7 @@ TEST_CASE(Match_WithLetInAndCalls) {
 }
 
 TEST_CASE(Match_NestedExpressions) {
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
+    std::vector<AstExprMatchPathPtr> paths;
     
     // Guard: (5L == 5L)
     auto guard1 = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>>(
@@ -618,7 +672,7 @@ TEST_CASE(Match_NestedExpressions) {
 
 
 TEST_CASE(Match_GuardTypeError) {
-    std::vector<std::unique_ptr<AstExprMatchPath>> paths;
+    std::vector<AstExprMatchPathPtr> paths;
     
     // Guard: 10L (should be bool)
     auto guard = std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 10L);
@@ -634,7 +688,7 @@ TEST_CASE(Match_GuardTypeError) {
 }
 
 TEST_CASE(Factorial) {
-    std::vector<std::unique_ptr<AstExpr>> args;
+    std::vector<AstExprPtr> args;
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 5L));
     auto call_expr = std::make_unique<AstExprCall>(SourceLocation{0, 0}, "factorial", std::move(args));
     long result = getLongResult(evaluateExpression(std::move(call_expr)));
@@ -642,7 +696,7 @@ TEST_CASE(Factorial) {
 }
 
 TEST_CASE(GoBackToOriginalContext) {
-    std::vector<std::unique_ptr<AstExpr>> args;
+    std::vector<AstExprPtr> args;
     args.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 5L));
     auto call_expr = std::make_unique<AstExprCall>(SourceLocation{0, 0}, "factorial", std::move(args));
 
@@ -662,7 +716,7 @@ TEST_CASE(GoBackToOriginalContext) {
 
 TEST_CASE(ArrayCreation) {
     // [10L, 20L, 30L]
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 10L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 20L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 30L));
@@ -682,7 +736,7 @@ TEST_CASE(ArrayCreation) {
 
 TEST_CASE(ArrayIndexing_Valid) {
     // Create array [100L, 200L, 300L]
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 100L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 200L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 300L));
@@ -701,7 +755,7 @@ TEST_CASE(ArrayIndexing_Valid) {
 
 TEST_CASE(ArrayIndexing_ExpressionIndexer) {
     // Array: [40L, 50L, 60L, 70L]
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 40L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 50L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 60L));
@@ -730,7 +784,7 @@ TEST_CASE(ArrayIndexing_ExpressionIndexer) {
 
 TEST_CASE(ArrayIndexing_OutOfBounds_High) {
     // Array: [1L, 2L] (Size 2)
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 1L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 2L));
     auto array_expr = std::make_unique<AstExprConstArray>(SourceLocation{0, 0}, std::make_unique<Long>(), std::move(elements));
@@ -748,7 +802,7 @@ TEST_CASE(ArrayIndexing_OutOfBounds_High) {
 
 TEST_CASE(ArrayIndexing_NegativeIndex) {
     // Array: [1L, 2L]
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 1L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 2L));
     auto array_expr = std::make_unique<AstExprConstArray>(SourceLocation{0, 0}, std::make_unique<Long>(), std::move(elements));
@@ -781,7 +835,7 @@ TEST_CASE(ArrayIndexing_Indexee_TypeError) {
 
 TEST_CASE(ArrayIndexing_Indexer_TypeError) {
     // Array: [1L, 2L]
-    std::vector<std::unique_ptr<AstExpr>> elements;
+    std::vector<AstExprPtr> elements;
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 1L));
     elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 2L));
     auto array_expr = std::make_unique<AstExprConstArray>(SourceLocation{0, 0}, std::make_unique<Long>(), std::move(elements));
@@ -797,6 +851,428 @@ TEST_CASE(ArrayIndexing_Indexer_TypeError) {
     ASSERT_THROWS(interpreter.eval(*expr), TypeMismatchException);
 }
 
+TEST_CASE(FuelLimitsEvaluationSteps) {
+    // Expression: 1L + (2L + 3L), five evaluation steps
+    auto makeExpr = []() {
+        return std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(
+            SourceLocation{0, 0},
+            std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 1L),
+            std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(
+                SourceLocation{0, 0},
+                std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 2L),
+                std::make_unique<AstExprConstLong>(SourceLocation{0, 0}, 3L)
+            )
+        );
+    };
+
+    Context context;
+    Interpreter limited(context);
+    limited.setFuel(4, 0);
+    ASSERT_THROWS(limited.eval(*makeExpr()), FuelExhaustedException);
+
+    Interpreter sufficient(context);
+    sufficient.setFuel(5, 0);
+    ASSERT_EQ(6L, getLongResult(sufficient.eval(*makeExpr())));
+}
+
+
+TEST_CASE(TailCallsRunInConstantStackSpace) {
+    // fn count(n, acc) { match { n == 0 -> acc; true -> count(n - 1, acc + 1) } }
+    std::vector<AstExprPtr> recurseArgs;
+    recurseArgs.push_back(std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Sub>>(SourceLocation {0, 0}, std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "n"), std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L)));
+    recurseArgs.push_back(std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(SourceLocation {0, 0}, std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "acc"), std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L)));
+
+    std::vector<AstExprMatchPathPtr> paths;
+    paths.push_back(std::make_unique<AstExprMatchPath>(SourceLocation {0, 0},
+        std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Eq>>(SourceLocation {0, 0}, std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "n"), std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 0L)),
+        std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "acc")));
+    paths.push_back(std::make_unique<AstExprMatchPath>(SourceLocation {0, 0},
+        std::make_unique<AstExprConstBool>(SourceLocation {0, 0}, true),
+        std::make_unique<AstExprCall>(SourceLocation {0, 0}, "count", std::move(recurseArgs))));
+
+    auto countProto = std::make_unique<AstPrototype>(SourceLocation {0, 0}, "count", std::vector<AstArg>{AstArg {SourceLocation {0, 0}, "n"}, AstArg {SourceLocation {0, 0}, "acc"}});
+    Context context;
+    context.addFunction(std::make_unique<AstFunction>(SourceLocation {0, 0}, std::move(countProto), std::make_unique<AstExprMatch>(SourceLocation {0, 0}, std::move(paths))));
+
+    std::vector<AstExprPtr> args;
+    args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1000000L));
+    args.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 0L));
+    auto call = std::make_unique<AstExprCall>(SourceLocation {0, 0}, "count", std::move(args));
+
+    // Far deeper than the interpreter's stack allows for non-tail calls.
+    Interpreter interpreter(context);
+    ASSERT_EQ(1000000L, getLongResult(interpreter.eval(*call)));
+}
+
+
+TEST_CASE(AccumulatorsOnlyForTypedBaseCases) {
+    auto functions = parseFunctions(
+        "fn fact(n) { match { n < 1 -> 1  true -> n * fact(n - 1) } } "
+        "fn pair(n) { match { n < 1 -> [1, 2]  true -> n * pair(n - 1) } }");
+    introduceAccumulators(functions);
+    // fact gets a helper; pair, whose base case is an array, stays as written.
+    ASSERT_EQ(size_t(3), functions.size());
+    ASSERT_EQ(true, functions[0]->isInternal());
+
+    Context context;
+    for (auto& func : functions) {
+        context.addFunction(std::move(func));
+    }
+    Interpreter interpreter(context);
+    ASSERT_EQ(120L, getLongResult(interpreter.eval(makeCall("fact", {5}))));
+    auto base = interpreter.eval(makeCall("pair", {0}));
+    ASSERT_EQ(true, (dynamic_cast<InterpreterValueArray*>(base.get()) != nullptr));
+}
+
+TEST_CASE(ConstantEvaluationSharesFuelPerExpression) {
+    auto functions = parseFunctions(
+        "fn spin(n) { match { n < 1 -> 0  true -> spin(n - 1) } } "
+        "fn f(x) { x + spin(20) + spin(20) + 2 * 3 } "
+        "fn g(x) { x + let y = 2 in y * 3 }");
+    Context context;
+    for (auto& func : functions) {
+        context.addFunction(std::move(func));
+    }
+    const AstFunction* f = context.getFunction("f");
+    const AstFunction* g = context.getFunction("g");
+
+    Interpreter interpreter(context);
+    interpreter.setFuel(1000000, 100);
+    interpreter.eval(makeCall("spin", {20}));
+    uint64_t cost = 1000000 - *interpreter.getRemainingFuel();
+
+    auto countKind = [](const AstExpr& body, AstExprKind kind) {
+        size_t count = 0;
+        std::function<void(const AstExpr&)> walk = [&](const AstExpr& expr) {
+            count += expr.getKind() == kind;
+            forEachChild(expr, walk);
+        };
+        walk(body);
+        return count;
+    };
+
+    // Fuel for one call: the second call and everything after it stay.
+    ConstantEvaluator limited(context, cost + cost / 2, 100);
+    auto body = limited.rewrite(*f->getBody());
+    ASSERT_EQ(size_t(1), countKind(*body, AstExprKind::Call));
+    ASSERT_EQ(size_t(1), countKind(*body, AstExprKind::Mul));
+
+    // The budget is renewed for the next expression.
+    body = limited.rewrite(*g->getBody());
+    ASSERT_EQ(size_t(0), countKind(*body, AstExprKind::LetIn));
+    ASSERT_EQ(size_t(1), countKind(*body, AstExprKind::ConstLong));
+
+    ConstantEvaluator sufficient(context, 3 * cost, 100);
+    body = sufficient.rewrite(*f->getBody());
+    ASSERT_EQ(size_t(0), countKind(*body, AstExprKind::Call));
+    ASSERT_EQ(size_t(0), countKind(*body, AstExprKind::Mul));
+}
+
+
+TEST_CASE(FlatAstEvaluation) {
+    // fn add(x, y) { x + y }  let x := 5 in add(x, [1, 2][1])
+    auto addProto = std::make_unique<AstPrototype>(SourceLocation {0, 0}, "add", std::vector<AstArg>{AstArg {SourceLocation {0, 0}, "x"}, AstArg {SourceLocation {0, 0}, "y"}});
+    AstFunction addFunc(SourceLocation {0, 0}, std::move(addProto), std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(SourceLocation {0, 0}, std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "x"), std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "y")));
+
+    std::vector<AstExprPtr> elements;
+    elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L));
+    elements.push_back(std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 2L));
+    std::vector<AstExprPtr> args;
+    args.push_back(std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "x"));
+    args.push_back(std::make_unique<AstExprIndex>(SourceLocation {0, 0}, std::make_unique<AstExprConstArray>(SourceLocation {0, 0}, std::make_unique<Any>(), std::move(elements)), std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L)));
+    auto expr = std::make_unique<AstExprLetIn>(SourceLocation {0, 0}, "x", std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 5L),
+        std::make_unique<AstExprCall>(SourceLocation {0, 0}, "add", std::move(args)));
+
+    FlatAst ast;
+    std::vector<FlatFunction> functions {ast.add(addFunc)};
+    FlatNodeId root = ast.add(*expr);
+    FlatInterpreter interpreter(ast, functions);
+    ASSERT_EQ(7L, getLongResult(interpreter.eval(root)));
+
+    // Expanding the flat form again gives an equivalent tree.
+    Context context;
+    context.addFunction(ast.toTree(functions[0]));
+    Interpreter treeInterpreter(context);
+    ASSERT_EQ(7L, getLongResult(treeInterpreter.eval(*ast.toTree(root))));
+}
+
+
+TEST_CASE(ParallelParsingKeepsSourceOrder) {
+    std::string source;
+    for (int i = 0; i < 1000; ++i) {
+        source += "fn f" + std::to_string(i) + "(a) { match { a == 0 -> 0  true -> a + " + std::to_string(i) + " } }\n";
+    }
+    TokenBuffer tokens(source);
+    size_t pos = 0;
+    auto functions = parseFunctionsInParallel(tokens, pos, 4);
+    ASSERT_EQ(size_t(1000), functions.size());
+    ASSERT_EQ(std::string("f999"), functions.back()->getPrototype()->getName().str());
+    ASSERT_EQ(tokens.size() - 1, pos);
+
+    // Stops at the first definition that does not parse, wherever the threads fail.
+    std::string valid = "fn f700(a) { match { a == 0 -> 0";
+    source.replace(source.find(valid), valid.size(), "fn f700(a) { match { a == 0 0");
+    TokenBuffer broken(source);
+    pos = 0;
+    functions = parseFunctionsInParallel(broken, pos, 4);
+    ASSERT_EQ(size_t(700), functions.size());
+    ASSERT_EQ(true, (broken.getKind(pos) == TokenKind::Fn));
+}
+
+
+TEST_CASE(LazyBodiesAreParsedOnFirstCall) {
+    TokenBuffer tokens("fn used(a) { a + 1 } fn broken(a) { a + } fn count(n) { match { n == 0 -> 0  true -> count(n - 1) } }");
+    Parser parser(tokens);
+    Context context;
+    std::vector<std::unique_ptr<AstFunction>> functions;
+    while (parser.get().Kind == TokenKind::Fn) {
+        functions.push_back(parser.parseLazyFunction());
+    }
+    ASSERT_EQ(false, functions[0]->isBodyParsed());
+    // Self-recursive bodies are parsed right away for the tail recursion rewrite.
+    ASSERT_EQ(true, functions[2]->isBodyParsed());
+    ASSERT_THROWS(functions[1]->getBody(), ParserException);
+    for (auto& func : functions) {
+        context.addFunction(std::move(func));
+    }
+
+    Interpreter interpreter(context);
+    ASSERT_EQ(42L, getLongResult(interpreter.eval(makeCall("used", {41}))));
+}
+
+
+TEST_CASE(AstCacheRoundTrip) {
+    // fn inc(a) { a + 1 }  input x in inc(x) at offsets 100 and up
+    auto incProto = std::make_unique<AstPrototype>(SourceLocation {103, 109}, "inc", std::vector<AstArg>{AstArg {SourceLocation {107, 108}, "a"}});
+    AstFunction inc(SourceLocation {100, 119}, std::move(incProto), std::make_unique<AstExprBinaryIntToInt<BinaryOpKindIntToInt::Add>>(SourceLocation {112, 117}, std::make_unique<AstExprVariable>(SourceLocation {112, 113}, "a"), std::make_unique<AstExprConstLong>(SourceLocation {116, 117}, 1L)));
+    std::vector<AstExprPtr> args;
+    args.push_back(std::make_unique<AstExprVariable>(SourceLocation {134, 135}, "x"));
+    AstExprCall call(SourceLocation {130, 136}, "inc", std::move(args));
+    inc.setInternal(true);
+
+    CachedModule module {{}, FlatAst(100), {}, {AstArg {SourceLocation {126, 127}, "x"}}, std::nullopt};
+    module.Functions.push_back(module.Ast.add(inc));
+    module.MainExpr = module.Ast.add(call);
+
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / ("ast_cache_test" + std::to_string(::getpid()));
+    AstCache cache(directory);
+    uint64_t key = AstCache::getKey("fn inc(a) { a + 1 } input x in inc(x)", true);
+    cache.store(key, module);
+    ASSERT_EQ(false, cache.lookup(key + 1, 0).has_value());
+
+    // Loaded at a different place in the location space.
+    auto loaded = cache.lookup(key, 1000);
+    ASSERT_EQ(true, loaded.has_value());
+    ASSERT_EQ(size_t(1), loaded->Functions.size());
+    ASSERT_EQ(size_t(1000), loaded->Functions[0].Location.StartPos);
+    ASSERT_EQ(size_t(1030), loaded->Ast.getLocation(*loaded->MainExpr).StartPos);
+    ASSERT_EQ(std::string("x"), loaded->MainInputs[0].Name.str());
+    ASSERT_EQ(true, loaded->Ast.toTree(loaded->Functions[0])->isInternal());
+
+    Context context;
+    context.addFunction(loaded->Ast.toTree(loaded->Functions[0]));
+    context.setValue("x", std::make_unique<InterpreterValueLong>(41L));
+    Interpreter interpreter(context);
+    ASSERT_EQ(42L, getLongResult(interpreter.eval(*loaded->Ast.toTree(*loaded->MainExpr))));
+
+    // An entry damaged anywhere, without changing its size, either misses or
+    // still reads as a well-formed tree.
+    std::filesystem::path entry = std::filesystem::directory_iterator(directory)->path();
+    std::string original(SourceBuffer::fromFile(entry.string()).text());
+    size_t misses = 0;
+    for (size_t i = 0; i < original.size(); ++i) {
+        std::string damaged = original;
+        damaged[i] = static_cast<char>(damaged[i] ^ 0x80);
+        std::ofstream(entry, std::ios::binary) << damaged;
+        auto result = cache.lookup(key, 0);
+        if (!result) {
+            ++misses;
+            continue;
+        }
+        for (const FlatFunction& func : result->Functions) {
+            result->Ast.toTree(func);
+        }
+        result->Ast.toTree(*result->MainExpr);
+    }
+    std::filesystem::remove_all(directory);
+    ASSERT_EQ(true, (misses > original.size() / 2));
+}
+
+
+TEST_CASE(DispatchByKind) {
+    auto expr = std::make_unique<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>>(SourceLocation {0, 0}, std::make_unique<AstExprConstLong>(SourceLocation {0, 0}, 1L), std::make_unique<AstExprVariable>(SourceLocation {0, 0}, "x"));
+    ASSERT_EQ(true, (expr->getKind() == AstExprKind::Lt));
+    ASSERT_EQ(true, (expr->getLHS()->getKind() == AstExprKind::ConstLong));
+
+    auto isLessThan = [](const auto& node) {
+        return std::is_same_v<std::decay_t<decltype(node)>, AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>>;
+    };
+    ASSERT_EQ(true, dispatchExpr(*expr, isLessThan));
+    ASSERT_EQ(false, dispatchExpr(*expr->getRHS(), isLessThan));
+}
+
+
+TEST_CASE(ClonesShareInternedNodes) {
+    // match { n < 1 -> n  true -> 1 } with the two n at the same location, as a rewrite copying n would leave them
+    std::vector<AstExprMatchPathPtr> paths;
+    paths.push_back(std::make_shared<AstExprMatchPath>(SourceLocation {0, 9}, std::make_shared<AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>>(SourceLocation {0, 5}, std::make_shared<AstExprVariable>(SourceLocation {0, 1}, "n"), std::make_shared<AstExprConstLong>(SourceLocation {4, 5}, 1L)), std::make_shared<AstExprVariable>(SourceLocation {0, 1}, "n")));
+    paths.push_back(std::make_shared<AstExprMatchPath>(SourceLocation {10, 19}, std::make_shared<AstExprConstBool>(SourceLocation {10, 14}, true), std::make_shared<AstExprConstLong>(SourceLocation {18, 19}, 1L)));
+    AstExprPtr match = std::make_shared<AstExprMatch>(SourceLocation {0, 20}, std::move(paths));
+    ASSERT_EQ(match.get(), match->clone().get());
+
+    AstInterner interner;
+    AstExprPtr interned = interner.intern(match);
+    const auto& path = static_cast<const AstExprMatch&>(*interned).getPaths()[0];
+    ASSERT_EQ(path->getBody(), static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>&>(*path->getGuard()).getLHS());
+    ASSERT_EQ(interned.get(), interner.intern(interned).get());
+    // The two literals 1 are written at different places: they only share a
+    // node when locations are not kept.
+    auto literals = [](const AstExprPtr& expr) {
+        const auto& paths = static_cast<const AstExprMatch&>(*expr).getPaths();
+        return std::make_pair(static_cast<const AstExprBinaryIntToBool<BinaryOpKindIntToBool::Lt>&>(*paths[0]->getGuard()).getRHS(), paths[1]->getBody());
+    };
+    auto [bound, result] = literals(interned);
+    ASSERT_EQ(bound, result);
+    AstInterner located(true);
+    auto [locatedBound, locatedResult] = literals(located.intern(match));
+    ASSERT_EQ(true, (locatedBound != locatedResult));
+
+    Context context;
+    context.setValue("n", std::make_unique<InterpreterValueLong>(0L));
+    Interpreter interpreter(context);
+    ASSERT_EQ(0L, getLongResult(interpreter.eval(*interned)));
+}
+
+
+TEST_CASE(AnalysesOfCallGraph) {
+    auto functions = parseFunctions(
+        "fn even(n) { match { n == 0 -> true  true -> odd(n - 1) } } fn odd(n) { match { n == 0 -> false  true -> even(n - 1) } } "
+        "fn count(n) { match { n == 0 -> 0  true -> count(n - 1) } } fn half(x) { x / 2 } fn f(x, y) { let z = half(x) in z + y }");
+    AnalysisManager analyses(functions);
+    ASSERT_EQ(true, (analyses.getRecursionKind("even") == RecursionKind::Mutual));
+    ASSERT_EQ(true, (analyses.getRecursionKind("count") == RecursionKind::Self));
+    ASSERT_EQ(true, (analyses.getRecursionKind("f") == RecursionKind::None));
+    // Callees come before their callers.
+    const auto& sccs = analyses.getSCCs();
+    ASSERT_EQ(size_t(4), sccs.size());
+    ASSERT_EQ(size_t(2), sccs[0].size());
+    ASSERT_EQ(true, (sccs[2][0] == Symbol("half") && sccs[3][0] == Symbol("f")));
+
+    const AstExpr& body = *functions[4]->getBody();
+    const auto& vars = analyses.getFreeVariables(body);
+    ASSERT_EQ(size_t(2), vars.size());
+    ASSERT_EQ(true, (vars[0] != vars[1] && vars[0].getId() < vars[1].getId()));
+    ASSERT_EQ(true, analyses.isPure(body));
+    ASSERT_EQ(false, analyses.isPure(Symbol("even")));
+    ASSERT_EQ(false, analyses.isPure(*functions[2]->getBody()));
+
+    // Replacing half by a division that may trap makes f impure, once the
+    // facts about the module are dropped.
+    functions[3] = std::move(parseFunctions("fn half(x) { 2 / x }").front());
+    analyses.invalidate();
+    ASSERT_EQ(false, analyses.isPure(body));
+}
+
+
+TEST_CASE(InlinesSmallNonRecursiveFunctions) {
+    auto functions = parseFunctions(
+        "fn sub(x, y) { x - y } fn twice(x) { let y = x + x in y } fn swapped(x, y) { sub(y + 0, x) } "
+        "fn shadow(y) { twice(y * 3) + sub(y, 1) } fn count(n) { match { n == 0 -> 0  true -> count(n - 1) } } "
+        "fn calls(n) { count(n) + sub(n, 1) }");
+    PassManager passes;
+    passes.addPass(std::make_unique<InlinePass>(30));
+    ASSERT_EQ(true, passes.run(functions, nullptr));
+
+    bool hasCalls = false;
+    std::function<void(const AstExpr&)> findCalls = [&](const AstExpr& expr) {
+        hasCalls = hasCalls || expr.getKind() == AstExprKind::Call;
+        forEachChild(expr, findCalls);
+    };
+    findCalls(*functions[2]->getBody());
+    findCalls(*functions[3]->getBody());
+    ASSERT_EQ(false, hasCalls);
+    // The recursive callee stays a call.
+    findCalls(*functions[5]->getBody());
+    ASSERT_EQ(true, hasCalls);
+
+    Context context;
+    for (auto& func : functions) {
+        context.addFunction(std::move(func));
+    }
+    Interpreter interpreter(context);
+    // y + 0 is bound to the parameter x while x is still the caller's.
+    ASSERT_EQ(3L, getLongResult(interpreter.eval(makeCall("swapped", {2, 5}))));
+    ASSERT_EQ(27L, getLongResult(interpreter.eval(makeCall("shadow", {4}))));
+}
+
+
+TEST_CASE(PassesKeepReplacedFunctionsUntilTheyFinish) {
+    // c is too large to inline. a is rewritten before b, whose calls to a
+    // still ask whether a is pure.
+    auto functions = parseFunctions(
+        "fn c(x) { x * x * x * x * x * x * x * x * x * x * x * x * x * x * x * x * x * x * x * x + 1 } "
+        "fn a(x) { (c(x) * 2 + x * x * x * x * x + 1) * (c(x) * 2 + x * x * x * x * x + 1) } "
+        "fn b(y) { a(y) + a(y) }");
+    PassManager passes;
+    passes.addPass(std::make_unique<InlinePass>(30));
+    passes.addPass(std::make_unique<GuardEliminationPass>());
+    passes.addPass(std::make_unique<CommonSubexpressionPass>());
+    ASSERT_EQ(true, passes.run(functions, nullptr));
+
+    Context context;
+    for (auto& func : functions) {
+        context.addFunction(std::move(func));
+    }
+    Interpreter interpreter(context);
+    ASSERT_EQ(8796386625938L, getLongResult(interpreter.eval(makeCall("b", {2}))));
+}
+
+TEST_CASE(EliminatesImpliedGuardsAndRepeatedSubexpressions) {
+    auto functions = parseFunctions(
+        "fn sign(n) { match { n < 0 -> 0 - 1  n == 0 -> 0  n > 0 -> 1  true -> 2 } } "
+        "fn square(a, b) { (a * b + b * 7) * (a * b + b * 7) + (let a = 2 in a * b + b * 7) } "
+        "fn divide(a, b) { match { a / b > 1 -> a / b  true -> 0 } } "
+        "fn same(a) { match { a == a -> 1  true -> 0 } } "
+        "fn compared(a) { match { a < 0 -> 0  a + 1 == a + 1 -> 1  true -> 2 } } "
+        "fn extreme(a) { match { a / 0 <= 9223372036854775807 -> 1  true -> 0 } } "
+        "fn pair(a) { match { [1, a] > 9223372036854775807 -> 1  true -> 0 } }");
+    AstExprPtr divide = functions[2]->getBody()->clone();
+    PassManager passes;
+    passes.addPass(std::make_unique<GuardEliminationPass>());
+    passes.addPass(std::make_unique<CommonSubexpressionPass>());
+    ASSERT_EQ(true, passes.run(functions, nullptr));
+
+    // n > 0 always holds once the first two guards failed.
+    const auto& sign = static_cast<const AstExprMatch&>(*functions[0]->getBody());
+    ASSERT_EQ(3UL, sign.getPaths().size());
+    ASSERT_EQ(true, (sign.getPaths()[2]->getGuard()->getKind() == AstExprKind::ConstBool));
+    // a * b + b * 7 is bound once; the copy under the shadowing let is kept.
+    const AstExpr* square = functions[1]->getBody();
+    ASSERT_EQ(true, (square->getKind() == AstExprKind::LetIn));
+    // Division may fail, so it is left alone.
+    ASSERT_EQ(true, (functions[2]->getBody() == divide.get()));
+    // a may not be an integer, so a == a has to fail at runtime then...
+    ASSERT_EQ(true, (functions[3]->getBody()->getKind() == AstExprKind::Match));
+    // ...unless an earlier guard compared it already.
+    ASSERT_EQ(true, (functions[4]->getBody()->getKind() == AstExprKind::Match));
+    ASSERT_EQ(2UL, static_cast<const AstExprMatch&>(*functions[4]->getBody()).getPaths().size());
+    // Neither a / 0 nor an array is an integer known to be at most the
+    // largest one: both comparisons have to fail at runtime.
+    ASSERT_EQ(true, (functions[5]->getBody()->getKind() == AstExprKind::Match));
+    ASSERT_EQ(true, (functions[6]->getBody()->getKind() == AstExprKind::Match));
+
+    Context context;
+    for (auto& func : functions) {
+        context.addFunction(std::move(func));
+    }
+    Interpreter interpreter(context);
+    ASSERT_EQ(-1L, getLongResult(interpreter.eval(makeCall("sign", {-4}))));
+    ASSERT_EQ(1L, getLongResult(interpreter.eval(makeCall("sign", {9}))));
+    ASSERT_EQ(756L, getLongResult(interpreter.eval(makeCall("square", {2, 3}))));
+    ASSERT_THROWS(interpreter.eval(makeCall("extreme", {5})), DivisionByZeroException);
+    ASSERT_THROWS(interpreter.eval(makeCall("pair", {5})), TypeMismatchException);
+}
+
 
 int main() {
     RUN_ALL_TESTS();
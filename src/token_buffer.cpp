@@ -0,0 +1,28 @@
+#include <limits>
+
+#include "token_buffer.hpp"
+
+TokenBuffer::TokenBuffer(std::string_view input, size_t baseOffset) : Input(input), BaseOffset(baseOffset) {
+    if (input.size() > std::numeric_limits<uint32_t>::max()) {
+        throw LexerException("Source files over 4 GiB are not supported", SourceLocation{baseOffset, baseOffset});
+    }
+    // Most tokens are a few characters plus a separator.
+    size_t expected = input.size() / 4 + 1;
+    Kinds.reserve(expected);
+    Starts.reserve(expected);
+    Ends.reserve(expected);
+    Values.reserve(expected);
+    Names.reserve(expected);
+
+    Lexer lexer(input, baseOffset);
+    while (true) {
+        const Token& token = lexer.get();
+        Kinds.push_back(token.Kind);
+        Starts.push_back(static_cast<uint32_t>(token.Location.StartPos - baseOffset));
+        Ends.push_back(static_cast<uint32_t>(token.Location.EndPos - baseOffset));
+        Values.push_back(token.Value);
+        Names.push_back(token.Name);
+        if (token.Kind == TokenKind::Eof) break;
+        lexer.nextToken();
+    }
+}
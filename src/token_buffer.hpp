@@ -0,0 +1,44 @@
+#ifndef TOKEN_BUFFER_HPP
+#define TOKEN_BUFFER_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "lexer.hpp"
+
+// Every token of one source, lexed up front and stored column by column so
+// the parser can index and look ahead without building Token objects. The
+// last token is always Eof.
+class TokenBuffer {
+    std::string_view Input;
+    size_t BaseOffset = 0;
+    std::vector<TokenKind> Kinds;
+    // Offsets of each token's text within Input.
+    std::vector<uint32_t> Starts;
+    std::vector<uint32_t> Ends;
+    // The value of Number tokens and the name of Identifier tokens.
+    std::vector<long> Values;
+    std::vector<Symbol> Names;
+public:
+    TokenBuffer() = default;
+    // Throws LexerException at the first invalid token. Like Token::Text, the
+    // buffer views input, which must outlive it.
+    explicit TokenBuffer(std::string_view input, size_t baseOffset = 0);
+
+    size_t size() const { return Kinds.size(); }
+    TokenKind getKind(size_t index) const { return Kinds[index]; }
+    long getValue(size_t index) const { return Values[index]; }
+    Symbol getName(size_t index) const { return Names[index]; }
+    SourceLocation getLocation(size_t index) const {
+        return SourceLocation{BaseOffset + Starts[index], BaseOffset + Ends[index]};
+    }
+    std::string_view getText(size_t index) const {
+        return Input.substr(Starts[index], Ends[index] - Starts[index]);
+    }
+    Token get(size_t index) const {
+        return Token{Kinds[index], getText(index), Values[index], getLocation(index), Names[index]};
+    }
+};
+
+#endif